@@ -21,6 +21,7 @@
 
 // ZLIB/PNG code available at http://public-domain.advel.cz/ under CC0 license
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,6 +35,9 @@
 #include <pthread.h>
 #include <errno.h>
 #endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 #ifdef __APPLE__
 #include <sys/time.h>
 #endif
@@ -399,11 +403,13 @@ typedef struct CoreThread {
    void *data;
    int from, to;
    int ack;
+   int core, cur_core;
    struct CoreThread *next;
    char padding[128];
 } CoreThread;
 
 static volatile int multicore_num_cores;
+static volatile int multicore_affinity;
 static pthread_mutex_t *multicore_mutex;
 static CoreThread *multicore_threads;
 
@@ -411,6 +417,51 @@ static uint32_t *load_png(const unsigned char *buf, int len, int *width, int *he
 static int save_png(const uint32_t *pixels, int stride, int width, int height, unsigned char **dest_out, int *dest_len_out);
 
 
+void fiximage_bind_thread_to_core(int core)
+{
+#if defined(_WIN32)
+   DWORD_PTR process_mask, system_mask, mask;
+   int i;
+
+   if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+      return;
+   }
+   mask = process_mask;
+   if (core >= 0) {
+      for (i=0; i<sizeof(DWORD_PTR)*8; i++) {
+         if ((process_mask & ((DWORD_PTR)1 << i)) && core-- == 0) {
+            mask = (DWORD_PTR)1 << i;
+            break;
+         }
+      }
+   }
+   SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(__linux__) && !defined(__EMSCRIPTEN__)
+   cpu_set_t allowed, set;
+   int i, count;
+
+   // the core index is relative to the CPUs allowed for the process (eg. as set by taskset),
+   // negative core restores all of them:
+   if (sched_getaffinity(getpid(), sizeof(allowed), &allowed) != 0) {
+      return;
+   }
+   set = allowed;
+   count = CPU_COUNT(&allowed);
+   if (core >= 0 && count > 0) {
+      core %= count;
+      CPU_ZERO(&set);
+      for (i=0; i<CPU_SETSIZE; i++) {
+         if (CPU_ISSET(i, &allowed) && core-- == 0) {
+            CPU_SET(i, &set);
+            break;
+         }
+      }
+   }
+   pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
+
+
 #if defined(_WIN32)
 static DWORD WINAPI thread_main(void *data)
 #else
@@ -441,6 +492,11 @@ static void *thread_main(void *data)
       }
       pthread_mutex_unlock(&thread->mutex);
 
+      if (thread->core != thread->cur_core) {
+         fiximage_bind_thread_to_core(thread->core);
+         thread->cur_core = thread->core;
+      }
+
       thread->func(thread->from, thread->to, thread->data);
 
       pthread_mutex_lock(&thread->mutex);
@@ -498,6 +554,9 @@ static CoreThread *acquire_thread()
    if (pthread_cond_init(&thread->cond2, NULL) != 0) goto error;
    init = 3;
 
+   thread->core = -1;
+   thread->cur_core = -1;
+
 #if defined(_WIN32)
    handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
    if (!handle) {
@@ -529,9 +588,10 @@ static void release_thread(CoreThread *thread)
 }
 
 
-static void start_in_thread(CoreThread *thread, int from, int to, MulticoreFunc func, void *data)
+static void start_in_thread(CoreThread *thread, int core, int from, int to, MulticoreFunc func, void *data)
 {
    pthread_mutex_lock(&thread->mutex);
+   thread->core = multicore_affinity? core : -1;
    thread->from = from;
    thread->to = to;
    thread->func = func;
@@ -573,6 +633,12 @@ int fiximage_get_core_count()
 }
 
 
+void fiximage_set_thread_affinity(int enable)
+{
+   multicore_affinity = enable;
+}
+
+
 void fiximage_multicore_run(int from, int to, int min_iters, MulticoreFunc func, void *data)
 {
    int i, cores, iters_per_core;
@@ -669,7 +735,7 @@ void fiximage_multicore_run(int from, int to, int min_iters, MulticoreFunc func,
       if (thread_to > to) {
          thread_to = to;
       }
-      start_in_thread(threads[i], thread_from, thread_to, func, data);
+      start_in_thread(threads[i], i, thread_from, thread_to, func, data);
    }
 
    for (i=0; i<cores; i++) {
@@ -3677,7 +3743,7 @@ static Value painter_fill_shape(Heap *heap, Value *error, int num_params, Value
                }
             }
             for (i=0; i<multicore_num_cores; i++) {
-               start_in_thread(p->geom_threads[i], i, i, process_geometry_in_thread, p);
+               start_in_thread(p->geom_threads[i], i, i, i, process_geometry_in_thread, p);
             }
          }
 
@@ -5366,6 +5432,13 @@ static Value image_remap_color_ramps(Heap *heap, Value *error, int num_params, V
 }
 
 
+static Value image_set_thread_affinity(Heap *heap, Value *error, int num_params, Value *params, void *func_data)
+{
+   fiximage_set_thread_affinity(params[0].value != 0);
+   return fixscript_int(0);
+}
+
+
 void fiximage_register_functions(Heap *heap)
 {
    fixscript_register_handle_types(&handles_offset, NUM_HANDLE_TYPES);
@@ -5389,6 +5462,7 @@ void fiximage_register_functions(Heap *heap)
    fixscript_register_native_func(heap, "image_load#1", image_load, NULL);
    fixscript_register_native_func(heap, "image_blur_box#4", image_blur_box, NULL);
    fixscript_register_native_func(heap, "image_remap_color_ramps#2", image_remap_color_ramps, NULL);
+   fixscript_register_native_func(heap, "image_set_thread_affinity#1", image_set_thread_affinity, NULL);
 }
 
 
@@ -42,6 +42,8 @@ void fiximage_register_functions(Heap *heap);
 
 int fiximage_get_core_count();
 void fiximage_multicore_run(int from, int to, int min_iters, MulticoreFunc func, void *data);
+void fiximage_set_thread_affinity(int enable);
+void fiximage_bind_thread_to_core(int core);
 
 #ifdef __cplusplus
 }
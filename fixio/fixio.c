@@ -48,8 +48,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/poll.h>
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <fcntl.h>
 #include <netdb.h>
@@ -73,6 +76,9 @@
 #include <sys/time.h>
 #include <sys/wait.h>
 #endif
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include <locale.h>
 #ifndef __wasm__
 #include <sys/ioctl.h>
@@ -118,6 +124,12 @@ enum {
 #define USE_POLL
 #endif
 
+#if defined(USE_EPOLL) && defined(FIXIO_IO_URING)
+#define USE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 #if defined(USE_EPOLL)
 
 typedef struct {
@@ -233,9 +245,10 @@ static void *poll_get_event(Poll *poll, int *flags)
          continue;
       }
 
+      // the hang up of a pipe is reported without the other flags:
       *flags = 0;
-      if (event->events & EPOLLIN) *flags |= ASYNC_READ;
-      if (event->events & EPOLLOUT) *flags |= ASYNC_WRITE;
+      if (event->events & (EPOLLIN | EPOLLHUP | EPOLLERR)) *flags |= ASYNC_READ;
+      if (event->events & (EPOLLOUT | EPOLLERR)) *flags |= ASYNC_WRITE;
       return event->data.ptr;
    }
 }
@@ -395,10 +408,11 @@ static void *poll_get_event(Poll *poll, int *flags)
          continue;
       }
 
-      if (poll->fds[i].revents & (POLLIN | POLLOUT)) {
+      if (poll->fds[i].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)) {
+         // the hang up of a pipe is reported without the other flags:
          *flags = 0;
-         if (poll->fds[i].revents & POLLIN) *flags |= ASYNC_READ;
-         if (poll->fds[i].revents & POLLOUT) *flags |= ASYNC_WRITE;
+         if (poll->fds[i].revents & (POLLIN | POLLHUP | POLLERR)) *flags |= ASYNC_READ;
+         if (poll->fds[i].revents & (POLLOUT | POLLERR)) *flags |= ASYNC_WRITE;
          poll->pending--;
          return poll->data[i];
       }
@@ -409,11 +423,248 @@ static void *poll_get_event(Poll *poll, int *flags)
 
 #endif
 
+#ifdef USE_IO_URING
+
+enum {
+   RING_OP_POLL,
+   RING_OP_READ,
+   RING_OP_WRITE,
+   RING_OP_ACCEPT,
+   RING_OP_CANCEL
+};
+
+#define RING_OP_MASK 7
+
+typedef struct {
+   int fd;
+   unsigned entries;
+   unsigned *sq_head, *sq_tail, *sq_mask;
+   unsigned *cq_head, *cq_tail, *cq_mask;
+   struct io_uring_sqe *sqes;
+   struct io_uring_cqe *cqes;
+   void *sq_ptr, *cq_ptr;
+   size_t sq_size, cq_size, sqes_size;
+   unsigned to_submit;
+   int immediate;
+} Ring;
+
+static void ring_destroy(Ring *ring)
+{
+   if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+   if (ring->cq_ptr) munmap(ring->cq_ptr, ring->cq_size);
+   if (ring->sq_ptr) munmap(ring->sq_ptr, ring->sq_size);
+   close(ring->fd);
+   free(ring);
+}
+
+static Ring *ring_create(int entries)
+{
+   struct io_uring_params params;
+   unsigned *array;
+   Ring *ring;
+   void *ptr;
+   int i;
+
+   ring = calloc(1, sizeof(Ring));
+   if (!ring) {
+      return NULL;
+   }
+
+   memset(&params, 0, sizeof(params));
+   ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+   if (ring->fd < 0) {
+      free(ring);
+      return NULL;
+   }
+
+   // waiting with a timeout requires the extended arguments (Linux 5.11), the fast poll is needed
+   // for the kernel to wait for the readiness of non-blocking sockets instead of returning EAGAIN:
+   if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_FAST_POLL)) {
+      ring_destroy(ring);
+      return NULL;
+   }
+
+   ring->entries = params.sq_entries;
+   ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+   ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+   ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+   ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+   if (ptr == MAP_FAILED) {
+      ring_destroy(ring);
+      return NULL;
+   }
+   ring->sq_ptr = ptr;
+
+   ptr = mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+   if (ptr == MAP_FAILED) {
+      ring_destroy(ring);
+      return NULL;
+   }
+   ring->cq_ptr = ptr;
+
+   ptr = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+   if (ptr == MAP_FAILED) {
+      ring_destroy(ring);
+      return NULL;
+   }
+   ring->sqes = ptr;
+
+   ring->sq_head = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+   ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+   ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+   ring->cq_head = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+   ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+   ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+   ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+
+   array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+   for (i=0; i<params.sq_entries; i++) {
+      array[i] = i;
+   }
+   return ring;
+}
+
+static void ring_submit(Ring *ring)
+{
+   int ret;
+
+   while (ring->to_submit > 0) {
+      ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, 0, 0, NULL, 0);
+      if (ret < 0) {
+         if (errno == EINTR) continue;
+         break;
+      }
+      ring->to_submit -= ret;
+   }
+}
+
+static struct io_uring_sqe *ring_get_sqe(Ring *ring)
+{
+   struct io_uring_sqe *sqe;
+   unsigned tail;
+
+   tail = *ring->sq_tail;
+   if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries) {
+      ring_submit(ring);
+      if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries) {
+         return NULL;
+      }
+   }
+
+   sqe = &ring->sqes[tail & *ring->sq_mask];
+   memset(sqe, 0, sizeof(struct io_uring_sqe));
+   return sqe;
+}
+
+static void ring_commit(Ring *ring)
+{
+   __atomic_store_n(ring->sq_tail, *ring->sq_tail + 1, __ATOMIC_RELEASE);
+   ring->to_submit++;
+   if (ring->immediate) {
+      ring_submit(ring);
+   }
+}
+
+static int ring_add(Ring *ring, int opcode, int fd, void *buf, int len, void *data, int op)
+{
+   struct io_uring_sqe *sqe;
+
+   sqe = ring_get_sqe(ring);
+   if (!sqe) {
+      return 0;
+   }
+
+   sqe->opcode = opcode;
+   sqe->fd = fd;
+   sqe->addr = (uintptr_t)buf;
+   sqe->len = len;
+   if (opcode == IORING_OP_SEND) {
+      sqe->msg_flags = MSG_NOSIGNAL;
+   }
+   else if (opcode == IORING_OP_POLL_ADD) {
+      sqe->poll32_events = POLLIN;
+   }
+   else if (opcode == IORING_OP_ACCEPT) {
+      sqe->accept_flags = SOCK_NONBLOCK;
+   }
+   sqe->user_data = (uintptr_t)data | op;
+   ring_commit(ring);
+   return 1;
+}
+
+static int ring_reserve(char **buf, int *size, int len)
+{
+   char *new_buf;
+
+   if (len > *size) {
+      new_buf = realloc(*buf, len);
+      if (!new_buf) {
+         return 0;
+      }
+      *buf = new_buf;
+      *size = len;
+   }
+   return 1;
+}
+
+static void ring_cancel(Ring *ring, void *data, int op)
+{
+   ring_add(ring, IORING_OP_ASYNC_CANCEL, -1, (void *)((uintptr_t)data | op), 0, NULL, RING_OP_CANCEL);
+}
+
+static void ring_wait(Ring *ring, int timeout)
+{
+   struct io_uring_getevents_arg arg;
+   struct __kernel_timespec ts;
+   unsigned to_submit;
+   int ret, min_complete;
+
+   memset(&arg, 0, sizeof(arg));
+   if (timeout >= 0) {
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000LL;
+      arg.ts = (uintptr_t)&ts;
+   }
+
+   // pending submissions are sent together with the wait, in the immediate mode they're submitted from other thread:
+   to_submit = ring->immediate? 0 : ring->to_submit;
+   min_complete = (*ring->cq_head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))? 1 : 0;
+
+   ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+   if (ret > 0 && !ring->immediate) {
+      ring->to_submit -= ret;
+   }
+}
+
+static int ring_get_event(Ring *ring, void **data, int *op, int *result)
+{
+   struct io_uring_cqe *cqe;
+   unsigned head;
+
+   head = *ring->cq_head;
+   if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      return 0;
+   }
+
+   cqe = &ring->cqes[head & *ring->cq_mask];
+   *data = (void *)(uintptr_t)(cqe->user_data & ~(uint64_t)RING_OP_MASK);
+   *op = cqe->user_data & RING_OP_MASK;
+   *result = cqe->res;
+   __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+   return 1;
+}
+
+#endif
+
 #ifdef __wasm__
 typedef int pid_t;
 #endif
 
 #ifdef _WIN32
+#ifndef SIO_UDP_CONNRESET
+#define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR, 12)
+#endif
 #define ETIMEDOUT -1000
 typedef CRITICAL_SECTION pthread_mutex_t;
 typedef HANDLE pthread_cond_t;
@@ -461,9 +712,25 @@ enum {
 
 enum {
    ASYNC_TCP_CONNECTION,
-   ASYNC_TCP_SERVER
+   ASYNC_TCP_SERVER,
+   ASYNC_FILE,
+   ASYNC_UDP_SOCKET,
+   ASYNC_PROCESS_STREAM,
+   ASYNC_PROCESS_SPLICE
+};
+
+#define UDP_MSG_SIZE  4
+#define UDP_MAX_BATCH 1024
+
+enum {
+   FILE_OP_OPEN,
+   FILE_OP_READ,
+   FILE_OP_WRITE,
+   FILE_OP_SYNC
 };
 
+#define ASYNC_FILE_CLOSING 0x40000000
+
 enum {
    REDIR_IN        = 0x01,
    REDIR_OUT       = 0x02,
@@ -698,6 +965,7 @@ typedef struct {
    int fd;
 #endif
    int mode;
+   volatile int async_ops;
 } FileHandle;
 
 typedef struct {
@@ -718,9 +986,20 @@ typedef struct {
    SOCKET socket;
 #else
    int fd;
+   char *unix_path;
 #endif
 } TCPServerHandle;
 
+typedef struct {
+   volatile int refcnt;
+   volatile int closed;
+#if defined(_WIN32)
+   SOCKET socket;
+#else
+   int fd;
+#endif
+} UDPSocketHandle;
+
 typedef struct AsyncThreadResult {
    int type;
    Value callback;
@@ -730,6 +1009,8 @@ typedef struct AsyncThreadResult {
 #else
    int fd;
 #endif
+   struct AsyncFileOp *file_op;
+   int64_t length;
    struct AsyncThreadResult *next;
 } AsyncThreadResult;
 
@@ -741,6 +1022,21 @@ typedef struct AsyncTimer {
    struct AsyncTimer *next;
 } AsyncTimer;
 
+#define WHEEL_ROOT_BITS  8
+#define WHEEL_LEVEL_BITS 6
+#define WHEEL_ROOT_SIZE  (1 << WHEEL_ROOT_BITS)
+#define WHEEL_LEVEL_SIZE (1 << WHEEL_LEVEL_BITS)
+
+typedef struct {
+   uint32_t base;
+   int count;
+   AsyncTimer *immediate_first;
+   AsyncTimer *immediate_last;
+   AsyncTimer *root[WHEEL_ROOT_SIZE];
+   uint64_t root_bitmap[WHEEL_ROOT_SIZE/64];
+   AsyncTimer *levels[4][WHEEL_LEVEL_SIZE];
+} TimerWheel;
+
 #ifdef _WIN32
 typedef struct {
    DWORD transferred;
@@ -753,6 +1049,8 @@ typedef struct {
    volatile int refcnt;
    pthread_mutex_t mutex;
    AsyncThreadResult *thread_results;
+   struct AsyncFileOp *file_ops_first, *file_ops_last;
+   int file_ops_active, file_ops_max;
 #if defined(_WIN32)
    HANDLE iocp;
    CompletedIO completed_ios[32];
@@ -761,10 +1059,14 @@ typedef struct {
    void *poll;
 #else
    Poll *poll;
+#endif
+#ifdef USE_IO_URING
+   Ring *ring;
+   void *ring_freed_handles;
 #endif
    int quit;
    Value quit_value;
-   AsyncTimer *timers;
+   TimerWheel timers;
 
    pthread_mutex_t foreign_mutex;
    pthread_cond_t foreign_cond;
@@ -773,14 +1075,39 @@ typedef struct {
    int foreign_processed;
 } AsyncProcess;
 
+typedef struct AsyncFileOp {
+   AsyncProcess *proc;
+   int type;
+   FileHandle *file;
+#if defined(_WIN32)
+   uint16_t *fname;
+#else
+   char *fname;
+#endif
+   int mode;
+   uint64_t pos;
+   char *buf;
+   int len, read_ahead, result;
+   Value callback;
+   Value data;
+   Value array;
+   int off;
+   AsyncThreadResult *atr;
+   struct AsyncFileOp *next;
+} AsyncFileOp;
+
 typedef struct {
    Value callback;
    Value data;
    Value array;
    int off, len;
+   int fd_passing;
 #if defined(_WIN32)
    char buf[1024];
    WSAOVERLAPPED overlapped;
+#elif defined(USE_IO_URING)
+   char *ring_buf;
+   int ring_buf_size;
 #endif
 } AsyncRead;
 
@@ -793,8 +1120,13 @@ typedef struct {
 #else
    int result;
 #endif
+#ifdef USE_IO_URING
+   char *ring_buf;
+   int ring_buf_size;
+#endif
 } AsyncWrite;
 
+// common part of all kinds of async handles, must be the first field:
 typedef struct {
    AsyncProcess *proc;
    int type;
@@ -803,29 +1135,56 @@ typedef struct {
 #else
    int fd;
    int last_active;
+#endif
+#ifdef USE_IO_URING
+   int ring_pending;
+   int ring_freed;
+   void *ring_freed_next;
 #endif
    int active;
+} AsyncCommon;
+
+typedef struct {
+   AsyncCommon common;
    AsyncRead read;
    AsyncWrite write;
 } AsyncHandle;
 
 typedef struct {
-   AsyncProcess *proc;
-   int type;
+   AsyncCommon common;
 #if defined(_WIN32)
-   SOCKET socket;
    SOCKET accept_socket;
    char buf[(sizeof(struct sockaddr_in)+16)*2];
    OVERLAPPED overlapped;
-#else
-   int fd;
-   int last_active;
 #endif
-   int active;
    Value callback;
    Value data;
+#if !defined(_WIN32)
+   char *unix_path;
+#endif
 } AsyncServerHandle;
 
+typedef struct {
+   AsyncCommon common;
+   Value read_callback;
+   Value read_data;
+   Value read_array;
+   Value read_msgs;
+   int slot_size;
+   Value write_callback;
+   Value write_data;
+   int write_result;
+#if defined(_WIN32)
+   char *read_buf;
+   int read_buf_size;
+   struct sockaddr_in read_addr;
+   int read_addr_len;
+   DWORD read_flags;
+   WSAOVERLAPPED read_overlapped;
+   WSAOVERLAPPED write_overlapped;
+#endif
+} AsyncUDPHandle;
+
 typedef struct {
    volatile int refcnt;
    int flags;
@@ -868,7 +1227,7 @@ typedef struct {
 
 typedef int (*CompressFunc)(void *st);
 
-#define NUM_HANDLE_TYPES 11
+#define NUM_HANDLE_TYPES 13
 #define HANDLE_TYPE_ZCOMPRESS       (handles_offset+0)
 #define HANDLE_TYPE_ZUNCOMPRESS     (handles_offset+1)
 #define HANDLE_TYPE_GZIP_COMPRESS   (handles_offset+2)
@@ -880,6 +1239,8 @@ typedef int (*CompressFunc)(void *st);
 #define HANDLE_TYPE_PROCESS         (handles_offset+8)
 #define HANDLE_TYPE_SQLITE          (handles_offset+9)
 #define HANDLE_TYPE_SQLITE_STMT     (handles_offset+10)
+#define HANDLE_TYPE_DIRECTORY       (handles_offset+11)
+#define HANDLE_TYPE_UDP_SOCKET      (handles_offset+12)
 
 static volatile int handles_offset;
 static volatile int async_process_key;
@@ -4567,33 +4928,91 @@ error:
 #endif /* __wasm__ */
 
 
+static const char *get_file_mode_error(int mode)
+{
+   if ((mode & (SCRIPT_FILE_READ | SCRIPT_FILE_WRITE)) == 0) {
+      return "file must be opened for reading and/or writing";
+   }
+
+   if ((mode & (SCRIPT_FILE_CREATE | SCRIPT_FILE_TRUNCATE | SCRIPT_FILE_APPEND)) && (mode & SCRIPT_FILE_WRITE) == 0) {
+      return "file must be opened for writing when create, truncate and/or append mode is requested";
+   }
+
+   if ((mode & SCRIPT_FILE_APPEND) && (mode & SCRIPT_FILE_READ)) {
+      return "file must be opened in write only mode when appending";
+   }
+   return NULL;
+}
+
+
+#if defined(_WIN32)
+static int open_file_handle(FileHandle *handle, uint16_t *fname, int mode)
+{
+   DWORD flags = 0, creation = OPEN_EXISTING;
+
+   if (mode & SCRIPT_FILE_APPEND) {
+      flags = FILE_APPEND_DATA;
+   }
+   else {
+      if (mode & SCRIPT_FILE_READ) flags |= GENERIC_READ;
+      if (mode & SCRIPT_FILE_WRITE) flags |= GENERIC_WRITE;
+   }
+   switch (mode & (SCRIPT_FILE_CREATE | SCRIPT_FILE_TRUNCATE)) {
+      case 0:                                         creation = OPEN_EXISTING; break;
+      case SCRIPT_FILE_CREATE:                        creation = OPEN_ALWAYS; break;
+      case SCRIPT_FILE_TRUNCATE:                      creation = TRUNCATE_EXISTING; break;
+      case SCRIPT_FILE_CREATE | SCRIPT_FILE_TRUNCATE: creation = CREATE_ALWAYS; break;
+   }
+   handle->handle = CreateFile(fname, flags, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, creation, FILE_ATTRIBUTE_NORMAL, NULL);
+   return handle->handle != INVALID_HANDLE_VALUE;
+}
+#elif !defined(__wasm__)
+static int open_file_handle(FileHandle *handle, char *fname, int mode)
+{
+   int flags;
+
+   switch (mode & (SCRIPT_FILE_READ | SCRIPT_FILE_WRITE)) {
+      case SCRIPT_FILE_READ: flags = O_RDONLY; break;
+      case SCRIPT_FILE_WRITE: flags = O_WRONLY; break;
+      default: flags = O_RDWR; break;
+   }
+   if (mode & SCRIPT_FILE_CREATE) {
+      flags |= O_CREAT;
+   }
+   if (mode & SCRIPT_FILE_TRUNCATE) {
+      flags |= O_TRUNC;
+   }
+   if (mode & SCRIPT_FILE_APPEND) {
+      flags |= O_APPEND;
+   }
+   
+   handle->fd = open(fname, flags, 0666);
+   return handle->fd != -1;
+}
+#endif
+
+
 static Value native_file_open(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
    FileHandle *handle = NULL;
    Value retval = fixscript_int(0);
 #if defined(_WIN32)
    uint16_t *fname_utf16 = NULL;
-   DWORD creation;
 #elif defined(__wasm__)
    FileOpenCont *cont;
 #endif
+   const char *msg;
    char *fname = NULL, *s;
    int mode = fixscript_get_int(params[1]);
    size_t len;
-   int err, flags;
-
-   if ((mode & (SCRIPT_FILE_READ | SCRIPT_FILE_WRITE)) == 0) {
-      *error = fixscript_create_error_string(heap, "file must be opened for reading and/or writing");
-      goto error;
-   }
-
-   if ((mode & (SCRIPT_FILE_CREATE | SCRIPT_FILE_TRUNCATE | SCRIPT_FILE_APPEND)) && (mode & SCRIPT_FILE_WRITE) == 0) {
-      *error = fixscript_create_error_string(heap, "file must be opened for writing when create, truncate and/or append mode is requested");
-      goto error;
-   }
+   int err;
+#ifdef __wasm__
+   int flags;
+#endif
 
-   if ((mode & SCRIPT_FILE_APPEND) && (mode & SCRIPT_FILE_READ)) {
-      *error = fixscript_create_error_string(heap, "file must be opened in write only mode when appending");
+   msg = get_file_mode_error(mode);
+   if (msg) {
+      *error = fixscript_create_error_string(heap, msg);
       goto error;
    }
 
@@ -4616,22 +5035,7 @@ static Value native_file_open(Heap *heap, Value *error, int num_params, Value *p
    handle->mode = mode;
 
 #if defined(_WIN32)
-   flags = 0;
-   if (mode & SCRIPT_FILE_APPEND) {
-      flags = FILE_APPEND_DATA;
-   }
-   else {
-      if (mode & SCRIPT_FILE_READ) flags |= GENERIC_READ;
-      if (mode & SCRIPT_FILE_WRITE) flags |= GENERIC_WRITE;
-   }
-   switch (mode & (SCRIPT_FILE_CREATE | SCRIPT_FILE_TRUNCATE)) {
-      case 0:                                         creation = OPEN_EXISTING; break;
-      case SCRIPT_FILE_CREATE:                        creation = OPEN_ALWAYS; break;
-      case SCRIPT_FILE_TRUNCATE:                      creation = TRUNCATE_EXISTING; break;
-      case SCRIPT_FILE_CREATE | SCRIPT_FILE_TRUNCATE: creation = CREATE_ALWAYS; break;
-   }
-   handle->handle = CreateFile(fname_utf16, flags, FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, creation, FILE_ATTRIBUTE_NORMAL, NULL);
-   if (handle->handle == INVALID_HANDLE_VALUE) {
+   if (!open_file_handle(handle, fname_utf16, mode)) {
       len = strlen(fname);
       if (len > INT_MAX-64) {
          fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
@@ -4701,23 +5105,7 @@ static Value native_file_open(Heap *heap, Value *error, int num_params, Value *p
       goto error;
    }
 #else
-   switch (mode & (SCRIPT_FILE_READ | SCRIPT_FILE_WRITE)) {
-      case SCRIPT_FILE_READ: flags = O_RDONLY; break;
-      case SCRIPT_FILE_WRITE: flags = O_WRONLY; break;
-      default: flags = O_RDWR; break;
-   }
-   if (mode & SCRIPT_FILE_CREATE) {
-      flags |= O_CREAT;
-   }
-   if (mode & SCRIPT_FILE_TRUNCATE) {
-      flags |= O_TRUNC;
-   }
-   if (mode & SCRIPT_FILE_APPEND) {
-      flags |= O_APPEND;
-   }
-   
-   handle->fd = open(fname, flags, 0666);
-   if (handle->fd == -1) {
+   if (!open_file_handle(handle, fname, mode)) {
       len = strlen(fname);
       if (len > INT_MAX-64) {
          fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
@@ -5832,9 +6220,193 @@ static Value native_file_get_native_handle(Heap *heap, Value *error, int num_par
 }
 
 
-static Value native_file_exists(Heap *heap, Value *error, int num_params, Value *params, void *data)
+#ifndef __wasm__
+typedef struct {
+   void *ptr;
+   size_t size;
+} MappedFile;
+
+static void free_mapped_file(void *data)
 {
-   *error = fixscript_create_error_string(heap, "not implemented yet");
+   MappedFile *map = data;
+
+#if defined(_WIN32)
+   UnmapViewOfFile(map->ptr);
+#else
+   munmap(map->ptr, map->size);
+#endif
+   free(map);
+}
+#endif
+
+
+static Value native_file_map(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   MappedFile *map = NULL;
+   Value retval = fixscript_int(0);
+#if defined(_WIN32)
+   uint16_t *fname_utf16 = NULL;
+   HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+   SYSTEM_INFO si;
+   LARGE_INTEGER size;
+#else
+   int fd = -1;
+   struct stat buf;
+#endif
+   char *fname = NULL, *s;
+   uint64_t offset, file_size, aligned_offset;
+   int64_t len = params[3].value;
+   int mode = fixscript_get_int(params[4]);
+   size_t slen;
+   int err, granularity;
+
+   offset = ((uint32_t)params[1].value) | (((uint64_t)params[2].value) << 32);
+
+   if ((mode & SCRIPT_FILE_READ) == 0 || (mode & ~(SCRIPT_FILE_READ | SCRIPT_FILE_WRITE)) != 0) {
+      *error = fixscript_create_error_string(heap, "file must be mapped for reading or for reading and writing");
+      goto error;
+   }
+
+#if defined(_WIN32)
+   err = fixscript_get_string_utf16(heap, params[0], 0, -1, &fname_utf16, NULL);
+#else
+   err = 0;
+#endif
+   if (!err) {
+      err = fixscript_get_string(heap, params[0], 0, -1, &fname, NULL);
+   }
+   if (err) {
+      fixscript_error(heap, error, err);
+      goto error;
+   }
+
+#if defined(_WIN32)
+   file = CreateFile(fname_utf16, GENERIC_READ | ((mode & SCRIPT_FILE_WRITE)? GENERIC_WRITE : 0), FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (file == INVALID_HANDLE_VALUE) goto open_error;
+   if (!GetFileSizeEx(file, &size)) goto io_error;
+   file_size = size.QuadPart;
+   GetSystemInfo(&si);
+   granularity = si.dwAllocationGranularity;
+#else
+   fd = open(fname, (mode & SCRIPT_FILE_WRITE)? O_RDWR : O_RDONLY);
+   if (fd == -1) goto open_error;
+   if (fstat(fd, &buf) != 0) goto io_error;
+   file_size = buf.st_size;
+   granularity = sysconf(_SC_PAGESIZE);
+#endif
+
+   if (offset > file_size) {
+      *error = fixscript_create_error_string(heap, "offset is past the end of file");
+      goto error;
+   }
+   if (len < 0) {
+      len = file_size - offset;
+      if (len > INT_MAX) {
+         *error = fixscript_create_error_string(heap, "file is too big");
+         goto error;
+      }
+   }
+   else if (len > file_size - offset) {
+      *error = fixscript_create_error_string(heap, "unexpected end of file");
+      goto error;
+   }
+
+   if (len == 0) {
+      retval = fixscript_create_shared_array(heap, 0, 1);
+      if (!retval.value) {
+         fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      goto error;
+   }
+
+   map = calloc(1, sizeof(MappedFile));
+   if (!map) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+   // the mapping must start at a page boundary:
+   aligned_offset = offset & ~((uint64_t)granularity - 1);
+   map->size = (offset - aligned_offset) + len;
+
+   // read only mappings are mapped as copy-on-write so writes from the script can't crash the process:
+#if defined(_WIN32)
+   mapping = CreateFileMapping(file, NULL, (mode & SCRIPT_FILE_WRITE)? PAGE_READWRITE : PAGE_WRITECOPY, 0, 0, NULL);
+   if (!mapping) goto io_error;
+   map->ptr = MapViewOfFile(mapping, (mode & SCRIPT_FILE_WRITE)? FILE_MAP_WRITE : FILE_MAP_COPY, (DWORD)(aligned_offset >> 32), (DWORD)aligned_offset, map->size);
+   if (!map->ptr) goto io_error;
+#else
+   map->ptr = mmap(NULL, map->size, PROT_READ | PROT_WRITE, (mode & SCRIPT_FILE_WRITE)? MAP_SHARED : MAP_PRIVATE, fd, aligned_offset);
+   if (map->ptr == MAP_FAILED) {
+      map->ptr = NULL;
+      goto io_error;
+   }
+#endif
+
+   // the mapping is freed by the shared array also when the creation fails:
+   retval = fixscript_create_or_get_shared_array(heap, -1, (char *)map->ptr + (offset - aligned_offset), len, 1, free_mapped_file, map, NULL);
+   map = NULL;
+   if (!retval.value) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   goto error;
+
+open_error:
+   slen = strlen(fname);
+   if (slen > INT_MAX-64) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+   slen += 64;
+   s = malloc(slen);
+   if (!s) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+   snprintf(s, slen, "can't open file '%s'", fname);
+   *error = fixscript_create_error_string(heap, s);
+   free(s);
+   goto error;
+
+io_error:
+   *error = fixscript_create_error_string(heap, "I/O error");
+
+error:
+   if (map) {
+      if (map->ptr) {
+         free_mapped_file(map);
+      }
+      else {
+         free(map);
+      }
+   }
+   free(fname);
+#if defined(_WIN32)
+   free(fname_utf16);
+   // the view keeps the file mapped after the handles are closed:
+   if (mapping) {
+      CloseHandle(mapping);
+   }
+   if (file != INVALID_HANDLE_VALUE) {
+      CloseHandle(file);
+   }
+#else
+   if (fd != -1) {
+      close(fd);
+   }
+#endif
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+static Value native_file_exists(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   *error = fixscript_create_error_string(heap, "not implemented yet");
    return fixscript_int(0);
 }
 
@@ -6027,7 +6599,210 @@ error:
    return 0;
 }
 #endif /* __wasm__ */
- 
+
+
+#if !defined(_WIN32) && !defined(__wasm__)
+typedef struct {
+   struct msghdr msg;
+   struct iovec iov;
+   char byte;
+   union {
+      struct cmsghdr hdr;
+      char buf[CMSG_SPACE(sizeof(int))];
+   } control;
+} FDMessage;
+
+static int unix_set_address(struct sockaddr_un *addr, const char *path)
+{
+   memset(addr, 0, sizeof(struct sockaddr_un));
+   addr->sun_family = AF_UNIX;
+   if (strlen(path) >= sizeof(addr->sun_path)) {
+      return 0;
+   }
+   strcpy(addr->sun_path, path);
+   return 1;
+}
+
+
+static int unix_connect(const char *path, int *ret)
+{
+   struct sockaddr_un addr;
+   int fd, err;
+
+   if (!unix_set_address(&addr, path)) {
+      errno = ENAMETOOLONG;
+      return 0;
+   }
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1) {
+      return 0;
+   }
+
+   if (connect(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0) {
+      err = errno;
+      close(fd);
+      errno = err;
+      return 0;
+   }
+
+   *ret = fd;
+   return 1;
+}
+
+
+static int unix_listen(const char *path, int *ret)
+{
+   struct sockaddr_un addr;
+   struct stat st;
+   int fd, other_fd;
+
+   if (!unix_set_address(&addr, path)) {
+      return 0;
+   }
+
+   fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   if (fd == -1) {
+      return 0;
+   }
+
+   if (bind(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0) {
+      if (errno != EADDRINUSE) {
+         goto error;
+      }
+
+      // remove the socket file left by a server that is no longer running:
+      if (lstat(path, &st) != 0 || !S_ISSOCK(st.st_mode)) {
+         errno = EADDRINUSE;
+         goto error;
+      }
+      if (unix_connect(path, &other_fd)) {
+         close(other_fd);
+         errno = EADDRINUSE;
+         goto error;
+      }
+      if (errno != ECONNREFUSED || unlink(path) != 0) {
+         goto error;
+      }
+      if (bind(fd, (struct sockaddr *)&addr, sizeof(struct sockaddr_un)) != 0) {
+         goto error;
+      }
+   }
+
+   if (listen(fd, 5) != 0) {
+      unlink(path);
+      goto error;
+   }
+
+   *ret = fd;
+   return 1;
+
+error:
+   close(fd);
+   return 0;
+}
+
+
+static void fd_message_init(FDMessage *fdm, int passed_fd)
+{
+   struct cmsghdr *cmsg;
+
+   memset(fdm, 0, sizeof(FDMessage));
+   fdm->iov.iov_base = &fdm->byte;
+   fdm->iov.iov_len = 1;
+   fdm->msg.msg_iov = &fdm->iov;
+   fdm->msg.msg_iovlen = 1;
+   fdm->msg.msg_control = fdm->control.buf;
+   fdm->msg.msg_controllen = sizeof(fdm->control.buf);
+
+   if (passed_fd != -1) {
+      cmsg = CMSG_FIRSTHDR(&fdm->msg);
+      cmsg->cmsg_level = SOL_SOCKET;
+      cmsg->cmsg_type = SCM_RIGHTS;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+      memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+   }
+}
+
+
+static int fd_message_get_fd(FDMessage *fdm)
+{
+   struct cmsghdr *cmsg;
+   int fd = -1;
+
+   for (cmsg = CMSG_FIRSTHDR(&fdm->msg); cmsg; cmsg = CMSG_NXTHDR(&fdm->msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS && cmsg->cmsg_len >= CMSG_LEN(sizeof(int))) {
+         memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+         break;
+      }
+   }
+   return fd;
+}
+
+
+static int unix_send_fd(int fd, int passed_fd, int flags)
+{
+   FDMessage fdm;
+   int ret;
+
+   fd_message_init(&fdm, passed_fd);
+   do {
+      ret = sendmsg(fd, &fdm.msg, flags);
+   }
+   while (ret < 0 && errno == EINTR);
+   return ret;
+}
+
+
+static int unix_receive_fd(int fd, int flags, int *passed_fd)
+{
+   FDMessage fdm;
+   int ret;
+
+   fd_message_init(&fdm, -1);
+   do {
+      ret = recvmsg(fd, &fdm.msg, flags);
+   }
+   while (ret < 0 && errno == EINTR);
+
+   *passed_fd = ret > 0? fd_message_get_fd(&fdm) : -1;
+   if (ret > 0 && *passed_fd == -1) {
+      // a byte without a file descriptor is not part of the protocol:
+      errno = EPROTO;
+      ret = -1;
+   }
+   return ret;
+}
+
+
+static int get_passed_fd(Heap *heap, Value *error, Value conn_val)
+{
+   TCPConnectionHandle *conn;
+   AsyncHandle *async_conn;
+
+   conn = fixscript_get_handle(heap, conn_val, HANDLE_TYPE_TCP_CONNECTION, NULL);
+   if (conn) {
+      if (conn->closed) {
+         *error = fixscript_create_error_string(heap, "TCP connection is already closed");
+         return -1;
+      }
+      return conn->fd;
+   }
+
+   async_conn = fixscript_get_handle(heap, conn_val, HANDLE_TYPE_ASYNC, NULL);
+   if (async_conn && async_conn->common.type == ASYNC_TCP_CONNECTION) {
+      if (async_conn->common.fd == -1) {
+         *error = fixscript_create_error_string(heap, "TCP connection is already closed");
+         return -1;
+      }
+      return async_conn->common.fd;
+   }
+
+   *error = fixscript_create_error_string(heap, "invalid TCP connection handle");
+   return -1;
+}
+#endif
+
 
 static Value native_tcp_connection_open(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
@@ -6035,6 +6810,7 @@ static Value native_tcp_connection_open(Heap *heap, Value *error, int num_params
    *error = fixscript_create_error_string(heap, "not supported");
    return fixscript_int(0);
 #else
+   int unix_socket = data == (void *)1;
    TCPConnectionHandle *handle;
    char *hostname = NULL;
    char buf[128];
@@ -6046,6 +6822,13 @@ static Value native_tcp_connection_open(Heap *heap, Value *error, int num_params
    int fd = -1;
 #endif
 
+#if defined(_WIN32)
+   if (unix_socket) {
+      *error = fixscript_create_error_string(heap, "not supported");
+      return fixscript_int(0);
+   }
+#endif
+
    err = fixscript_get_string(heap, params[0], 0, -1, &hostname, NULL);
    if (err) {
       fixscript_error(heap, error, err);
@@ -6055,10 +6838,15 @@ static Value native_tcp_connection_open(Heap *heap, Value *error, int num_params
 #if defined(_WIN32)
    if (!tcp_connect(hostname, params[1].value, &sock, 0))
 #else
-   if (!tcp_connect(hostname, params[1].value, &fd))
+   if (unix_socket? !unix_connect(hostname, &fd) : !tcp_connect(hostname, params[1].value, &fd))
 #endif
    {
-      snprintf(buf, sizeof(buf), "can't connect to %s:%d", hostname, params[1].value);
+      if (unix_socket) {
+         snprintf(buf, sizeof(buf), "can't connect to %s", hostname);
+      }
+      else {
+         snprintf(buf, sizeof(buf), "can't connect to %s:%d", hostname, params[1].value);
+      }
       *error = fixscript_create_error_string(heap, buf);
       goto error;
    }
@@ -6342,217 +7130,133 @@ static Value native_tcp_connection_write(Heap *heap, Value *error, int num_param
 
 
 #ifndef __wasm__
-static void *tcp_server_handle_func(Heap *heap, int op, void *p1, void *p2)
+#define MAX_WRITE_VECTORS 64
+
+typedef struct {
+   Value arr[MAX_WRITE_VECTORS];
+   int off[MAX_WRITE_VECTORS];
+   int len[MAX_WRITE_VECTORS];
+   char *ptr[MAX_WRITE_VECTORS];
+   int count, total;
+} WriteVector;
+
+static void unlock_write_vector(Heap *heap, WriteVector *vec)
 {
-   TCPServerHandle *handle = p1;
-   switch (op) {
-      case HANDLE_OP_FREE:
-         if (__sync_sub_and_fetch(&handle->refcnt, 1) == 0) {
-            if (!handle->closed) {
-               #if defined(_WIN32)
-                  closesocket(handle->socket);
-               #elif defined(__wasm__)
-               #else
-                  close(handle->fd);
-               #endif
-            }
-            free(handle);
-         }
-         break;
+   int i;
 
-      case HANDLE_OP_COPY:
-         __sync_add_and_fetch(&handle->refcnt, 1);
-         return handle;
+   for (i=0; i<vec->count; i++) {
+      fixscript_unlock_array(heap, vec->arr[i], vec->off[i], vec->len[i], (void **)&vec->ptr[i], 1, ACCESS_READ_ONLY);
    }
-   return NULL;
+   vec->count = 0;
 }
-#endif
 
 
-static TCPServerHandle *get_tcp_server_handle(Heap *heap, Value *error, Value handle_val)
+static int lock_write_vector(Heap *heap, Value *error, Value parts, WriteVector *vec)
 {
-   TCPServerHandle *handle;
+   Value values[3];
+   int i, len, err;
 
-   handle = fixscript_get_handle(heap, handle_val, HANDLE_TYPE_TCP_SERVER, NULL);
-   if (!handle) {
-      *error = fixscript_create_error_string(heap, "invalid TCP server handle");
-      return NULL;
-   }
-
-   if (handle->closed) {
-      *error = fixscript_create_error_string(heap, "TCP server is already closed");
-      return NULL;
-   }
-
-   return handle;
-}
-
-
-static Value native_tcp_server_create(Heap *heap, Value *error, int num_params, Value *params, void *data)
-{
-#if defined(__wasm__)
-   *error = fixscript_create_error_string(heap, "not supported");
-   return fixscript_int(0);
-#else
-   int local_only = data == (void *)1;
-   TCPServerHandle *handle;
-   struct sockaddr_in server;
-#if defined(_WIN32)
-   SOCKET sock = INVALID_SOCKET;
-#else
-   int fd = -1;
-#endif
-   int reuse;
-   Value retval = fixscript_int(0);
-
-#if defined(_WIN32)
-   sock = socket(AF_INET, SOCK_STREAM, 0);
-   if (sock == INVALID_SOCKET) {
-      goto io_error;
-   }
-
-   reuse = 1;
-   if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
-      goto io_error;
-   }
-
-   server.sin_family = AF_INET;
-   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
-   server.sin_port = htons(params[0].value);
-
-   if (bind(sock, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
-      goto io_error;
-   }
-
-   if (listen(sock, 5) == SOCKET_ERROR) {
-      goto io_error;
-   }
-#else
-   fd = socket(AF_INET, SOCK_STREAM, 0);
-   if (fd == -1) {
-      goto io_error;
-   }
-
-   reuse = 1;
-   if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
-      goto io_error;
-   }
-
-   server.sin_family = AF_INET;
-   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
-   server.sin_port = htons(params[0].value);
-
-   if (bind(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
-      goto io_error;
-   }
+   vec->count = 0;
+   vec->total = 0;
 
-   if (listen(fd, 5) < 0) {
-      goto io_error;
+   err = fixscript_get_array_length(heap, parts, &len);
+   if (err) {
+      fixscript_error(heap, error, err);
+      return 0;
    }
-#endif
 
-   handle = calloc(1, sizeof(TCPServerHandle));
-   if (!handle) {
-      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
-      goto error;
+   if (len % 3 != 0) {
+      *error = fixscript_create_error_string(heap, "parts must consist of buffer, offset and length triplets");
+      return 0;
    }
 
-   handle->refcnt = 1;
-#if defined(_WIN32)
-   handle->socket = sock;
-#else
-   handle->fd = fd;
-#endif
-
-   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_TCP_SERVER, handle, tcp_server_handle_func);
-#if defined(_WIN32)
-   sock = INVALID_SOCKET;
-#else
-   fd = -1;
-#endif
-   if (!retval.value) {
-      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
-      goto error;
+   if (len / 3 > MAX_WRITE_VECTORS) {
+      *error = fixscript_create_error_string(heap, "too many parts");
+      return 0;
    }
 
-error:
-#if defined(_WIN32)
-   if (!retval.value && sock != INVALID_SOCKET) {
-      closesocket(sock);
-   }
-#else
-   if (!retval.value && fd != -1) {
-      close(fd);
+   for (i=0; i<len; i+=3) {
+      err = fixscript_get_array_range(heap, parts, i, 3, values);
+      if (!err && (!fixscript_is_int(values[1]) || !fixscript_is_int(values[2]))) {
+         err = FIXSCRIPT_ERR_INVALID_ACCESS;
+      }
+      if (!err && values[2].value > INT_MAX - vec->total) {
+         err = FIXSCRIPT_ERR_OUT_OF_BOUNDS;
+      }
+      if (!err && values[2].value == 0) {
+         continue;
+      }
+      if (!err) {
+         err = fixscript_lock_array(heap, values[0], values[1].value, values[2].value, (void **)&vec->ptr[vec->count], 1, ACCESS_READ_ONLY);
+      }
+      if (err) {
+         unlock_write_vector(heap, vec);
+         fixscript_error(heap, error, err);
+         return 0;
+      }
+      vec->arr[vec->count] = values[0];
+      vec->off[vec->count] = values[1].value;
+      vec->len[vec->count] = values[2].value;
+      vec->total += values[2].value;
+      vec->count++;
    }
-#endif
-   return retval;
-
-io_error:
-   *error = fixscript_create_error_string(heap, "I/O error");
-   goto error;
-#endif /* __wasm__ */
+   return 1;
 }
 
 
-static Value native_tcp_server_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+#ifdef _WIN32
+static int copy_write_vector(WriteVector *vec, char *buf, int size)
 {
-   TCPServerHandle *handle;
-
-   handle = get_tcp_server_handle(heap, error, params[0]);
-   if (!handle) {
-      return fixscript_int(0);
-   }
+   int i, len, pos = 0;
 
-   handle->closed = 1;
-#if defined(_WIN32)
-   if (closesocket(handle->socket) != 0) {
-      *error = fixscript_create_error_string(heap, "I/O error");
-      return fixscript_int(0);
-   }
-#elif defined(__wasm__)
-   *error = fixscript_create_error_string(heap, "not supported");
-#else
-   if (close(handle->fd) == -1) {
-      *error = fixscript_create_error_string(heap, "I/O error");
-      return fixscript_int(0);
+   for (i=0; i<vec->count && pos < size; i++) {
+      len = vec->len[i];
+      if (len > size - pos) {
+         len = size - pos;
+      }
+      memcpy(buf + pos, vec->ptr[i], len);
+      pos += len;
    }
-#endif
-   return fixscript_int(0);
+   return pos;
 }
+#endif
+#endif
 
 
-static Value native_tcp_server_accept(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value native_tcp_connection_writev(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
 #if defined(__wasm__)
    *error = fixscript_create_error_string(heap, "not supported");
    return fixscript_int(0);
 #else
-   TCPServerHandle *handle;
-   TCPConnectionHandle *conn_handle;
-   Value retval;
-   int timeout = fixscript_get_int(params[1]);
+   TCPConnectionHandle *handle;
+   WriteVector vec;
+   int timeout = fixscript_get_int(params[2]);
+   int i;
 #if defined(_WIN32)
-   fd_set readfds;
+   WSABUF wsabuf[MAX_WRITE_VECTORS];
+   fd_set writefds;
    TIMEVAL timeval;
-   SOCKET sock;
+   DWORD written;
+   int ret;
 #else
+   struct iovec iov[MAX_WRITE_VECTORS];
    struct pollfd pfd;
-   int fd;
+   ssize_t ret;
 #endif
-   int ret, flag;
 
-   handle = get_tcp_server_handle(heap, error, params[0]);
+   handle = get_tcp_connection_handle(heap, error, params[0]);
    if (!handle) {
       return fixscript_int(0);
    }
 
 #if defined(_WIN32)
    if (timeout >= 0) {
-      FD_ZERO(&readfds);
-      FD_SET(handle->socket, &readfds);
+      FD_ZERO(&writefds);
+      FD_SET(handle->socket, &writefds);
       timeval.tv_sec = timeout / 1000;
       timeval.tv_usec = (timeout % 1000) * 1000;
-      ret = select(1, &readfds, NULL, NULL, &timeval);
+      ret = select(1, NULL, &writefds, NULL, &timeval);
       if (ret == SOCKET_ERROR) {
          *error = fixscript_create_error_string(heap, "I/O error");
          return fixscript_int(0);
@@ -6560,22 +7264,12 @@ static Value native_tcp_server_accept(Heap *heap, Value *error, int num_params,
       if (ret == 0) {
          return fixscript_int(0);
       }
+      handle->want_nonblocking = 1;
    }
-   sock = accept(handle->socket, NULL, NULL);
-   if (sock == INVALID_SOCKET) {
-      if (WSAGetLastError() == WSAEWOULDBLOCK) {
-         return fixscript_int(0);
-      }
-      *error = fixscript_create_error_string(heap, "I/O error");
-      return fixscript_int(0);
-   }
-
-   flag = 1;
-   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
 #else
    if (timeout >= 0) {
       pfd.fd = handle->fd;
-      pfd.events = POLLIN;
+      pfd.events = POLLOUT;
       ret = poll(&pfd, 1, timeout);
       if (ret < 0) {
          *error = fixscript_create_error_string(heap, "I/O error");
@@ -6583,972 +7277,5104 @@ static Value native_tcp_server_accept(Heap *heap, Value *error, int num_params,
       }
       if (ret == 1) {
          ret = 0;
-         if (pfd.revents & POLLIN) ret = 1;
+         if (pfd.revents & POLLOUT) ret = 1;
       }
       if (ret == 0) {
          return fixscript_int(0);
       }
+      handle->want_nonblocking = 1;
    }
-   fd = accept(handle->fd, NULL, NULL);
-   if (fd < 0) {
-      if (errno == EAGAIN) {
-         return fixscript_int(0);
-      }
+#endif
+
+   if (!update_nonblocking(handle)) {
       *error = fixscript_create_error_string(heap, "I/O error");
       return fixscript_int(0);
    }
+   handle->want_nonblocking = 0;
 
-   flag = 1;
-   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
-#endif
-
-   conn_handle = calloc(1, sizeof(TCPConnectionHandle));
-   if (!conn_handle) {
-      #if defined(_WIN32)
-         closesocket(sock);
-      #else
-         close(fd);
-      #endif
-      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   if (!lock_write_vector(heap, error, params[1], &vec)) {
+      return fixscript_int(0);
+   }
+   if (vec.count == 0) {
       return fixscript_int(0);
    }
 
-   conn_handle->refcnt = 1;
 #if defined(_WIN32)
-   conn_handle->socket = sock;
+   for (i=0; i<vec.count; i++) {
+      wsabuf[i].buf = vec.ptr[i];
+      wsabuf[i].len = vec.len[i];
+   }
+   ret = written = 0;
+   if (WSASend(handle->socket, wsabuf, vec.count, &written, 0, NULL, NULL) == SOCKET_ERROR) {
+      if (WSAGetLastError() != WSAEWOULDBLOCK) {
+         ret = -1;
+      }
+   }
+   else {
+      ret = written;
+   }
 #else
-   conn_handle->fd = fd;
+   for (i=0; i<vec.count; i++) {
+      iov[i].iov_base = vec.ptr[i];
+      iov[i].iov_len = vec.len[i];
+   }
+   ret = writev(handle->fd, iov, vec.count);
+   if (ret < 0 && errno == EAGAIN) {
+      ret = 0;
+   }
 #endif
 
-   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_TCP_CONNECTION, conn_handle, tcp_connection_handle_func);
-   if (!retval.value) {
-      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   unlock_write_vector(heap, &vec);
+
+   if (ret < 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
       return fixscript_int(0);
    }
-
-   return retval;
+   return fixscript_int(ret);
 #endif /* __wasm__ */
 }
 
 
-#ifndef __wasm__
-static void async_process_ref(AsyncProcess *proc)
+static Value native_tcp_connection_set_option(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   __sync_add_and_fetch(&proc->refcnt, 1);
-}
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   TCPConnectionHandle *conn;
+   AsyncHandle *async;
+   int option = (intptr_t)data & 1;
+   int flag = params[1].value != 0;
+#if defined(_WIN32)
+   SOCKET sock;
+#else
+   int sock;
 #endif
 
-
-#ifndef __wasm__
-static void async_process_unref(AsyncProcess *proc)
-{
-   AsyncThreadResult *atr, *atr_next;
-   AsyncTimer *timer, *timer_next;
-   
-   if (__sync_sub_and_fetch(&proc->refcnt, 1) == 0) {
-      for (atr = proc->thread_results; atr; atr = atr_next) {
-         #if defined(_WIN32)
-            if (atr->socket != INVALID_SOCKET) {
-               closesocket(atr->socket);
-            }
-         #elif defined(__wasm__)
-         #else
-            if (atr->fd != -1) {
-               close(atr->fd);
-            }
-         #endif
-         atr_next = atr->next;
-         free(atr);
+   if ((intptr_t)data & 2) {
+      async = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+      if (!async || async->common.type != ASYNC_TCP_CONNECTION) {
+         *error = fixscript_create_error_string(heap, "invalid async stream handle");
+         return fixscript_int(0);
       }
       #if defined(_WIN32)
-         CloseHandle(proc->iocp);
-      #elif defined(__wasm__)
+         sock = async->common.socket;
       #else
-         poll_destroy(proc->poll);
+         sock = async->common.fd;
       #endif
-      for (timer = proc->timers; timer; timer = timer_next) {
-         timer_next = timer->next;
-         free(timer);
-      }
-      pthread_mutex_destroy(&proc->mutex);
-      free(proc);
    }
-}
-#endif
-
-
-#ifndef __wasm__
-static AsyncProcess *get_async_process(Heap *heap, Value *error)
-{
-   AsyncProcess *proc;
-   int err;
-
-   proc = fixscript_get_heap_data(heap, async_process_key);
-   if (!proc) {
-      proc = calloc(1, sizeof(AsyncProcess));
-      proc->refcnt = 1;
-      if (pthread_mutex_init(&proc->mutex, NULL) != 0) {
-         free(proc);
-         *error = fixscript_create_error_string(heap, "can't create mutex");
-         return NULL;
-      }
-
-#if defined(_WIN32)
-      proc->iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
-      if (!proc->iocp) {
-         pthread_mutex_destroy(&proc->mutex);
-         free(proc);
-         *error = fixscript_create_error_string(heap, "can't create IO completion port");
-         return NULL;
+   else {
+      conn = get_tcp_connection_handle(heap, error, params[0]);
+      if (!conn) {
+         return fixscript_int(0);
       }
-#else
-      #ifndef __wasm__
-         proc->poll = poll_create();
+      #if defined(_WIN32)
+         sock = conn->socket;
+      #else
+         sock = conn->fd;
       #endif
-      if (!proc->poll) {
-         pthread_mutex_destroy(&proc->mutex);
-         free(proc);
-         *error = fixscript_create_error_string(heap, "can't create poll file descriptor");
-         return NULL;
-      }
-#endif
+   }
 
-      err = fixscript_set_heap_data(heap, async_process_key, proc, (HandleFreeFunc)async_process_unref);
-      if (err) {
-         fixscript_error(heap, error, err);
-         return NULL;
+   if (option == 0) {
+      if (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int)) < 0) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
       }
    }
-   return proc;
+   else {
+      // there is no equivalent on Windows, the data is sent as usual:
+      #if defined(TCP_CORK)
+         if (setsockopt(sock, IPPROTO_TCP, TCP_CORK, (char *)&flag, sizeof(int)) < 0) {
+            *error = fixscript_create_error_string(heap, "I/O error");
+            return fixscript_int(0);
+         }
+      #elif defined(TCP_NOPUSH)
+         if (setsockopt(sock, IPPROTO_TCP, TCP_NOPUSH, (char *)&flag, sizeof(int)) < 0) {
+            *error = fixscript_create_error_string(heap, "I/O error");
+            return fixscript_int(0);
+         }
+      #endif
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
 }
-#endif
 
 
 #ifndef __wasm__
-static void async_process_notify(AsyncProcess *proc)
+static int get_file_send_length(FileHandle *file, uint64_t offset, int len)
 {
 #if defined(_WIN32)
-   PostQueuedCompletionStatus(proc->iocp, 0, 0, (OVERLAPPED *)proc);
-#elif defined(__wasm__)
+   LARGE_INTEGER size;
+   uint64_t file_size;
+
+   if (!GetFileSizeEx(file->handle, &size)) {
+      return -1;
+   }
+   file_size = size.QuadPart;
 #else
-   poll_interrupt(proc->poll);
+   struct stat buf;
+   uint64_t file_size;
+
+   if (fstat(file->fd, &buf) != 0) {
+      return -1;
+   }
+   file_size = buf.st_size;
 #endif
+
+   if (offset >= file_size) {
+      return 0;
+   }
+   if (file_size - offset < len) {
+      len = file_size - offset;
+   }
+   return len;
 }
-#endif
 
 
-static pthread_mutex_t *get_mutex(volatile pthread_mutex_t **mutex_ptr)
+#if defined(_WIN32)
+static int send_file_part(SOCKET socket, FileHandle *file, uint64_t offset, int len)
 {
-   pthread_mutex_t *mutex, *cur_mutex;
+   char buf[16384];
+   OVERLAPPED overlapped;
+   DWORD read;
+   int ret;
 
-   mutex = (pthread_mutex_t *)*mutex_ptr;
-   if (!mutex) {
-      mutex = calloc(1, sizeof(pthread_mutex_t));
-      if (!mutex) {
-         return NULL;
-      }
-      if (pthread_mutex_init(mutex, NULL) != 0) {
-         free(mutex);
-         return NULL;
-      }
-      cur_mutex = (pthread_mutex_t *)__sync_val_compare_and_swap(mutex_ptr, NULL, mutex);
-      if (cur_mutex) {
-         pthread_mutex_destroy(mutex);
-         free(mutex);
-         mutex = cur_mutex;
-      }
+   if (len > sizeof(buf)) {
+      len = sizeof(buf);
    }
-   return mutex;
-}
 
+   memset(&overlapped, 0, sizeof(OVERLAPPED));
+   overlapped.Offset = (DWORD)offset;
+   overlapped.OffsetHigh = (DWORD)(offset >> 32);
+   if (!ReadFile(file->handle, buf, len, &read, &overlapped)) {
+      return -1;
+   }
 
-#if !defined(_WIN32) && !defined(__wasm__)
-static pthread_cond_t *get_cond(volatile pthread_cond_t **cond_ptr)
+   ret = send(socket, buf, read, 0);
+   if (ret == SOCKET_ERROR) {
+      return -1;
+   }
+   return ret;
+}
+#elif defined(__linux__)
+static int send_file_part(int fd, FileHandle *file, uint64_t offset, int len)
 {
-   pthread_cond_t *cond, *cur_cond;
+   off_t off = offset;
 
-   cond = (pthread_cond_t *)*cond_ptr;
-   if (!cond) {
-      cond = calloc(1, sizeof(pthread_cond_t));
-      if (!cond) {
-         return NULL;
-      }
-      if (pthread_cond_init(cond, NULL) != 0) {
-         free(cond);
-         return NULL;
-      }
-      cur_cond = (pthread_cond_t *)__sync_val_compare_and_swap(cond_ptr, NULL, cond);
-      if (cur_cond) {
-         pthread_cond_destroy(cond);
-         free(cond);
-         cond = cur_cond;
-      }
+   // the data is transferred directly from the page cache without copying to user space:
+   return sendfile(fd, file->fd, &off, len);
+}
+#else
+static int send_file_part(int fd, FileHandle *file, uint64_t offset, int len)
+{
+   char buf[16384];
+   ssize_t ret;
+
+   if (len > sizeof(buf)) {
+      len = sizeof(buf);
    }
-   return cond;
+
+   ret = pread(file->fd, buf, len, offset);
+   if (ret <= 0) {
+      return ret;
+   }
+   return write(fd, buf, ret);
 }
 #endif
 
 
-#ifndef __wasm__
-#if defined(_WIN32)
-static DWORD WINAPI thread_main(void *data)
-#else
-static void *thread_main(void *data)
-#endif
+static FileHandle *get_send_file_handle(Heap *heap, Value *error, Value handle_val, uint64_t offset, int *len)
 {
-   Thread *thread = data;
-   pthread_mutex_t *global_mutex;
-   
-   global_mutex = get_mutex(&threads_mutex);
-   if (!global_mutex) {
-#if defined(_WIN32)
-      return 0;
-#else
+   FileHandle *file;
+
+   file = get_file_handle(heap, error, handle_val);
+   if (!file) {
       return NULL;
-#endif
    }
 
-   for (;;) {
-      pthread_mutex_lock(&thread->mutex);
-      while (!thread->func) {
-         if (pthread_cond_timedwait_relative(&thread->cond, &thread->mutex, 5000*1000000LL) == ETIMEDOUT && !thread->func) {
-            pthread_mutex_unlock(&thread->mutex);
-            goto end;
-         }
-      }
-
-      thread->func(thread->data);
-      thread->func = NULL;
-      pthread_mutex_unlock(&thread->mutex);
-      
-      pthread_mutex_lock(global_mutex);
-      thread->next = threads_pool;
-      threads_pool = thread;
-      pthread_mutex_unlock(global_mutex);
+   if ((file->mode & SCRIPT_FILE_READ) == 0) {
+      *error = fixscript_create_error_string(heap, "file not opened for reading");
+      return NULL;
    }
 
-end:
-   pthread_cond_destroy(&thread->cond);
-   pthread_mutex_destroy(&thread->mutex);
-   free(thread);
+   if (*len < 0) {
+      *error = fixscript_create_error_string(heap, "negative length");
+      return NULL;
+   }
 
-#if defined(_WIN32)
-   return 0;
-#else
-   return NULL;
-#endif
+   if (*len > 0) {
+      *len = get_file_send_length(file, offset, *len);
+      if (*len < 0) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return NULL;
+      }
+      if (*len == 0) {
+         *error = fixscript_create_error_string(heap, "unexpected end of file");
+         return NULL;
+      }
+   }
+   return file;
 }
 #endif
 
 
-#ifndef __wasm__
-static int async_run_thread(ThreadFunc func, void *data)
+static Value native_tcp_connection_send_file(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   pthread_mutex_t *mutex;
-   Thread *thread;
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   TCPConnectionHandle *handle;
+   FileHandle *file;
+   uint64_t offset;
+   int len = params[4].value;
+   int timeout = fixscript_get_int(params[5]);
 #if defined(_WIN32)
-   HANDLE handle;
+   fd_set writefds;
+   TIMEVAL timeval;
 #else
-   pthread_t handle;
+   struct pollfd pfd;
 #endif
+   int ret;
 
-   mutex = get_mutex(&threads_mutex);
-   if (!mutex) {
-      return 0;
+   handle = get_tcp_connection_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
    }
-   
-   pthread_mutex_lock(mutex);
 
-   if (threads_pool) {
-      thread = threads_pool;
-      threads_pool = thread->next;
+   offset = ((uint32_t)params[2].value) | (((uint64_t)params[3].value) << 32);
+   file = get_send_file_handle(heap, error, params[1], offset, &len);
+   if (!file) {
+      return fixscript_int(0);
+   }
+   if (len == 0) {
+      return fixscript_int(0);
    }
-   else {
-      thread = calloc(1, sizeof(Thread));
-      if (!thread) {
-         pthread_mutex_unlock(mutex);
-         return 0;
-      }
-
-      if (pthread_mutex_init(&thread->mutex, NULL) != 0) {
-         free(thread);
-         pthread_mutex_unlock(mutex);
-         return 0;
-      }
-
-      if (pthread_cond_init(&thread->cond, NULL) != 0) {
-         pthread_mutex_destroy(&thread->mutex);
-         free(thread);
-         pthread_mutex_unlock(mutex);
-         return 0;
-      }
 
 #if defined(_WIN32)
-      handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
-      if (!handle) {
-         pthread_cond_destroy(&thread->cond);
-         pthread_mutex_destroy(&thread->mutex);
-         free(thread);
-         pthread_mutex_unlock(mutex);
+   if (timeout >= 0) {
+      FD_ZERO(&writefds);
+      FD_SET(handle->socket, &writefds);
+      timeval.tv_sec = timeout / 1000;
+      timeval.tv_usec = (timeout % 1000) * 1000;
+      ret = select(1, NULL, &writefds, NULL, &timeval);
+      if (ret == SOCKET_ERROR) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      if (ret == 0) {
+         return fixscript_int(0);
+      }
+      handle->want_nonblocking = 1;
+   }
+#else
+   if (timeout >= 0) {
+      pfd.fd = handle->fd;
+      pfd.events = POLLOUT;
+      ret = poll(&pfd, 1, timeout);
+      if (ret < 0) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      if (ret == 1) {
+         ret = 0;
+         if (pfd.revents & POLLOUT) ret = 1;
+      }
+      if (ret == 0) {
+         return fixscript_int(0);
+      }
+      handle->want_nonblocking = 1;
+   }
+#endif
+
+   if (!update_nonblocking(handle)) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   handle->want_nonblocking = 0;
+
+#if defined(_WIN32)
+   ret = send_file_part(handle->socket, file, offset, len);
+   if (ret < 0 && WSAGetLastError() == WSAEWOULDBLOCK) {
+      ret = 0;
+   }
+#else
+   ret = send_file_part(handle->fd, file, offset, len);
+   if (ret < 0 && errno == EAGAIN) {
+      ret = 0;
+   }
+#endif
+
+   if (ret < 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   return fixscript_int(ret);
+#endif /* __wasm__ */
+}
+
+
+static Value native_tcp_connection_send_connection(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   TCPConnectionHandle *handle;
+   int passed_fd;
+
+   handle = get_tcp_connection_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   passed_fd = get_passed_fd(heap, error, params[1]);
+   if (passed_fd == -1) {
+      return fixscript_int(0);
+   }
+
+   if (!update_nonblocking(handle)) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   if (unix_send_fd(handle->fd, passed_fd, 0) != 1) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_tcp_connection_receive_connection(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   TCPConnectionHandle *handle, *conn_handle;
+   Value retval;
+   int timeout = fixscript_get_int(params[1]);
+   struct pollfd pfd;
+   int ret, fd, flags;
+
+   handle = get_tcp_connection_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   if (timeout >= 0) {
+      pfd.fd = handle->fd;
+      pfd.events = POLLIN;
+      ret = poll(&pfd, 1, timeout);
+      if (ret < 0) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      if (ret == 1) {
+         ret = 0;
+         if (pfd.revents & POLLIN) ret = 1;
+      }
+      if (ret == 0) {
+         return fixscript_int(0);
+      }
+      handle->want_nonblocking = 1;
+   }
+
+   if (!update_nonblocking(handle)) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   handle->want_nonblocking = 0;
+
+   ret = unix_receive_fd(handle->fd, 0, &fd);
+   if (ret == 0) {
+      return fixscript_int(0);
+   }
+   if (ret < 0) {
+      if (errno == EAGAIN) {
+         return fixscript_int(0);
+      }
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   conn_handle = calloc(1, sizeof(TCPConnectionHandle));
+   if (!conn_handle) {
+      close(fd);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   // the file status flags are shared with the sending process:
+   flags = fcntl(fd, F_GETFL);
+   conn_handle->refcnt = 1;
+   conn_handle->fd = fd;
+   conn_handle->in_nonblocking = flags != -1 && (flags & O_NONBLOCK) != 0;
+
+   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_TCP_CONNECTION, conn_handle, tcp_connection_handle_func);
+   if (!retval.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+#ifndef __wasm__
+static void *tcp_server_handle_func(Heap *heap, int op, void *p1, void *p2)
+{
+   TCPServerHandle *handle = p1;
+   switch (op) {
+      case HANDLE_OP_FREE:
+         if (__sync_sub_and_fetch(&handle->refcnt, 1) == 0) {
+            if (!handle->closed) {
+               #if defined(_WIN32)
+                  closesocket(handle->socket);
+               #elif defined(__wasm__)
+               #else
+                  close(handle->fd);
+                  if (handle->unix_path) {
+                     unlink(handle->unix_path);
+                  }
+               #endif
+            }
+            #if !defined(_WIN32)
+               free(handle->unix_path);
+            #endif
+            free(handle);
+         }
+         break;
+
+      case HANDLE_OP_COPY:
+         __sync_add_and_fetch(&handle->refcnt, 1);
+         return handle;
+   }
+   return NULL;
+}
+#endif
+
+
+static TCPServerHandle *get_tcp_server_handle(Heap *heap, Value *error, Value handle_val)
+{
+   TCPServerHandle *handle;
+
+   handle = fixscript_get_handle(heap, handle_val, HANDLE_TYPE_TCP_SERVER, NULL);
+   if (!handle) {
+      *error = fixscript_create_error_string(heap, "invalid TCP server handle");
+      return NULL;
+   }
+
+   if (handle->closed) {
+      *error = fixscript_create_error_string(heap, "TCP server is already closed");
+      return NULL;
+   }
+
+   return handle;
+}
+
+
+static Value native_tcp_server_create(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   int local_only = data == (void *)1;
+   TCPServerHandle *handle;
+   struct sockaddr_in server;
+#if defined(_WIN32)
+   SOCKET sock = INVALID_SOCKET;
+#else
+   int fd = -1;
+#endif
+   int reuse;
+   Value retval = fixscript_int(0);
+
+#if defined(_WIN32)
+   sock = socket(AF_INET, SOCK_STREAM, 0);
+   if (sock == INVALID_SOCKET) {
+      goto io_error;
+   }
+
+   reuse = 1;
+   if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
+      goto io_error;
+   }
+
+   server.sin_family = AF_INET;
+   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
+   server.sin_port = htons(params[0].value);
+
+   if (bind(sock, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
+      goto io_error;
+   }
+
+   if (listen(sock, 5) == SOCKET_ERROR) {
+      goto io_error;
+   }
+#else
+   fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd == -1) {
+      goto io_error;
+   }
+
+   reuse = 1;
+   if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
+      goto io_error;
+   }
+
+   server.sin_family = AF_INET;
+   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
+   server.sin_port = htons(params[0].value);
+
+   if (bind(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
+      goto io_error;
+   }
+
+   if (listen(fd, 5) < 0) {
+      goto io_error;
+   }
+#endif
+
+   handle = calloc(1, sizeof(TCPServerHandle));
+   if (!handle) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+   handle->refcnt = 1;
+#if defined(_WIN32)
+   handle->socket = sock;
+#else
+   handle->fd = fd;
+#endif
+
+   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_TCP_SERVER, handle, tcp_server_handle_func);
+#if defined(_WIN32)
+   sock = INVALID_SOCKET;
+#else
+   fd = -1;
+#endif
+   if (!retval.value) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+error:
+#if defined(_WIN32)
+   if (!retval.value && sock != INVALID_SOCKET) {
+      closesocket(sock);
+   }
+#else
+   if (!retval.value && fd != -1) {
+      close(fd);
+   }
+#endif
+   return retval;
+
+io_error:
+   *error = fixscript_create_error_string(heap, "I/O error");
+   goto error;
+#endif /* __wasm__ */
+}
+
+
+static Value native_tcp_server_create_unix(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   TCPServerHandle *handle;
+   char *path = NULL;
+   char buf[128];
+   int err, fd = -1;
+   Value retval = fixscript_int(0);
+
+   err = fixscript_get_string(heap, params[0], 0, -1, &path, NULL);
+   if (err) {
+      fixscript_error(heap, error, err);
+      goto error;
+   }
+
+   if (!unix_listen(path, &fd)) {
+      snprintf(buf, sizeof(buf), "can't listen on %s", path);
+      *error = fixscript_create_error_string(heap, buf);
+      goto error;
+   }
+
+   handle = calloc(1, sizeof(TCPServerHandle));
+   if (!handle) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+   handle->refcnt = 1;
+   handle->fd = fd;
+   handle->unix_path = path;
+   path = NULL;
+
+   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_TCP_SERVER, handle, tcp_server_handle_func);
+   fd = -1;
+   if (!retval.value) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+error:
+   if (fd != -1) {
+      close(fd);
+      unlink(path);
+   }
+   free(path);
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+static Value native_tcp_server_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   TCPServerHandle *handle;
+
+   handle = get_tcp_server_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   handle->closed = 1;
+#if defined(_WIN32)
+   if (closesocket(handle->socket) != 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#elif defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+#else
+   if (handle->unix_path) {
+      unlink(handle->unix_path);
+      free(handle->unix_path);
+      handle->unix_path = NULL;
+   }
+   if (close(handle->fd) == -1) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#endif
+   return fixscript_int(0);
+}
+
+
+static Value native_tcp_server_accept(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   TCPServerHandle *handle;
+   TCPConnectionHandle *conn_handle;
+   Value retval;
+   int timeout = fixscript_get_int(params[1]);
+#if defined(_WIN32)
+   fd_set readfds;
+   TIMEVAL timeval;
+   SOCKET sock;
+#else
+   struct pollfd pfd;
+   int fd;
+#endif
+   int ret, flag;
+
+   handle = get_tcp_server_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   if (timeout >= 0) {
+      FD_ZERO(&readfds);
+      FD_SET(handle->socket, &readfds);
+      timeval.tv_sec = timeout / 1000;
+      timeval.tv_usec = (timeout % 1000) * 1000;
+      ret = select(1, &readfds, NULL, NULL, &timeval);
+      if (ret == SOCKET_ERROR) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      if (ret == 0) {
+         return fixscript_int(0);
+      }
+   }
+   sock = accept(handle->socket, NULL, NULL);
+   if (sock == INVALID_SOCKET) {
+      if (WSAGetLastError() == WSAEWOULDBLOCK) {
+         return fixscript_int(0);
+      }
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   flag = 1;
+   setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+#else
+   if (timeout >= 0) {
+      pfd.fd = handle->fd;
+      pfd.events = POLLIN;
+      ret = poll(&pfd, 1, timeout);
+      if (ret < 0) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      if (ret == 1) {
+         ret = 0;
+         if (pfd.revents & POLLIN) ret = 1;
+      }
+      if (ret == 0) {
+         return fixscript_int(0);
+      }
+   }
+   fd = accept(handle->fd, NULL, NULL);
+   if (fd < 0) {
+      if (errno == EAGAIN) {
+         return fixscript_int(0);
+      }
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   flag = 1;
+   setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+#endif
+
+   conn_handle = calloc(1, sizeof(TCPConnectionHandle));
+   if (!conn_handle) {
+      #if defined(_WIN32)
+         closesocket(sock);
+      #else
+         close(fd);
+      #endif
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      return fixscript_int(0);
+   }
+
+   conn_handle->refcnt = 1;
+#if defined(_WIN32)
+   conn_handle->socket = sock;
+#else
+   conn_handle->fd = fd;
+#endif
+
+   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_TCP_CONNECTION, conn_handle, tcp_connection_handle_func);
+   if (!retval.value) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      return fixscript_int(0);
+   }
+
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+#ifndef __wasm__
+static void *udp_socket_handle_func(Heap *heap, int op, void *p1, void *p2)
+{
+   UDPSocketHandle *handle = p1;
+   switch (op) {
+      case HANDLE_OP_FREE:
+         if (__sync_sub_and_fetch(&handle->refcnt, 1) == 0) {
+            if (!handle->closed) {
+               #if defined(_WIN32)
+                  closesocket(handle->socket);
+               #else
+                  close(handle->fd);
+               #endif
+            }
+            free(handle);
+         }
+         break;
+
+      case HANDLE_OP_COPY:
+         __sync_add_and_fetch(&handle->refcnt, 1);
+         return handle;
+   }
+   return NULL;
+}
+
+
+static UDPSocketHandle *get_udp_socket_handle(Heap *heap, Value *error, Value handle_val)
+{
+   UDPSocketHandle *handle;
+
+   handle = fixscript_get_handle(heap, handle_val, HANDLE_TYPE_UDP_SOCKET, NULL);
+   if (!handle) {
+      *error = fixscript_create_error_string(heap, "invalid UDP socket handle");
+      return NULL;
+   }
+
+   if (handle->closed) {
+      *error = fixscript_create_error_string(heap, "UDP socket is already closed");
+      return NULL;
+   }
+
+   return handle;
+}
+
+
+#if defined(_WIN32)
+static int udp_create_socket(int port, int local_only, SOCKET *ret)
+#else
+static int udp_create_socket(int port, int local_only, int *ret)
+#endif
+{
+   struct sockaddr_in addr;
+#if defined(_WIN32)
+   SOCKET sock;
+   DWORD flag = FALSE, bytes;
+
+   sock = WSASocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP, NULL, 0, WSA_FLAG_OVERLAPPED);
+   if (sock == INVALID_SOCKET) {
+      return 0;
+   }
+
+   // don't report ICMP port unreachable messages as errors when receiving:
+   WSAIoctl(sock, SIO_UDP_CONNRESET, &flag, sizeof(flag), NULL, 0, &bytes, NULL, NULL);
+#else
+   int fd;
+
+   fd = socket(AF_INET, SOCK_DGRAM, 0);
+   if (fd == -1) {
+      return 0;
+   }
+#endif
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
+   addr.sin_port = htons(port);
+
+#if defined(_WIN32)
+   if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR) {
+      closesocket(sock);
+      return 0;
+   }
+   *ret = sock;
+#else
+   if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      close(fd);
+      return 0;
+   }
+   *ret = fd;
+#endif
+   return 1;
+}
+
+
+#if defined(_WIN32)
+static int udp_get_port(SOCKET sock)
+#else
+static int udp_get_port(int fd)
+#endif
+{
+   struct sockaddr_in addr;
+#if defined(_WIN32)
+   int addr_len = sizeof(addr);
+
+   if (getsockname(sock, (struct sockaddr *)&addr, &addr_len) == SOCKET_ERROR) {
+      return -1;
+   }
+#else
+   socklen_t addr_len = sizeof(addr);
+
+   if (getsockname(fd, (struct sockaddr *)&addr, &addr_len) < 0) {
+      return -1;
+   }
+#endif
+   return ntohs(addr.sin_port);
+}
+
+
+static void udp_set_info(int *info, int off, int len, struct sockaddr_in *addr)
+{
+   info[0] = off;
+   info[1] = len;
+   info[2] = ntohl(addr->sin_addr.s_addr);
+   info[3] = ntohs(addr->sin_port);
+}
+
+
+static void udp_get_address(int *info, struct sockaddr_in *addr)
+{
+   memset(addr, 0, sizeof(struct sockaddr_in));
+   addr->sin_family = AF_INET;
+   addr->sin_addr.s_addr = htonl(info[2]);
+   addr->sin_port = htons(info[3]);
+}
+
+
+// receives available datagrams (up to given count) into the slots of the buffer, the offset, length,
+// address and port of each datagram is stored in the info, returns the number of received datagrams,
+// zero when no datagram is available in the non-blocking mode or -1 on error:
+#if defined(_WIN32)
+static int udp_receive(SOCKET sock, char *buf, int slot_size, int count, int *info, int nonblocking)
+#else
+static int udp_receive(int fd, char *buf, int slot_size, int count, int *info, int nonblocking)
+#endif
+{
+#if defined(__linux__)
+   struct mmsghdr *msgs;
+   struct iovec *iovs;
+   struct sockaddr_in *addrs;
+   int i, ret;
+
+   msgs = calloc(count, sizeof(struct mmsghdr) + sizeof(struct iovec) + sizeof(struct sockaddr_in));
+   if (!msgs) {
+      return -1;
+   }
+   iovs = (struct iovec *)(msgs + count);
+   addrs = (struct sockaddr_in *)(iovs + count);
+
+   for (i=0; i<count; i++) {
+      iovs[i].iov_base = buf + (intptr_t)i*slot_size;
+      iovs[i].iov_len = slot_size;
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+   }
+
+   // all datagrams that are already available are obtained in a single call:
+   do {
+      ret = recvmmsg(fd, msgs, count, nonblocking? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+   }
+   while (ret < 0 && errno == EINTR && !nonblocking);
+
+   if (ret < 0) {
+      free(msgs);
+      return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+   }
+
+   for (i=0; i<ret; i++) {
+      udp_set_info(info + i*UDP_MSG_SIZE, i*slot_size, msgs[i].msg_len, &addrs[i]);
+   }
+   free(msgs);
+   return ret;
+#elif defined(_WIN32)
+   struct sockaddr_in addr;
+   fd_set readfds;
+   TIMEVAL timeval;
+   int i, ret, addr_len;
+
+   for (i=0; i<count; i++) {
+      if (nonblocking || i > 0) {
+         FD_ZERO(&readfds);
+         FD_SET(sock, &readfds);
+         timeval.tv_sec = 0;
+         timeval.tv_usec = 0;
+         if (select(1, &readfds, NULL, NULL, &timeval) != 1) {
+            break;
+         }
+      }
+      addr_len = sizeof(addr);
+      ret = recvfrom(sock, buf + i*slot_size, slot_size, 0, (struct sockaddr *)&addr, &addr_len);
+      if (ret == SOCKET_ERROR) {
+         if (WSAGetLastError() == WSAEMSGSIZE) {
+            ret = slot_size;
+         }
+         else {
+            if (i > 0) break;
+            return -1;
+         }
+      }
+      udp_set_info(info + i*UDP_MSG_SIZE, i*slot_size, ret, &addr);
+   }
+   return i;
+#else
+   struct sockaddr_in addr;
+   socklen_t addr_len;
+   int i, ret;
+
+   for (i=0; i<count; i++) {
+      addr_len = sizeof(addr);
+      ret = recvfrom(fd, buf + i*slot_size, slot_size, (nonblocking || i > 0)? MSG_DONTWAIT : 0, (struct sockaddr *)&addr, &addr_len);
+      if (ret < 0) {
+         if (errno == EINTR && !nonblocking && i == 0) {
+            i--;
+            continue;
+         }
+         if (errno == EAGAIN || errno == EWOULDBLOCK || i > 0) {
+            break;
+         }
+         return -1;
+      }
+      udp_set_info(info + i*UDP_MSG_SIZE, i*slot_size, ret, &addr);
+   }
+   return i;
+#endif
+}
+
+
+// sends the datagrams described by the offset, length, address and port in the info, returns the number
+// of sent datagrams, zero when nothing can be sent in the non-blocking mode or -1 on error:
+#if defined(_WIN32)
+static int udp_send(SOCKET sock, char *buf, int *info, int count, int nonblocking)
+#else
+static int udp_send(int fd, char *buf, int *info, int count, int nonblocking)
+#endif
+{
+#if defined(__linux__)
+   struct mmsghdr *msgs;
+   struct iovec *iovs;
+   struct sockaddr_in *addrs;
+   int i, ret;
+
+   if (count == 0) {
+      return 0;
+   }
+
+   msgs = calloc(count, sizeof(struct mmsghdr) + sizeof(struct iovec) + sizeof(struct sockaddr_in));
+   if (!msgs) {
+      return -1;
+   }
+   iovs = (struct iovec *)(msgs + count);
+   addrs = (struct sockaddr_in *)(iovs + count);
+
+   for (i=0; i<count; i++) {
+      udp_get_address(info + i*UDP_MSG_SIZE, &addrs[i]);
+      iovs[i].iov_base = buf + info[i*UDP_MSG_SIZE+0];
+      iovs[i].iov_len = info[i*UDP_MSG_SIZE+1];
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+      msgs[i].msg_hdr.msg_name = &addrs[i];
+      msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+   }
+
+   do {
+      ret = sendmmsg(fd, msgs, count, nonblocking? MSG_DONTWAIT : 0);
+   }
+   while (ret < 0 && errno == EINTR && !nonblocking);
+
+   free(msgs);
+   if (ret < 0) {
+      return (errno == EAGAIN || errno == EWOULDBLOCK)? 0 : -1;
+   }
+   return ret;
+#else
+   struct sockaddr_in addr;
+   int i, ret;
+
+   for (i=0; i<count; i++) {
+      udp_get_address(info + i*UDP_MSG_SIZE, &addr);
+      #if defined(_WIN32)
+      ret = sendto(sock, buf + info[i*UDP_MSG_SIZE+0], info[i*UDP_MSG_SIZE+1], 0, (struct sockaddr *)&addr, sizeof(addr));
+      if (ret == SOCKET_ERROR) {
+         if (i > 0) break;
+         return -1;
+      }
+      #else
+      ret = sendto(fd, buf + info[i*UDP_MSG_SIZE+0], info[i*UDP_MSG_SIZE+1], nonblocking? MSG_DONTWAIT : 0, (struct sockaddr *)&addr, sizeof(addr));
+      if (ret < 0) {
+         if (errno == EINTR && !nonblocking) {
+            i--;
+            continue;
+         }
+         if (errno == EAGAIN || errno == EWOULDBLOCK || i > 0) {
+            break;
+         }
+         return -1;
+      }
+      #endif
+   }
+   return i;
+#endif
+}
+
+
+static int udp_get_receive_count(Heap *heap, Value *error, Value buf, int slot_size, Value msgs)
+{
+   int err, buf_len, msgs_len, count;
+
+   if (slot_size < 1) {
+      *error = fixscript_create_error_string(heap, "invalid slot size");
+      return -1;
+   }
+
+   err = fixscript_get_array_length(heap, buf, &buf_len);
+   if (!err) {
+      err = fixscript_get_array_length(heap, msgs, &msgs_len);
+   }
+   if (err) {
+      fixscript_error(heap, error, err);
+      return -1;
+   }
+
+   count = buf_len / slot_size;
+   if (count > msgs_len / UDP_MSG_SIZE) {
+      count = msgs_len / UDP_MSG_SIZE;
+   }
+   if (count > UDP_MAX_BATCH) {
+      count = UDP_MAX_BATCH;
+   }
+   if (count < 1) {
+      *error = fixscript_create_error_string(heap, "buffer too small");
+      return -1;
+   }
+   return count;
+}
+
+
+#if defined(_WIN32)
+static int udp_receive_arrays(Heap *heap, SOCKET sock, Value buf_val, int slot_size, Value msgs_val, int count, int nonblocking, int *result)
+#else
+static int udp_receive_arrays(Heap *heap, int fd, Value buf_val, int slot_size, Value msgs_val, int count, int nonblocking, int *result)
+#endif
+{
+   char *buf;
+   int *info;
+   Value *values;
+   int i, err, ret;
+
+   // the info is set afterwards as the locking doesn't upgrade the array to store bigger values:
+   info = malloc(count*UDP_MSG_SIZE*sizeof(int));
+   values = malloc(count*UDP_MSG_SIZE*sizeof(Value));
+   if (!info || !values) {
+      free(info);
+      free(values);
+      return FIXSCRIPT_ERR_OUT_OF_MEMORY;
+   }
+
+   err = fixscript_lock_array(heap, buf_val, 0, count*slot_size, (void **)&buf, 1, ACCESS_READ_WRITE);
+   if (err) {
+      free(info);
+      free(values);
+      return err;
+   }
+
+#if defined(_WIN32)
+   ret = udp_receive(sock, buf, slot_size, count, info, nonblocking);
+#else
+   ret = udp_receive(fd, buf, slot_size, count, info, nonblocking);
+#endif
+
+   fixscript_unlock_array(heap, buf_val, 0, count*slot_size, (void **)&buf, 1, ACCESS_READ_WRITE);
+
+   if (ret > 0) {
+      for (i=0; i<ret*UDP_MSG_SIZE; i++) {
+         values[i] = fixscript_int(info[i]);
+      }
+      err = fixscript_set_array_range(heap, msgs_val, 0, ret*UDP_MSG_SIZE, values);
+   }
+   free(info);
+   free(values);
+   if (err) {
+      return err;
+   }
+
+   *result = ret;
+   return FIXSCRIPT_SUCCESS;
+}
+
+
+#if defined(_WIN32)
+static int udp_send_arrays(Heap *heap, SOCKET sock, Value buf_val, Value msgs_val, int count, int nonblocking, int *result)
+#else
+static int udp_send_arrays(Heap *heap, int fd, Value buf_val, Value msgs_val, int count, int nonblocking, int *result)
+#endif
+{
+   char *buf;
+   int *info;
+   int i, err, buf_len, off, len;
+
+   if (count < 0) {
+      return FIXSCRIPT_ERR_OUT_OF_BOUNDS;
+   }
+   if (count > UDP_MAX_BATCH) {
+      count = UDP_MAX_BATCH;
+   }
+
+   err = fixscript_get_array_length(heap, buf_val, &buf_len);
+   if (err) {
+      return err;
+   }
+
+   err = fixscript_lock_array(heap, msgs_val, 0, count*UDP_MSG_SIZE, (void **)&info, 4, ACCESS_READ_ONLY);
+   if (err) {
+      return err;
+   }
+
+   for (i=0; i<count; i++) {
+      off = info[i*UDP_MSG_SIZE+0];
+      len = info[i*UDP_MSG_SIZE+1];
+      if (off < 0 || len < 0 || (int64_t)off + (int64_t)len > (int64_t)buf_len) {
+         fixscript_unlock_array(heap, msgs_val, 0, count*UDP_MSG_SIZE, (void **)&info, 4, ACCESS_READ_ONLY);
+         return FIXSCRIPT_ERR_OUT_OF_BOUNDS;
+      }
+   }
+
+   err = fixscript_lock_array(heap, buf_val, 0, buf_len, (void **)&buf, 1, ACCESS_READ_ONLY);
+   if (err) {
+      fixscript_unlock_array(heap, msgs_val, 0, count*UDP_MSG_SIZE, (void **)&info, 4, ACCESS_READ_ONLY);
+      return err;
+   }
+
+#if defined(_WIN32)
+   *result = udp_send(sock, buf, info, count, nonblocking);
+#else
+   *result = udp_send(fd, buf, info, count, nonblocking);
+#endif
+
+   fixscript_unlock_array(heap, buf_val, 0, buf_len, (void **)&buf, 1, ACCESS_READ_ONLY);
+   fixscript_unlock_array(heap, msgs_val, 0, count*UDP_MSG_SIZE, (void **)&info, 4, ACCESS_READ_ONLY);
+   return FIXSCRIPT_SUCCESS;
+}
+#endif /* __wasm__ */
+
+
+static Value native_udp_socket_create(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   int local_only = data == (void *)1;
+   UDPSocketHandle *handle;
+   Value retval;
+#if defined(_WIN32)
+   SOCKET sock;
+#else
+   int fd;
+#endif
+
+#if defined(_WIN32)
+   if (!udp_create_socket(params[0].value, local_only, &sock))
+#else
+   if (!udp_create_socket(params[0].value, local_only, &fd))
+#endif
+   {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   handle = calloc(1, sizeof(UDPSocketHandle));
+   if (!handle) {
+      #if defined(_WIN32)
+         closesocket(sock);
+      #else
+         close(fd);
+      #endif
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   handle->refcnt = 1;
+#if defined(_WIN32)
+   handle->socket = sock;
+#else
+   handle->fd = fd;
+#endif
+
+   retval = fixscript_create_value_handle(heap, HANDLE_TYPE_UDP_SOCKET, handle, udp_socket_handle_func);
+   if (!retval.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+static Value native_udp_socket_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   UDPSocketHandle *handle;
+
+   handle = get_udp_socket_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   handle->closed = 1;
+#if defined(_WIN32)
+   if (closesocket(handle->socket) != 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#else
+   if (close(handle->fd) == -1) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#endif
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_udp_socket_get_port(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   UDPSocketHandle *handle;
+   int port;
+
+   handle = get_udp_socket_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   port = udp_get_port(handle->socket);
+#else
+   port = udp_get_port(handle->fd);
+#endif
+   if (port < 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   return fixscript_int(port);
+#endif /* __wasm__ */
+}
+
+
+static Value native_udp_socket_resolve(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   char *hostname = NULL;
+   char buf[128];
+   int err;
+   Value retval = fixscript_int(0);
+#if defined(_WIN32)
+   LPHOSTENT host_ent;
+#else
+   struct addrinfo *addrinfo = NULL, hints;
+#endif
+
+   err = fixscript_get_string(heap, params[0], 0, -1, &hostname, NULL);
+   if (err) {
+      fixscript_error(heap, error, err);
+      goto error;
+   }
+
+#if defined(_WIN32)
+   host_ent = gethostbyname(hostname);
+   if (!host_ent || host_ent->h_addrtype != AF_INET || !host_ent->h_addr_list[0]) {
+      snprintf(buf, sizeof(buf), "can't resolve %s", hostname);
+      *error = fixscript_create_error_string(heap, buf);
+      goto error;
+   }
+   retval = fixscript_int(ntohl(((LPIN_ADDR)host_ent->h_addr_list[0])->s_addr));
+#else
+   memset(&hints, 0, sizeof(struct addrinfo));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_DGRAM;
+
+   if (getaddrinfo(hostname, NULL, &hints, &addrinfo) != 0 || !addrinfo) {
+      snprintf(buf, sizeof(buf), "can't resolve %s", hostname);
+      *error = fixscript_create_error_string(heap, buf);
+      goto error;
+   }
+   retval = fixscript_int(ntohl(((struct sockaddr_in *)addrinfo->ai_addr)->sin_addr.s_addr));
+#endif
+
+error:
+#if !defined(_WIN32)
+   if (addrinfo) {
+      freeaddrinfo(addrinfo);
+   }
+#endif
+   free(hostname);
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+static Value native_udp_socket_receive(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   UDPSocketHandle *handle;
+   int slot_size = params[2].value;
+   int timeout = params[4].value;
+   int count, err, ret, result;
+#if defined(_WIN32)
+   fd_set readfds;
+   TIMEVAL timeval;
+#else
+   struct pollfd pfd;
+#endif
+
+   handle = get_udp_socket_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   count = udp_get_receive_count(heap, error, params[1], slot_size, params[3]);
+   if (count < 0) {
+      return fixscript_int(0);
+   }
+
+   if (timeout >= 0) {
+      #if defined(_WIN32)
+         FD_ZERO(&readfds);
+         FD_SET(handle->socket, &readfds);
+         timeval.tv_sec = timeout / 1000;
+         timeval.tv_usec = (timeout % 1000) * 1000;
+         ret = select(1, &readfds, NULL, NULL, &timeval);
+         if (ret == SOCKET_ERROR) {
+            *error = fixscript_create_error_string(heap, "I/O error");
+            return fixscript_int(0);
+         }
+      #else
+         pfd.fd = handle->fd;
+         pfd.events = POLLIN;
+         ret = poll(&pfd, 1, timeout);
+         if (ret < 0) {
+            if (errno == EINTR) {
+               return fixscript_int(0);
+            }
+            *error = fixscript_create_error_string(heap, "I/O error");
+            return fixscript_int(0);
+         }
+         if (ret == 1 && !(pfd.revents & POLLIN)) {
+            ret = 0;
+         }
+      #endif
+      if (ret == 0) {
+         return fixscript_int(0);
+      }
+   }
+
+#if defined(_WIN32)
+   err = udp_receive_arrays(heap, handle->socket, params[1], slot_size, params[3], count, timeout >= 0, &result);
+#else
+   err = udp_receive_arrays(heap, handle->fd, params[1], slot_size, params[3], count, timeout >= 0, &result);
+#endif
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   if (result < 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   return fixscript_int(result);
+#endif /* __wasm__ */
+}
+
+
+static Value native_udp_socket_send(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   UDPSocketHandle *handle;
+   int err, result;
+
+   handle = get_udp_socket_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   err = udp_send_arrays(heap, handle->socket, params[1], params[2], params[3].value, 0, &result);
+#else
+   err = udp_send_arrays(heap, handle->fd, params[1], params[2], params[3].value, 0, &result);
+#endif
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   if (result < 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   return fixscript_int(result);
+#endif /* __wasm__ */
+}
+
+
+#ifndef __wasm__
+static void async_process_ref(AsyncProcess *proc)
+{
+   __sync_add_and_fetch(&proc->refcnt, 1);
+}
+#endif
+
+
+#ifndef __wasm__
+#define WHEEL_LEVEL_INDEX(time, level) (((time) >> (WHEEL_ROOT_BITS + (level)*WHEEL_LEVEL_BITS)) & (WHEEL_LEVEL_SIZE-1))
+
+static void timer_wheel_link(TimerWheel *wheel, AsyncTimer *timer)
+{
+   AsyncTimer **slot;
+   uint32_t expires, delta;
+   int idx;
+
+   if (timer->immediate) {
+      timer->next = NULL;
+      if (wheel->immediate_last) {
+         wheel->immediate_last->next = timer;
+      }
+      else {
+         wheel->immediate_first = timer;
+      }
+      wheel->immediate_last = timer;
+      return;
+   }
+
+   expires = timer->time;
+   delta = expires - wheel->base;
+   if ((int32_t)delta < 0) {
+      // already expired, put it in the slot that is processed next:
+      expires = wheel->base;
+      delta = 0;
+   }
+
+   if (delta < WHEEL_ROOT_SIZE) {
+      idx = expires & (WHEEL_ROOT_SIZE-1);
+      slot = &wheel->root[idx];
+      wheel->root_bitmap[idx >> 6] |= 1ULL << (idx & 63);
+   }
+   else if (delta < 1U << (WHEEL_ROOT_BITS + 1*WHEEL_LEVEL_BITS)) {
+      slot = &wheel->levels[0][WHEEL_LEVEL_INDEX(expires, 0)];
+   }
+   else if (delta < 1U << (WHEEL_ROOT_BITS + 2*WHEEL_LEVEL_BITS)) {
+      slot = &wheel->levels[1][WHEEL_LEVEL_INDEX(expires, 1)];
+   }
+   else if (delta < 1U << (WHEEL_ROOT_BITS + 3*WHEEL_LEVEL_BITS)) {
+      slot = &wheel->levels[2][WHEEL_LEVEL_INDEX(expires, 2)];
+   }
+   else {
+      slot = &wheel->levels[3][WHEEL_LEVEL_INDEX(expires, 3)];
+   }
+
+   timer->next = *slot;
+   *slot = timer;
+}
+
+
+static void timer_wheel_add(TimerWheel *wheel, AsyncTimer *timer, uint32_t time)
+{
+   if (!timer->immediate) {
+      if (wheel->count++ == 0) {
+         wheel->base = time;
+      }
+   }
+   timer_wheel_link(wheel, timer);
+}
+
+
+static int timer_wheel_cascade(TimerWheel *wheel, int level)
+{
+   AsyncTimer *timer, *next;
+   int idx;
+
+   idx = WHEEL_LEVEL_INDEX(wheel->base, level);
+   timer = wheel->levels[level][idx];
+   wheel->levels[level][idx] = NULL;
+   while (timer) {
+      next = timer->next;
+      timer_wheel_link(wheel, timer);
+      timer = next;
+   }
+   return idx;
+}
+
+
+static int timer_wheel_next_root_slot(TimerWheel *wheel, int idx)
+{
+   uint64_t bits;
+   int i;
+
+   for (i = idx >> 6; i < WHEEL_ROOT_SIZE/64; i++) {
+      bits = wheel->root_bitmap[i];
+      if (i == (idx >> 6)) {
+         bits &= ~0ULL << (idx & 63);
+      }
+      if (bits) {
+         return i*64 + __builtin_ctzll(bits);
+      }
+   }
+   return -1;
+}
+
+
+static AsyncTimer *timer_wheel_expire(TimerWheel *wheel, uint32_t time)
+{
+   AsyncTimer *first, **last, *timer, *next, *list;
+   int idx, next_idx;
+
+   first = wheel->immediate_first;
+   last = wheel->immediate_last? &wheel->immediate_last->next : &first;
+   wheel->immediate_first = NULL;
+   wheel->immediate_last = NULL;
+
+   while (wheel->count > 0 && (int32_t)(time - wheel->base) >= 0) {
+      idx = wheel->base & (WHEEL_ROOT_SIZE-1);
+      if (idx == 0) {
+         if (timer_wheel_cascade(wheel, 0) == 0 && timer_wheel_cascade(wheel, 1) == 0 && timer_wheel_cascade(wheel, 2) == 0) {
+            timer_wheel_cascade(wheel, 3);
+         }
+      }
+
+      // skip the empty slots up to the given time or the end of the root level:
+      next_idx = timer_wheel_next_root_slot(wheel, idx);
+      if (next_idx != idx) {
+         if (next_idx < 0) {
+            next_idx = WHEEL_ROOT_SIZE;
+         }
+         if ((int32_t)(time - wheel->base) < next_idx - idx) {
+            wheel->base = time + 1;
+            break;
+         }
+         wheel->base += next_idx - idx;
+         continue;
+      }
+
+      list = wheel->root[idx];
+      wheel->root[idx] = NULL;
+      wheel->root_bitmap[idx >> 6] &= ~(1ULL << (idx & 63));
+      wheel->base++;
+
+      // the slot list is in reverse order of insertion:
+      for (timer = NULL; list; list = next) {
+         next = list->next;
+         list->next = timer;
+         timer = list;
+         wheel->count--;
+      }
+      *last = timer;
+      while (*last) {
+         last = &(*last)->next;
+      }
+   }
+
+   if (wheel->count == 0) {
+      wheel->base = time + 1;
+   }
+   return first;
+}
+
+
+static int timer_wheel_get_timeout(TimerWheel *wheel, uint32_t time)
+{
+   int idx, next_idx;
+   int32_t diff;
+
+   if (wheel->immediate_first) {
+      return 0;
+   }
+   if (wheel->count == 0) {
+      return -1;
+   }
+
+   diff = (int32_t)(wheel->base - time);
+   if (diff < 0) {
+      return 0;
+   }
+
+   idx = wheel->base & (WHEEL_ROOT_SIZE-1);
+   next_idx = idx == 0? -1 : timer_wheel_next_root_slot(wheel, idx);
+   if (next_idx < 0) {
+      // wake up at the end of the root level to cascade the timers from the upper levels:
+      next_idx = WHEEL_ROOT_SIZE;
+      if (idx == 0) {
+         return diff;
+      }
+   }
+   return diff + (next_idx - idx);
+}
+
+
+static void timer_wheel_free(TimerWheel *wheel)
+{
+   AsyncTimer *timer, *next, **slots[6];
+   int i, j, sizes[6];
+
+   slots[0] = &wheel->immediate_first;
+   sizes[0] = 1;
+   slots[1] = wheel->root;
+   sizes[1] = WHEEL_ROOT_SIZE;
+   for (i=0; i<4; i++) {
+      slots[i+2] = wheel->levels[i];
+      sizes[i+2] = WHEEL_LEVEL_SIZE;
+   }
+
+   for (i=0; i<6; i++) {
+      for (j=0; j<sizes[i]; j++) {
+         for (timer = slots[i][j]; timer; timer = next) {
+            next = timer->next;
+            free(timer);
+         }
+      }
+   }
+}
+#endif
+
+
+#ifndef __wasm__
+static void free_async_file_op(AsyncFileOp *op)
+{
+   if (op->file) {
+      file_handle_func(NULL, HANDLE_OP_FREE, op->file, NULL);
+   }
+   free(op->fname);
+   free(op->buf);
+   free(op);
+}
+#endif
+
+
+#ifdef USE_IO_URING
+static void ring_free_handle(AsyncProcess *proc, AsyncCommon *common)
+{
+   AsyncHandle *handle = (AsyncHandle *)common;
+   void **prev;
+
+   for (prev = &proc->ring_freed_handles; *prev; prev = &((AsyncCommon *)*prev)->ring_freed_next) {
+      if (*prev == common) {
+         *prev = common->ring_freed_next;
+         break;
+      }
+   }
+
+   if (common->type == ASYNC_TCP_CONNECTION) {
+      free(handle->read.ring_buf);
+      free(handle->write.ring_buf);
+   }
+   free(common);
+}
+
+// the heap is NULL when the ring is being destroyed, the script values are freed with the heap then:
+static void ring_complete_freed(AsyncProcess *proc, Heap *heap, AsyncCommon *common, int op, int res)
+{
+   AsyncHandle *handle = (AsyncHandle *)common;
+   AsyncServerHandle *server_handle = (AsyncServerHandle *)common;
+
+   if (common->type == ASYNC_TCP_CONNECTION) {
+      if (op == RING_OP_READ && (common->active & ASYNC_READ)) {
+         if (handle->read.fd_passing) {
+            if (res > 0) {
+               close(fd_message_get_fd((FDMessage *)handle->read.ring_buf));
+            }
+         }
+         else if (heap) {
+            fixscript_unref(heap, handle->read.array);
+         }
+         if (heap) {
+            fixscript_unref(heap, handle->read.data);
+         }
+         common->active &= ~ASYNC_READ;
+      }
+      else if (op == RING_OP_WRITE && (common->active & ASYNC_WRITE)) {
+         if (heap) {
+            fixscript_unref(heap, handle->write.data);
+         }
+         common->active &= ~ASYNC_WRITE;
+      }
+   }
+   else if (common->type == ASYNC_TCP_SERVER) {
+      if (op == RING_OP_ACCEPT && common->active) {
+         if (res >= 0) {
+            close(res);
+         }
+         if (heap) {
+            fixscript_unref(heap, server_handle->data);
+         }
+         common->active = 0;
+      }
+   }
+
+   if (--common->ring_pending == 0) {
+      ring_free_handle(proc, common);
+   }
+}
+
+static void ring_drain_freed(AsyncProcess *proc)
+{
+   void *ptr;
+   int i, op, res;
+
+   // the cancelled operations must be completed before the buffers can be freed:
+   for (i=0; i<10 && proc->ring_freed_handles; i++) {
+      ring_submit(proc->ring);
+      ring_wait(proc->ring, 100);
+      while (ring_get_event(proc->ring, &ptr, &op, &res)) {
+         if (op == RING_OP_POLL || op == RING_OP_CANCEL) {
+            continue;
+         }
+         ring_complete_freed(proc, NULL, ptr, op, res);
+      }
+   }
+}
+#endif
+
+
+#ifndef __wasm__
+static void async_process_unref(AsyncProcess *proc)
+{
+   AsyncThreadResult *atr, *atr_next;
+   
+   if (__sync_sub_and_fetch(&proc->refcnt, 1) == 0) {
+      for (atr = proc->thread_results; atr; atr = atr_next) {
+         if (atr->type == ASYNC_FILE) {
+            free_async_file_op(atr->file_op);
+         }
+         else {
+            #if defined(_WIN32)
+               if (atr->socket != INVALID_SOCKET) {
+                  closesocket(atr->socket);
+               }
+            #elif defined(__wasm__)
+            #else
+               if (atr->fd != -1) {
+                  close(atr->fd);
+               }
+            #endif
+         }
+         atr_next = atr->next;
+         free(atr);
+      }
+      #if defined(_WIN32)
+         CloseHandle(proc->iocp);
+      #elif defined(__wasm__)
+      #else
+         #ifdef USE_IO_URING
+         if (proc->ring) {
+            ring_drain_freed(proc);
+            ring_destroy(proc->ring);
+         }
+         #endif
+         poll_destroy(proc->poll);
+      #endif
+      timer_wheel_free(&proc->timers);
+      pthread_mutex_destroy(&proc->mutex);
+      free(proc);
+   }
+}
+#endif
+
+
+#ifndef __wasm__
+static AsyncProcess *get_async_process(Heap *heap, Value *error)
+{
+   AsyncProcess *proc;
+   int err;
+
+   proc = fixscript_get_heap_data(heap, async_process_key);
+   if (!proc) {
+      proc = calloc(1, sizeof(AsyncProcess));
+      proc->refcnt = 1;
+      proc->file_ops_max = 4;
+      if (pthread_mutex_init(&proc->mutex, NULL) != 0) {
+         free(proc);
+         *error = fixscript_create_error_string(heap, "can't create mutex");
+         return NULL;
+      }
+
+#if defined(_WIN32)
+      proc->iocp = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
+      if (!proc->iocp) {
+         pthread_mutex_destroy(&proc->mutex);
+         free(proc);
+         *error = fixscript_create_error_string(heap, "can't create IO completion port");
+         return NULL;
+      }
+#else
+      #ifndef __wasm__
+         proc->poll = poll_create();
+      #endif
+      if (!proc->poll) {
+         pthread_mutex_destroy(&proc->mutex);
+         free(proc);
+         *error = fixscript_create_error_string(heap, "can't create poll file descriptor");
+         return NULL;
+      }
+      #ifdef USE_IO_URING
+         // the epoll file descriptor is watched by the ring for the notifications from other threads,
+         // the epoll is used directly when io_uring is not available:
+         proc->ring = ring_create(256);
+         if (proc->ring && !ring_add(proc->ring, IORING_OP_POLL_ADD, proc->poll->epoll_fd, NULL, 0, NULL, RING_OP_POLL)) {
+            ring_destroy(proc->ring);
+            proc->ring = NULL;
+         }
+      #endif
+#endif
+
+      err = fixscript_set_heap_data(heap, async_process_key, proc, (HandleFreeFunc)async_process_unref);
+      if (err) {
+         fixscript_error(heap, error, err);
+         return NULL;
+      }
+   }
+   return proc;
+}
+#endif
+
+
+#ifndef __wasm__
+static void async_process_notify(AsyncProcess *proc)
+{
+#if defined(_WIN32)
+   PostQueuedCompletionStatus(proc->iocp, 0, 0, (OVERLAPPED *)proc);
+#elif defined(__wasm__)
+#else
+   poll_interrupt(proc->poll);
+#endif
+}
+#endif
+
+
+static pthread_mutex_t *get_mutex(volatile pthread_mutex_t **mutex_ptr)
+{
+   pthread_mutex_t *mutex, *cur_mutex;
+
+   mutex = (pthread_mutex_t *)*mutex_ptr;
+   if (!mutex) {
+      mutex = calloc(1, sizeof(pthread_mutex_t));
+      if (!mutex) {
+         return NULL;
+      }
+      if (pthread_mutex_init(mutex, NULL) != 0) {
+         free(mutex);
+         return NULL;
+      }
+      cur_mutex = (pthread_mutex_t *)__sync_val_compare_and_swap(mutex_ptr, NULL, mutex);
+      if (cur_mutex) {
+         pthread_mutex_destroy(mutex);
+         free(mutex);
+         mutex = cur_mutex;
+      }
+   }
+   return mutex;
+}
+
+
+#if !defined(_WIN32) && !defined(__wasm__)
+static pthread_cond_t *get_cond(volatile pthread_cond_t **cond_ptr)
+{
+   pthread_cond_t *cond, *cur_cond;
+
+   cond = (pthread_cond_t *)*cond_ptr;
+   if (!cond) {
+      cond = calloc(1, sizeof(pthread_cond_t));
+      if (!cond) {
+         return NULL;
+      }
+      if (pthread_cond_init(cond, NULL) != 0) {
+         free(cond);
+         return NULL;
+      }
+      cur_cond = (pthread_cond_t *)__sync_val_compare_and_swap(cond_ptr, NULL, cond);
+      if (cur_cond) {
+         pthread_cond_destroy(cond);
+         free(cond);
+         cond = cur_cond;
+      }
+   }
+   return cond;
+}
+#endif
+
+
+#ifndef __wasm__
+#if defined(_WIN32)
+static DWORD WINAPI thread_main(void *data)
+#else
+static void *thread_main(void *data)
+#endif
+{
+   Thread *thread = data;
+   pthread_mutex_t *global_mutex;
+   
+   global_mutex = get_mutex(&threads_mutex);
+   if (!global_mutex) {
+#if defined(_WIN32)
+      return 0;
+#else
+      return NULL;
+#endif
+   }
+
+   for (;;) {
+      pthread_mutex_lock(&thread->mutex);
+      while (!thread->func) {
+         if (pthread_cond_timedwait_relative(&thread->cond, &thread->mutex, 5000*1000000LL) == ETIMEDOUT && !thread->func) {
+            pthread_mutex_unlock(&thread->mutex);
+            goto end;
+         }
+      }
+
+      thread->func(thread->data);
+      thread->func = NULL;
+      pthread_mutex_unlock(&thread->mutex);
+      
+      pthread_mutex_lock(global_mutex);
+      thread->next = threads_pool;
+      threads_pool = thread;
+      pthread_mutex_unlock(global_mutex);
+   }
+
+end:
+   pthread_cond_destroy(&thread->cond);
+   pthread_mutex_destroy(&thread->mutex);
+   free(thread);
+
+#if defined(_WIN32)
+   return 0;
+#else
+   return NULL;
+#endif
+}
+#endif
+
+
+#ifndef __wasm__
+static int async_run_thread(ThreadFunc func, void *data)
+{
+   pthread_mutex_t *mutex;
+   Thread *thread;
+#if defined(_WIN32)
+   HANDLE handle;
+#else
+   pthread_t handle;
+#endif
+
+   mutex = get_mutex(&threads_mutex);
+   if (!mutex) {
+      return 0;
+   }
+   
+   pthread_mutex_lock(mutex);
+
+   if (threads_pool) {
+      thread = threads_pool;
+      threads_pool = thread->next;
+   }
+   else {
+      thread = calloc(1, sizeof(Thread));
+      if (!thread) {
+         pthread_mutex_unlock(mutex);
+         return 0;
+      }
+
+      if (pthread_mutex_init(&thread->mutex, NULL) != 0) {
+         free(thread);
+         pthread_mutex_unlock(mutex);
+         return 0;
+      }
+
+      if (pthread_cond_init(&thread->cond, NULL) != 0) {
+         pthread_mutex_destroy(&thread->mutex);
+         free(thread);
+         pthread_mutex_unlock(mutex);
+         return 0;
+      }
+
+#if defined(_WIN32)
+      handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL);
+      if (!handle) {
+         pthread_cond_destroy(&thread->cond);
+         pthread_mutex_destroy(&thread->mutex);
+         free(thread);
+         pthread_mutex_unlock(mutex);
+         return 0;
+      }
+      CloseHandle(handle);
+#else
+      if (pthread_create(&handle, NULL, thread_main, thread) != 0) {
+         pthread_cond_destroy(&thread->cond);
+         pthread_mutex_destroy(&thread->mutex);
+         free(thread);
+         pthread_mutex_unlock(mutex);
          return 0;
       }
-      CloseHandle(handle);
+      pthread_detach(handle);
+#endif
+   }
+
+   pthread_mutex_unlock(mutex);
+   
+   pthread_mutex_lock(&thread->mutex);
+   thread->func = func;
+   thread->data = data;
+   pthread_cond_signal(&thread->cond);
+   pthread_mutex_unlock(&thread->mutex);
+   return 1;
+}
+#endif
+
+
+#ifdef USE_IO_URING
+static int ring_cancel_handle(AsyncCommon *common)
+{
+   Ring *ring = common->proc->ring;
+
+   if (common->type == ASYNC_TCP_CONNECTION) {
+      if (common->active & ASYNC_READ) {
+         ring_cancel(ring, common, RING_OP_READ);
+      }
+      if (common->active & ASYNC_WRITE) {
+         ring_cancel(ring, common, RING_OP_WRITE);
+      }
+   }
+   else if (common->type == ASYNC_TCP_SERVER) {
+      if (common->active) {
+         ring_cancel(ring, common, RING_OP_ACCEPT);
+      }
+   }
+   return common->ring_pending > 0;
+}
+#endif
+
+
+#ifndef __wasm__
+static void free_async_handle(void *data)
+{
+   AsyncCommon *common = data;
+   AsyncProcess *proc = common->proc;
+
+#ifdef USE_IO_URING
+   if (proc->ring && ring_cancel_handle(common)) {
+      // the kernel still uses the buffers, the handle is freed once all operations are completed
+      // or when the ring is destroyed:
+      common->ring_freed = 1;
+      common->ring_freed_next = proc->ring_freed_handles;
+      proc->ring_freed_handles = common;
+   }
+   else if (common->type == ASYNC_TCP_CONNECTION) {
+      free(((AsyncHandle *)common)->read.ring_buf);
+      free(((AsyncHandle *)common)->write.ring_buf);
+   }
+#endif
+#if !defined(_WIN32) && !defined(__wasm__)
+   poll_remove_socket(proc->poll, common->fd);
+#endif
+
+   if (common->type == ASYNC_TCP_CONNECTION || common->type == ASYNC_TCP_SERVER || common->type == ASYNC_UDP_SOCKET || common->type == ASYNC_PROCESS_STREAM) {
+      #if defined(_WIN32)
+      if (common->type == ASYNC_TCP_SERVER) {
+         closesocket(((AsyncServerHandle *)common)->accept_socket);
+      }
+      if (common->type == ASYNC_UDP_SOCKET) {
+         free(((AsyncUDPHandle *)common)->read_buf);
+      }
+      closesocket(common->socket);
+      #elif defined(__wasm__)
+      #else
+      close(common->fd);
+      if (common->type == ASYNC_TCP_SERVER && ((AsyncServerHandle *)common)->unix_path) {
+         unlink(((AsyncServerHandle *)common)->unix_path);
+         free(((AsyncServerHandle *)common)->unix_path);
+      }
+      #endif
+   }
+#ifdef USE_IO_URING
+   if (!common->ring_freed)
+#endif
+   free(common);
+   async_process_unref(proc);
+}
+#endif
+
+
+#if !defined(_WIN32) && !defined(__wasm__)
+static void update_poll_ctl(AsyncCommon *common)
+{
+   if (common->active != common->last_active) {
+      poll_update_socket(common->proc->poll, common->fd, common, common->type == ASYNC_TCP_SERVER? (common->active? ASYNC_READ : 0) : common->active);
+      common->last_active = common->active;
+   }
+}
+#endif
+
+
+#if !defined(_WIN32) && !defined(__wasm__)
+static Value create_async_connection(Heap *heap, AsyncProcess *proc, int fd)
+{
+   AsyncHandle *handle;
+   int flags;
+
+   flags = fcntl(fd, F_GETFL);
+   if (flags == -1) {
+      close(fd);
+      return fixscript_int(0);
+   }
+   flags |= O_NONBLOCK;
+   if (fcntl(fd, F_SETFL, flags) == -1) {
+      close(fd);
+      return fixscript_int(0);
+   }
+
+   handle = calloc(1, sizeof(AsyncHandle));
+   if (!handle) {
+      close(fd);
+      return fixscript_int(0);
+   }
+
+   handle->common.proc = proc;
+   async_process_ref(handle->common.proc);
+   handle->common.type = ASYNC_TCP_CONNECTION;
+   handle->common.fd = fd;
+#ifdef USE_IO_URING
+   if (!proc->ring)
+#endif
+   if (!poll_add_socket(proc->poll, fd, handle, 0)) {
+      async_process_unref(handle->common.proc);
+      close(fd);
+      free(handle);
+      return fixscript_int(0);
+   }
+
+   return fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, handle, free_async_handle);
+}
+#endif
+
+
+#ifndef __wasm__
+typedef struct {
+   AsyncProcess *proc;
+   char *hostname;
+   int port;
+   int unix_socket;
+   Value callback;
+   Value data;
+   AsyncThreadResult *atr;
+} TCPOpenData;
+
+static void tcp_open_func(void *data)
+{
+   TCPOpenData *tod = data;
+   AsyncProcess *proc = tod->proc;
+   AsyncThreadResult *atr = tod->atr;
+#if defined(_WIN32)
+   u_long arg;
+#else
+   int flags;
+#endif
+
+   atr->type = ASYNC_TCP_CONNECTION;
+   atr->callback = tod->callback;
+   atr->data = tod->data;
+
+#if defined(_WIN32)
+   if (tcp_connect(tod->hostname, tod->port, &atr->socket, 1)) {
+      arg = 1;
+      if (ioctlsocket(atr->socket, FIONBIO, &arg) != 0) {
+         closesocket(atr->socket);
+         atr->socket = INVALID_SOCKET;
+      }
+   }
+   else {
+      atr->socket = INVALID_SOCKET;
+   }
+#else
+   if (tod->unix_socket? unix_connect(tod->hostname, &atr->fd) : tcp_connect(tod->hostname, tod->port, &atr->fd)) {
+      flags = fcntl(atr->fd, F_GETFL);
+      if (flags != -1) {
+         flags |= O_NONBLOCK;
+         if (fcntl(atr->fd, F_SETFL, flags) == -1) {
+            close(atr->fd);
+            atr->fd = -1;
+         }
+      }
+      else {
+         close(atr->fd);
+         atr->fd = -1;
+      }
+   }
+   else {
+      atr->fd = -1;
+   }
+#endif
+
+   pthread_mutex_lock(&proc->mutex);
+   atr->next = proc->thread_results;
+   proc->thread_results = atr;
+   async_process_notify(proc);
+   pthread_mutex_unlock(&proc->mutex);
+
+   async_process_unref(tod->proc);
+   free(tod->hostname);
+   free(tod);
+}
+#endif /* __wasm__ */
+
+static Value native_async_tcp_connection_open(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   int unix_socket = data == (void *)1;
+   AsyncProcess *proc;
+   TCPOpenData *tod;
+   int err;
+
+#if defined(_WIN32)
+   if (unix_socket) {
+      *error = fixscript_create_error_string(heap, "not supported");
+      return fixscript_int(0);
+   }
+#endif
+   
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   tod = calloc(1, sizeof(TCPOpenData));
+   if (!tod) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   
+   tod->atr = calloc(1, sizeof(AsyncThreadResult));
+   if (!tod->atr) {
+      free(tod);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   err = fixscript_get_string(heap, params[0], 0, -1, &tod->hostname, NULL);
+   if (err) {
+      free(tod->atr);
+      free(tod);
+      return fixscript_error(heap, error, err);
+   }
+
+   tod->proc = proc;
+   tod->unix_socket = unix_socket;
+   if (unix_socket) {
+      tod->callback = params[1];
+      tod->data = params[2];
+   }
+   else {
+      tod->port = fixscript_get_int(params[1]);
+      tod->callback = params[2];
+      tod->data = params[3];
+   }
+   async_process_ref(proc);
+   fixscript_ref(heap, tod->data);
+
+   if (!async_run_thread(tcp_open_func, tod)) {
+      async_process_unref(proc);
+      fixscript_unref(heap, tod->data);
+      free(tod->hostname);
+      free(tod->atr);
+      free(tod);
+      *error = fixscript_create_error_string(heap, "can't create thread");
+      return fixscript_int(0);
+   }
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_connection_read(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+#ifdef _WIN32
+   WSABUF wsabuf;
+   DWORD flags;
+   DWORD read;
+#endif
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+   
+   if (handle->common.active & ASYNC_READ) {
+      *error = fixscript_create_error_string(heap, "only one read operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+#ifdef _WIN32
+   if (params[3].value > sizeof(handle->read.buf)) {
+      params[3].value = sizeof(handle->read.buf);
+   }
+   if (params[3].value < 0) {
+      *error = fixscript_create_error_string(heap, "negative length");
+      return fixscript_int(0);
+   }
+#endif
+
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      if (params[3].value < 0) {
+         *error = fixscript_create_error_string(heap, "negative length");
+         return fixscript_int(0);
+      }
+      if (!ring_reserve(&handle->read.ring_buf, &handle->read.ring_buf_size, params[3].value)) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      if (!ring_add(handle->common.proc->ring, IORING_OP_RECV, handle->common.fd, handle->read.ring_buf, params[3].value, handle, RING_OP_READ)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+   }
+#endif
+
+   handle->common.active |= ASYNC_READ;
+   handle->read.callback = params[4];
+   handle->read.data = params[5];
+   handle->read.array = params[1];
+   handle->read.off = params[2].value;
+   handle->read.len = params[3].value;
+   fixscript_ref(heap, handle->read.data);
+   fixscript_ref(heap, handle->read.array);
+
+#ifdef _WIN32
+   memset(&handle->read.overlapped, 0, sizeof(WSAOVERLAPPED));
+
+   wsabuf.len = params[3].value;
+   wsabuf.buf = handle->read.buf;
+   flags = 0;
+   WSARecv(handle->common.socket, &wsabuf, 1, &read, &flags, &handle->read.overlapped, NULL);
+#else
+   #ifdef USE_IO_URING
+   if (!handle->common.proc->ring)
+   #endif
+   update_poll_ctl(&handle->common);
+#endif
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+#if defined(_WIN32)
+static Value native_async_tcp_connection_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   AsyncHandle *handle;
+   WSABUF wsabuf;
+   DWORD written;
+   int err;
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+   
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   if (params[3].value > sizeof(handle->write.buf)) {
+      params[3].value = sizeof(handle->write.buf);
+   }
+
+   err = fixscript_get_array_bytes(heap, params[1], params[2].value, params[3].value, handle->write.buf);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[4];
+   handle->write.data = params[5];
+   fixscript_ref(heap, handle->write.data);
+
+   memset(&handle->write.overlapped, 0, sizeof(WSAOVERLAPPED));
+
+   wsabuf.len = params[3].value;
+   wsabuf.buf = handle->write.buf;
+   WSASend(handle->common.socket, &wsabuf, 1, &written, 0, &handle->write.overlapped, NULL);
+
+   return fixscript_int(0);
+}
+#elif defined(__wasm__)
+static Value native_async_tcp_connection_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+}
+#else
+static Value native_async_tcp_connection_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   AsyncHandle *handle;
+   char *buf;
+   int err;
+   int written;
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+   
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      if (params[3].value < 0) {
+         *error = fixscript_create_error_string(heap, "negative length");
+         return fixscript_int(0);
+      }
+      if (!ring_reserve(&handle->write.ring_buf, &handle->write.ring_buf_size, params[3].value)) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      err = fixscript_get_array_bytes(heap, params[1], params[2].value, params[3].value, handle->write.ring_buf);
+      if (err) {
+         return fixscript_error(heap, error, err);
+      }
+      if (!ring_add(handle->common.proc->ring, IORING_OP_SEND, handle->common.fd, handle->write.ring_buf, params[3].value, handle, RING_OP_WRITE)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+
+      handle->common.active |= ASYNC_WRITE;
+      handle->write.callback = params[4];
+      handle->write.data = params[5];
+      fixscript_ref(heap, handle->write.data);
+      return fixscript_int(0);
+   }
+#endif
+
+   err = fixscript_lock_array(heap, params[1], params[2].value, params[3].value, (void **)&buf, 1, ACCESS_READ_ONLY);
+   if (err) {
+      fixscript_error(heap, error, err);
+      return fixscript_int(0);
+   }
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[4];
+   handle->write.data = params[5];
+   fixscript_ref(heap, handle->write.data);
+
+   written = write(handle->common.fd, buf, params[3].value);
+   if (written < 0 && errno == EAGAIN) {
+      written = 0;
+   }
+   handle->write.result = written;
+   update_poll_ctl(&handle->common);
+
+   fixscript_unlock_array(heap, params[1], params[2].value, params[3].value, (void **)&buf, 1, ACCESS_READ_ONLY);
+
+   return fixscript_int(0);
+}
+#endif
+
+
+static Value native_async_tcp_connection_writev(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+   WriteVector vec;
+#if defined(_WIN32)
+   WSABUF wsabuf;
+   DWORD written;
+#else
+   struct iovec iov[MAX_WRITE_VECTORS];
+   int i, ret;
+#endif
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+   
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   if (!lock_write_vector(heap, error, params[1], &vec)) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   wsabuf.len = copy_write_vector(&vec, handle->write.buf, sizeof(handle->write.buf));
+   wsabuf.buf = handle->write.buf;
+   unlock_write_vector(heap, &vec);
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[2];
+   handle->write.data = params[3];
+   fixscript_ref(heap, handle->write.data);
+
+   memset(&handle->write.overlapped, 0, sizeof(WSAOVERLAPPED));
+   WSASend(handle->common.socket, &wsabuf, 1, &written, 0, &handle->write.overlapped, NULL);
+#else
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      // the arrays can't stay locked while the operation is pending, the data is gathered into the buffer instead:
+      if (!ring_reserve(&handle->write.ring_buf, &handle->write.ring_buf_size, vec.total)) {
+         unlock_write_vector(heap, &vec);
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      ret = 0;
+      for (i=0; i<vec.count; i++) {
+         memcpy(handle->write.ring_buf + ret, vec.ptr[i], vec.len[i]);
+         ret += vec.len[i];
+      }
+      unlock_write_vector(heap, &vec);
+      if (!ring_add(handle->common.proc->ring, IORING_OP_SEND, handle->common.fd, handle->write.ring_buf, ret, handle, RING_OP_WRITE)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+
+      handle->common.active |= ASYNC_WRITE;
+      handle->write.callback = params[2];
+      handle->write.data = params[3];
+      fixscript_ref(heap, handle->write.data);
+      return fixscript_int(0);
+   }
+#endif
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[2];
+   handle->write.data = params[3];
+   fixscript_ref(heap, handle->write.data);
+
+   ret = 0;
+   if (vec.count > 0) {
+      for (i=0; i<vec.count; i++) {
+         iov[i].iov_base = vec.ptr[i];
+         iov[i].iov_len = vec.len[i];
+      }
+      ret = writev(handle->common.fd, iov, vec.count);
+      if (ret < 0 && errno == EAGAIN) {
+         ret = 0;
+      }
+   }
+   unlock_write_vector(heap, &vec);
+
+   handle->write.result = ret;
+   update_poll_ctl(&handle->common);
+#endif
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_connection_send_file(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+   FileHandle *file;
+   uint64_t offset;
+   int len = params[4].value;
+#if defined(_WIN32)
+   OVERLAPPED overlapped;
+   WSABUF wsabuf;
+   DWORD read, written;
+#else
+   int ret;
+#endif
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+   
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   offset = ((uint32_t)params[2].value) | (((uint64_t)params[3].value) << 32);
+   file = get_send_file_handle(heap, error, params[1], offset, &len);
+   if (!file) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   if (len > sizeof(handle->write.buf)) {
+      len = sizeof(handle->write.buf);
+   }
+
+   memset(&overlapped, 0, sizeof(OVERLAPPED));
+   overlapped.Offset = (DWORD)offset;
+   overlapped.OffsetHigh = (DWORD)(offset >> 32);
+   if (len > 0 && !ReadFile(file->handle, handle->write.buf, len, &read, &overlapped)) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[5];
+   handle->write.data = params[6];
+   fixscript_ref(heap, handle->write.data);
+
+   memset(&handle->write.overlapped, 0, sizeof(WSAOVERLAPPED));
+
+   wsabuf.len = len > 0? read : 0;
+   wsabuf.buf = handle->write.buf;
+   WSASend(handle->common.socket, &wsabuf, 1, &written, 0, &handle->write.overlapped, NULL);
+#else
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      // there is no direct operation for sending of files, the data is read into the buffer instead:
+      if (len > 65536) {
+         len = 65536;
+      }
+      if (!ring_reserve(&handle->write.ring_buf, &handle->write.ring_buf_size, len)) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      ret = len > 0? pread(file->fd, handle->write.ring_buf, len, offset) : 0;
+      if (ret < 0 || !ring_add(handle->common.proc->ring, IORING_OP_SEND, handle->common.fd, handle->write.ring_buf, ret, handle, RING_OP_WRITE)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+
+      handle->common.active |= ASYNC_WRITE;
+      handle->write.callback = params[5];
+      handle->write.data = params[6];
+      fixscript_ref(heap, handle->write.data);
+      return fixscript_int(0);
+   }
+#endif
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[5];
+   handle->write.data = params[6];
+   fixscript_ref(heap, handle->write.data);
+
+   ret = len > 0? send_file_part(handle->common.fd, file, offset, len) : 0;
+   if (ret < 0 && errno == EAGAIN) {
+      ret = 0;
+   }
+   handle->write.result = ret;
+   update_poll_ctl(&handle->common);
+#endif
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_connection_send_connection(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+   int passed_fd;
+#ifdef USE_IO_URING
+   FDMessage *fdm;
+#endif
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   passed_fd = get_passed_fd(heap, error, params[1]);
+   if (passed_fd == -1) {
+      return fixscript_int(0);
+   }
+
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      if (!ring_reserve(&handle->write.ring_buf, &handle->write.ring_buf_size, sizeof(FDMessage))) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      fdm = (FDMessage *)handle->write.ring_buf;
+      fd_message_init(fdm, passed_fd);
+      if (!ring_add(handle->common.proc->ring, IORING_OP_SENDMSG, handle->common.fd, &fdm->msg, 1, handle, RING_OP_WRITE)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+
+      handle->common.active |= ASYNC_WRITE;
+      handle->write.callback = params[2];
+      handle->write.data = params[3];
+      fixscript_ref(heap, handle->write.data);
+      return fixscript_int(0);
+   }
+#endif
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[2];
+   handle->write.data = params[3];
+   fixscript_ref(heap, handle->write.data);
+
+   handle->write.result = unix_send_fd(handle->common.fd, passed_fd, MSG_DONTWAIT);
+   if (handle->write.result < 0 && errno == EAGAIN) {
+      handle->write.result = 0;
+   }
+   update_poll_ctl(&handle->common);
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_connection_receive_connection(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+#ifdef USE_IO_URING
+   FDMessage *fdm;
+#endif
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+
+   if (handle->common.active & ASYNC_READ) {
+      *error = fixscript_create_error_string(heap, "only one read operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      if (!ring_reserve(&handle->read.ring_buf, &handle->read.ring_buf_size, sizeof(FDMessage))) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      fdm = (FDMessage *)handle->read.ring_buf;
+      fd_message_init(fdm, -1);
+      if (!ring_add(handle->common.proc->ring, IORING_OP_RECVMSG, handle->common.fd, &fdm->msg, 1, handle, RING_OP_READ)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+   }
+#endif
+
+   handle->common.active |= ASYNC_READ;
+   handle->read.fd_passing = 1;
+   handle->read.callback = params[1];
+   handle->read.data = params[2];
+   fixscript_ref(heap, handle->read.data);
+
+#ifdef USE_IO_URING
+   if (!handle->common.proc->ring)
+#endif
+   update_poll_ctl(&handle->common);
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_connection_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   AsyncHandle *handle;
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_CONNECTION) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   closesocket(handle->common.socket);
+   handle->common.socket = INVALID_SOCKET;
+#elif defined(__wasm__)
+#else
+   #ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      ring_cancel_handle(&handle->common);
+   }
+   #endif
+   poll_remove_socket(handle->common.proc->poll, handle->common.fd);
+   close(handle->common.fd);
+   handle->common.fd = -1;
+#endif
+   return fixscript_int(0);
+}
+
+
+static Value native_async_tcp_server_create(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   int local_only = data == (void *)1;
+   int reuse_port = num_params > 1 && params[1].value;
+   AsyncProcess *proc;
+   AsyncServerHandle *handle;
+   struct sockaddr_in server;
+#if defined(_WIN32)
+   SOCKET sock = INVALID_SOCKET;
+#else
+   int fd = -1;
+#endif
+   int reuse;
+   Value retval = fixscript_int(0);
+   
+#ifndef SO_REUSEPORT
+   if (reuse_port) {
+      *error = fixscript_create_error_string(heap, "reusing of port is not supported");
+      return fixscript_int(0);
+   }
+#endif
+   
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+#if defined(_WIN32)
+   sock = socket(AF_INET, SOCK_STREAM, 0);
+   if (sock == INVALID_SOCKET) {
+      goto io_error;
+   }
+
+   reuse = 1;
+   if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
+      goto io_error;
+   }
+
+   server.sin_family = AF_INET;
+   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
+   server.sin_port = htons(params[0].value);
+
+   if (bind(sock, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
+      goto io_error;
+   }
+
+   if (listen(sock, 5) == SOCKET_ERROR) {
+      goto io_error;
+   }
+#else
+   fd = socket(AF_INET, SOCK_STREAM, 0);
+   if (fd == -1) {
+      goto io_error;
+   }
+
+   reuse = 1;
+   if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
+      goto io_error;
+   }
+
+#if defined(SO_REUSEPORT_LB)
+   // multiple servers (usually each in different thread) can listen on the same port,
+   // FreeBSD distributes the incoming connections between them only with this variant:
+   if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT_LB, (const char *)&reuse, sizeof(reuse)) < 0) {
+      goto io_error;
+   }
+#elif defined(SO_REUSEPORT)
+   // multiple servers (usually each in different thread) can listen on the same port,
+   // Linux distributes the incoming connections between them, other systems don't:
+   if (reuse_port && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const char *)&reuse, sizeof(reuse)) < 0) {
+      goto io_error;
+   }
+#endif
+
+   server.sin_family = AF_INET;
+   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
+   server.sin_port = htons(params[0].value);
+
+   if (bind(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
+      goto io_error;
+   }
+
+   if (listen(fd, 5) < 0) {
+      goto io_error;
+   }
+#endif
+
+   handle = calloc(1, sizeof(AsyncServerHandle));
+   if (!handle) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+   handle->common.proc = proc;
+   async_process_ref(handle->common.proc);
+   handle->common.type = ASYNC_TCP_SERVER;
+#if defined(_WIN32)
+   handle->common.socket = sock;
+   handle->accept_socket = INVALID_SOCKET;
+   if (!CreateIoCompletionPort((HANDLE)handle->common.socket, proc->iocp, (ULONG_PTR)handle, 0)) {
+      async_process_unref(handle->common.proc);
+      free(handle);
+      goto io_error;
+   }
+#else
+   handle->common.fd = fd;
+   #ifdef USE_IO_URING
+   if (!proc->ring)
+   #endif
+   if (!poll_add_socket(proc->poll, fd, handle, 0)) {
+      async_process_unref(handle->common.proc);
+      free(handle);
+      goto io_error;
+   }
+#endif
+
+   retval = fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, handle, free_async_handle);
+#if defined(_WIN32)
+   sock = INVALID_SOCKET;
+#else
+   fd = -1;
+#endif
+   if (!retval.value) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+error:
+#if defined(_WIN32)
+   if (!retval.value && sock != INVALID_SOCKET) {
+      closesocket(sock);
+   }
+#else
+   if (!retval.value && fd != -1) {
+      close(fd);
+   }
+#endif
+   return retval;
+
+io_error:
+   *error = fixscript_create_error_string(heap, "I/O error");
+   goto error;
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_server_create_unix(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   AsyncServerHandle *handle;
+   char *path = NULL;
+   char buf[128];
+   int err, fd = -1;
+   Value retval = fixscript_int(0);
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   err = fixscript_get_string(heap, params[0], 0, -1, &path, NULL);
+   if (err) {
+      fixscript_error(heap, error, err);
+      goto error;
+   }
+
+   if (!unix_listen(path, &fd)) {
+      snprintf(buf, sizeof(buf), "can't listen on %s", path);
+      *error = fixscript_create_error_string(heap, buf);
+      goto error;
+   }
+
+   handle = calloc(1, sizeof(AsyncServerHandle));
+   if (!handle) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+   handle->common.proc = proc;
+   async_process_ref(handle->common.proc);
+   handle->common.type = ASYNC_TCP_SERVER;
+   handle->common.fd = fd;
+   #ifdef USE_IO_URING
+   if (!proc->ring)
+   #endif
+   if (!poll_add_socket(proc->poll, fd, handle, 0)) {
+      async_process_unref(handle->common.proc);
+      free(handle);
+      *error = fixscript_create_error_string(heap, "I/O error");
+      goto error;
+   }
+   handle->unix_path = path;
+   path = NULL;
+
+   retval = fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, handle, free_async_handle);
+   fd = -1;
+   if (!retval.value) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      goto error;
+   }
+
+error:
+   if (fd != -1) {
+      close(fd);
+      unlink(path);
+   }
+   free(path);
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_server_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncServerHandle *handle;
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_SERVER) {
+      *error = fixscript_create_error_string(heap, "invalid async TCP server handle");
+      return fixscript_int(0);
+   }
+
+#ifdef _WIN32
+   closesocket(handle->common.socket);
+   handle->common.socket = INVALID_SOCKET;
+#else
+   #ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      ring_cancel_handle(&handle->common);
+   }
+   #endif
+   poll_remove_socket(handle->common.proc->poll, handle->common.fd);
+   close(handle->common.fd);
+   handle->common.fd = -1;
+   if (handle->unix_path) {
+      unlink(handle->unix_path);
+      free(handle->unix_path);
+      handle->unix_path = NULL;
+   }
+#endif
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_tcp_server_accept(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncServerHandle *handle;
+#ifdef _WIN32
+   BOOL ret;
+   int flag;
+#endif
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_TCP_SERVER) {
+      *error = fixscript_create_error_string(heap, "invalid async TCP server handle");
+      return fixscript_int(0);
+   }
+   
+   if (handle->common.active) {
+      *error = fixscript_create_error_string(heap, "only one accept operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+#ifdef _WIN32
+   handle->accept_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+   if (handle->accept_socket == INVALID_SOCKET) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   flag = 1;
+   setsockopt(handle->accept_socket, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+#endif
+
+#ifdef USE_IO_URING
+   if (handle->common.proc->ring) {
+      if (!ring_add(handle->common.proc->ring, IORING_OP_ACCEPT, handle->common.fd, NULL, 0, handle, RING_OP_ACCEPT)) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+      handle->common.ring_pending++;
+   }
+#endif
+
+   handle->common.active = 1;
+   handle->callback = params[1];
+   handle->data = params[2];
+   fixscript_ref(heap, handle->data);
+
+#ifdef _WIN32
+   memset(&handle->overlapped, 0, sizeof(OVERLAPPED));
+   ret = AcceptEx(handle->common.socket, handle->accept_socket, handle->buf, 0, sizeof(struct sockaddr_in) + 16, sizeof(struct sockaddr_in) + 16, NULL, &handle->overlapped);
+   if (ret != 0 || WSAGetLastError() != ERROR_IO_PENDING) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#else
+   #ifdef USE_IO_URING
+   if (!handle->common.proc->ring)
+   #endif
+   update_poll_ctl(&handle->common);
+#endif
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_udp_socket_create(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   int local_only = data == (void *)1;
+   AsyncProcess *proc;
+   AsyncUDPHandle *handle;
+   Value retval;
+#if defined(_WIN32)
+   SOCKET sock;
+#else
+   int fd;
+#endif
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+#if defined(_WIN32)
+   if (!udp_create_socket(params[0].value, local_only, &sock))
+#else
+   if (!udp_create_socket(params[0].value, local_only, &fd))
+#endif
+   {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   handle = calloc(1, sizeof(AsyncUDPHandle));
+   if (!handle) {
+      #if defined(_WIN32)
+         closesocket(sock);
+      #else
+         close(fd);
+      #endif
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   handle->common.proc = proc;
+   async_process_ref(handle->common.proc);
+   handle->common.type = ASYNC_UDP_SOCKET;
+#if defined(_WIN32)
+   handle->common.socket = sock;
+   if (!CreateIoCompletionPort((HANDLE)handle->common.socket, proc->iocp, (ULONG_PTR)handle, 0)) {
+      async_process_unref(handle->common.proc);
+      closesocket(sock);
+      free(handle);
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#else
+   // the batched system calls are used directly even when io_uring is active:
+   handle->common.fd = fd;
+   if (!poll_add_socket(proc->poll, fd, handle, 0)) {
+      async_process_unref(handle->common.proc);
+      close(fd);
+      free(handle);
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+#endif
+
+   retval = fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, handle, free_async_handle);
+   if (!retval.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   return retval;
+#endif /* __wasm__ */
+}
+
+
+#ifndef __wasm__
+static AsyncUDPHandle *get_async_udp_handle(Heap *heap, Value *error, Value handle_val)
+{
+   AsyncUDPHandle *handle;
+
+   handle = fixscript_get_handle(heap, handle_val, HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_UDP_SOCKET) {
+      *error = fixscript_create_error_string(heap, "invalid async UDP socket handle");
+      return NULL;
+   }
+
+#if defined(_WIN32)
+   if (handle->common.socket == INVALID_SOCKET)
+#else
+   if (handle->common.fd == -1)
+#endif
+   {
+      *error = fixscript_create_error_string(heap, "UDP socket is already closed");
+      return NULL;
+   }
+   return handle;
+}
+#endif
+
+
+static Value native_async_udp_socket_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncUDPHandle *handle;
+
+   handle = get_async_udp_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   closesocket(handle->common.socket);
+   handle->common.socket = INVALID_SOCKET;
+#else
+   poll_remove_socket(handle->common.proc->poll, handle->common.fd);
+   close(handle->common.fd);
+   handle->common.fd = -1;
+#endif
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_udp_socket_get_port(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncUDPHandle *handle;
+   int port;
+
+   handle = get_async_udp_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+#if defined(_WIN32)
+   port = udp_get_port(handle->common.socket);
+#else
+   port = udp_get_port(handle->common.fd);
+#endif
+   if (port < 0) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+   return fixscript_int(port);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_udp_socket_receive(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncUDPHandle *handle;
+   int slot_size = params[2].value;
+#ifdef _WIN32
+   WSABUF wsabuf;
+   DWORD read;
+   char *new_buf;
+#endif
+
+   handle = get_async_udp_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   if (handle->common.active & ASYNC_READ) {
+      *error = fixscript_create_error_string(heap, "only one receive operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   if (udp_get_receive_count(heap, error, params[1], slot_size, params[3]) < 0) {
+      return fixscript_int(0);
+   }
+
+#ifdef _WIN32
+   // only a single datagram is received at once when using the IO completion port:
+   if (slot_size > handle->read_buf_size) {
+      new_buf = realloc(handle->read_buf, slot_size);
+      if (!new_buf) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      handle->read_buf = new_buf;
+      handle->read_buf_size = slot_size;
+   }
+#endif
+
+   handle->common.active |= ASYNC_READ;
+   handle->read_callback = params[4];
+   handle->read_data = params[5];
+   handle->read_array = params[1];
+   handle->read_msgs = params[3];
+   handle->slot_size = slot_size;
+   fixscript_ref(heap, handle->read_data);
+   fixscript_ref(heap, handle->read_array);
+   fixscript_ref(heap, handle->read_msgs);
+
+#ifdef _WIN32
+   memset(&handle->read_overlapped, 0, sizeof(WSAOVERLAPPED));
+
+   wsabuf.len = slot_size;
+   wsabuf.buf = handle->read_buf;
+   handle->read_flags = 0;
+   handle->read_addr_len = sizeof(handle->read_addr);
+   WSARecvFrom(handle->common.socket, &wsabuf, 1, &read, &handle->read_flags, (struct sockaddr *)&handle->read_addr, &handle->read_addr_len, &handle->read_overlapped, NULL);
+#else
+   update_poll_ctl(&handle->common);
+#endif
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_udp_socket_send(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncUDPHandle *handle;
+   int err, result;
+
+   handle = get_async_udp_handle(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one send operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   // the datagrams are sent right away (or as many as possible without blocking),
+   // the callback is called once the socket is ready for sending more:
+#if defined(_WIN32)
+   err = udp_send_arrays(heap, handle->common.socket, params[1], params[2], params[3].value, 1, &result);
+#else
+   err = udp_send_arrays(heap, handle->common.fd, params[1], params[2], params[3].value, 1, &result);
+#endif
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write_callback = params[4];
+   handle->write_data = params[5];
+   handle->write_result = result;
+   fixscript_ref(heap, handle->write_data);
+
+#ifdef _WIN32
+   memset(&handle->write_overlapped, 0, sizeof(WSAOVERLAPPED));
+   PostQueuedCompletionStatus(handle->common.proc->iocp, 0, (ULONG_PTR)handle, &handle->write_overlapped);
+#else
+   update_poll_ctl(&handle->common);
+#endif
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+#ifndef __wasm__
+static uint32_t get_time()
+{
+#if defined(_WIN32)
+   return timeGetTime();
+#elif defined(__APPLE__)
+   uint64_t time;
+   mach_timebase_info_data_t info;
+   time = mach_absolute_time();
+   mach_timebase_info(&info);
+   return time * info.numer / info.denom / 1000000;
+#else
+   struct timespec ts;
+   if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
+      return 0;
+   }
+   return ((uint64_t)ts.tv_sec) * 1000 + ((uint64_t)ts.tv_nsec / 1000000L);
+#endif
+}
+#endif
+
+
+#ifndef __wasm__
+static void wait_events(AsyncProcess *proc, int timeout)
+{
+   int timer_timeout;
+#ifdef _WIN32
+   CompletedIO *cio;
+#endif
+
+   pthread_mutex_lock(&proc->mutex);
+   timer_timeout = timer_wheel_get_timeout(&proc->timers, get_time());
+   if (timer_timeout >= 0 && (timeout < 0 || timer_timeout < timeout)) {
+      timeout = timer_timeout;
+   }
+   pthread_mutex_unlock(&proc->mutex);
+
+#if defined(_WIN32)
+   if (timeout < 0) {
+      timeout = INFINITE;
+   }
+   proc->num_events = 0;
+   cio = &proc->completed_ios[0];
+
+   while (proc->num_events < sizeof(proc->completed_ios)/sizeof(CompletedIO)) {
+      GetQueuedCompletionStatus(proc->iocp, &cio->transferred, &cio->key, (OVERLAPPED **)&cio->overlapped, timeout);
+      if (!cio->overlapped) break;
+
+      cio = &proc->completed_ios[++proc->num_events];
+      timeout = 0;
+   }
+#elif defined(__wasm__)
+#else
+   if (timeout < 0) {
+      timeout = -1;
+   }
+   #ifdef USE_IO_URING
+   if (proc->ring) {
+      ring_wait(proc->ring, timeout);
+      return;
+   }
+   #endif
+   poll_wait(proc->poll, timeout);
+#endif
+}
+#endif
+
+
+#ifdef USE_IO_URING
+static void ring_process_events(AsyncProcess *proc, Heap *heap)
+{
+   AsyncHandle *handle, *new_handle;
+   AsyncServerHandle *server_handle;
+   Value callback, data, result, callback_error;
+   void *ptr;
+   int op, res, fd, flag;
+
+   while (ring_get_event(proc->ring, &ptr, &op, &res)) {
+      if (op == RING_OP_POLL) {
+         poll_wait(proc->poll, 0);
+         ring_add(proc->ring, IORING_OP_POLL_ADD, proc->poll->epoll_fd, NULL, 0, NULL, RING_OP_POLL);
+         continue;
+      }
+      if (op == RING_OP_CANCEL) {
+         continue;
+      }
+
+      handle = ptr;
+      if (handle->common.ring_freed) {
+         ring_complete_freed(proc, heap, &handle->common, op, res);
+         continue;
+      }
+
+      if (handle->common.type == ASYNC_TCP_CONNECTION) {
+         handle->common.ring_pending--;
+
+         if (op == RING_OP_READ && (handle->common.active & ASYNC_READ) && handle->read.fd_passing) {
+            callback = handle->read.callback;
+            data = handle->read.data;
+            handle->common.active &= ~ASYNC_READ;
+            handle->read.fd_passing = 0;
+
+            result = fixscript_int(0);
+            fd = res > 0? fd_message_get_fd((FDMessage *)handle->read.ring_buf) : -1;
+            if (fd != -1 && handle->common.fd == -1) {
+               close(fd);
+            }
+            else if (fd != -1) {
+               result = create_async_connection(heap, proc, fd);
+            }
+
+            if (handle->common.fd != -1) {
+               fixscript_call(heap, callback, 2, &callback_error, data, result);
+               if (callback_error.value) {
+                  fixscript_dump_value(heap, callback_error, 1);
+               }
+            }
+            fixscript_unref(heap, data);
+         }
+         else if (op == RING_OP_READ && (handle->common.active & ASYNC_READ)) {
+            callback = handle->read.callback;
+            data = handle->read.data;
+            handle->common.active &= ~ASYNC_READ;
+
+            if (res < 0) {
+               res = -1;
+            }
+            if (res > 0 && fixscript_set_array_bytes(heap, handle->read.array, handle->read.off, res, handle->read.ring_buf) != 0) {
+               res = -1;
+            }
+            fixscript_unref(heap, handle->read.array);
+
+            if (handle->common.fd != -1) {
+               fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(res));
+               if (callback_error.value) {
+                  fixscript_dump_value(heap, callback_error, 1);
+               }
+            }
+            fixscript_unref(heap, data);
+         }
+         else if (op == RING_OP_WRITE && (handle->common.active & ASYNC_WRITE)) {
+            callback = handle->write.callback;
+            data = handle->write.data;
+            handle->common.active &= ~ASYNC_WRITE;
+
+            if (handle->common.fd != -1) {
+               fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(res < 0? -1 : res));
+               if (callback_error.value) {
+                  fixscript_dump_value(heap, callback_error, 1);
+               }
+            }
+            fixscript_unref(heap, data);
+         }
+      }
+      else if (handle->common.type == ASYNC_TCP_SERVER) {
+         server_handle = ptr;
+         server_handle->common.ring_pending--;
+         if (op != RING_OP_ACCEPT || !server_handle->common.active) {
+            continue;
+         }
+
+         result = fixscript_int(0);
+         fd = res;
+         if (fd >= 0 && server_handle->common.fd == -1) {
+            close(fd);
+         }
+         else if (fd >= 0) {
+            flag = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+
+            new_handle = calloc(1, sizeof(AsyncHandle));
+            if (!new_handle) {
+               close(fd);
+            }
+            else {
+               new_handle->common.proc = proc;
+               async_process_ref(new_handle->common.proc);
+               new_handle->common.type = ASYNC_TCP_CONNECTION;
+               new_handle->common.fd = fd;
+               result = fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, new_handle, free_async_handle);
+            }
+         }
+
+         callback = server_handle->callback;
+         data = server_handle->data;
+         server_handle->common.active = 0;
+
+         if (server_handle->common.fd != -1) {
+            fixscript_call(heap, callback, 2, &callback_error, data, result);
+            if (callback_error.value) {
+               fixscript_dump_value(heap, callback_error, 1);
+            }
+         }
+         fixscript_unref(heap, data);
+      }
+   }
+}
+#endif
+
+
+#ifndef __wasm__
+static void async_file_close_handle(FileHandle *file)
+{
+#if defined(_WIN32)
+   CloseHandle(file->handle);
+#else
+   close(file->fd);
+#endif
+}
+
+
+static void async_file_run_op(AsyncFileOp *op)
+{
+   FileHandle *file;
+#if defined(_WIN32)
+   OVERLAPPED overlapped;
+   DWORD transferred;
+#else
+   ssize_t ret;
+#endif
+   int pos;
+
+   switch (op->type) {
+      case FILE_OP_OPEN:
+         file = calloc(1, sizeof(FileHandle));
+         if (!file) break;
+         file->refcnt = 1;
+         file->mode = op->mode;
+         if (!open_file_handle(file, op->fname, op->mode)) {
+            free(file);
+            break;
+         }
+         op->file = file;
+         break;
+
+      case FILE_OP_READ:
+         #if defined(_WIN32)
+            memset(&overlapped, 0, sizeof(OVERLAPPED));
+            overlapped.Offset = (DWORD)op->pos;
+            overlapped.OffsetHigh = (DWORD)(op->pos >> 32);
+            if (ReadFile(op->file->handle, op->buf, op->len, &transferred, &overlapped)) {
+               op->result = transferred;
+            }
+            else {
+               op->result = GetLastError() == ERROR_HANDLE_EOF? 0 : -1;
+            }
+         #else
+            ret = pread(op->file->fd, op->buf, op->len, op->pos);
+            op->result = ret < 0? -1 : ret;
+            #ifdef POSIX_FADV_WILLNEED
+            if (op->result > 0 && op->read_ahead > 0) {
+               // hint the kernel to start reading of the following data in the background:
+               posix_fadvise(op->file->fd, op->pos + op->result, op->read_ahead, POSIX_FADV_WILLNEED);
+            }
+            #endif
+         #endif
+         break;
+
+      case FILE_OP_WRITE:
+         pos = 0;
+         while (pos < op->len) {
+            #if defined(_WIN32)
+               memset(&overlapped, 0, sizeof(OVERLAPPED));
+               if (op->file->mode & SCRIPT_FILE_APPEND) {
+                  overlapped.Offset = 0xFFFFFFFF;
+                  overlapped.OffsetHigh = 0xFFFFFFFF;
+               }
+               else {
+                  overlapped.Offset = (DWORD)(op->pos + pos);
+                  overlapped.OffsetHigh = (DWORD)((op->pos + pos) >> 32);
+               }
+               if (!WriteFile(op->file->handle, op->buf + pos, op->len - pos, &transferred, &overlapped)) {
+                  break;
+               }
+               pos += transferred;
+            #else
+               ret = pwrite(op->file->fd, op->buf + pos, op->len - pos, op->pos + pos);
+               if (ret < 0 && errno == EINTR) continue;
+               if (ret <= 0) break;
+               pos += ret;
+            #endif
+         }
+         op->result = pos < op->len? -1 : pos;
+         break;
+
+      case FILE_OP_SYNC:
+         #if defined(_WIN32)
+            op->result = FlushFileBuffers(op->file->handle)? 0 : -1;
+         #else
+            op->result = fsync(op->file->fd) == 0? 0 : -1;
+         #endif
+         break;
+   }
+}
+
+
+static void async_file_func(void *data)
+{
+   AsyncFileOp *op = data, *next;
+   AsyncProcess *proc = op->proc;
+   AsyncThreadResult *atr;
+
+   // the thread processes the queued operations until there is none left:
+   while (op) {
+      async_file_run_op(op);
+
+      if (op->type != FILE_OP_OPEN) {
+         if (__sync_sub_and_fetch(&op->file->async_ops, 1) == ASYNC_FILE_CLOSING) {
+            async_file_close_handle(op->file);
+         }
+      }
+
+      atr = op->atr;
+      op->atr = NULL;
+      atr->type = ASYNC_FILE;
+      atr->callback = op->callback;
+      atr->data = op->data;
+      atr->file_op = op;
+
+      pthread_mutex_lock(&proc->mutex);
+      atr->next = proc->thread_results;
+      proc->thread_results = atr;
+      next = proc->file_ops_first;
+      if (next) {
+         proc->file_ops_first = next->next;
+         if (!proc->file_ops_first) {
+            proc->file_ops_last = NULL;
+         }
+      }
+      else {
+         proc->file_ops_active--;
+      }
+      async_process_notify(proc);
+      pthread_mutex_unlock(&proc->mutex);
+
+      async_process_unref(proc);
+      op = next;
+   }
+}
+
+
+static int async_file_submit(Heap *heap, Value *error, AsyncProcess *proc, AsyncFileOp *op)
+{
+   int run = 0;
+
+   op->atr = calloc(1, sizeof(AsyncThreadResult));
+   if (!op->atr) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      return 0;
+   }
+
+   op->proc = proc;
+   async_process_ref(proc);
+   if (op->file) {
+      __sync_add_and_fetch(&op->file->refcnt, 1);
+      __sync_add_and_fetch(&op->file->async_ops, 1);
+   }
+   fixscript_ref(heap, op->data);
+   if (op->type == FILE_OP_READ) {
+      fixscript_ref(heap, op->array);
+   }
+
+   pthread_mutex_lock(&proc->mutex);
+   if (proc->file_ops_active < proc->file_ops_max) {
+      proc->file_ops_active++;
+      run = 1;
+   }
+   else {
+      if (proc->file_ops_last) {
+         proc->file_ops_last->next = op;
+      }
+      else {
+         proc->file_ops_first = op;
+      }
+      proc->file_ops_last = op;
+   }
+   pthread_mutex_unlock(&proc->mutex);
+
+   if (run && !async_run_thread(async_file_func, op)) {
+      pthread_mutex_lock(&proc->mutex);
+      proc->file_ops_active--;
+      pthread_mutex_unlock(&proc->mutex);
+
+      if (op->file) {
+         // the reference to the file is released by the caller when freeing the operation:
+         __sync_sub_and_fetch(&op->file->async_ops, 1);
+      }
+      if (op->type == FILE_OP_READ) {
+         fixscript_unref(heap, op->array);
+      }
+      fixscript_unref(heap, op->data);
+      async_process_unref(proc);
+      free(op->atr);
+      op->atr = NULL;
+      *error = fixscript_create_error_string(heap, "can't create thread");
+      return 0;
+   }
+   return 1;
+}
+
+
+static FileHandle *async_file_get_handle(Heap *heap, Value *error, Value file_val, int required_mode)
+{
+   FileHandle *file;
+
+   file = get_file_handle(heap, error, file_val);
+   if (!file) {
+      return NULL;
+   }
+
+   if ((file->mode & required_mode) != required_mode) {
+      *error = fixscript_create_error_string(heap, required_mode == SCRIPT_FILE_READ? "file not opened for reading" : "file not opened for writing");
+      return NULL;
+   }
+   return file;
+}
+#endif /* __wasm__ */
+
+
+static Value native_async_file_open(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   AsyncFileOp *op;
+   const char *msg;
+   int mode = fixscript_get_int(params[1]);
+   int err;
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   msg = get_file_mode_error(mode);
+   if (msg) {
+      *error = fixscript_create_error_string(heap, msg);
+      return fixscript_int(0);
+   }
+
+   op = calloc(1, sizeof(AsyncFileOp));
+   if (!op) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+#if defined(_WIN32)
+   err = fixscript_get_string_utf16(heap, params[0], 0, -1, &op->fname, NULL);
+#else
+   err = fixscript_get_string(heap, params[0], 0, -1, &op->fname, NULL);
+#endif
+   if (err) {
+      free(op);
+      return fixscript_error(heap, error, err);
+   }
+
+   op->type = FILE_OP_OPEN;
+   op->mode = mode;
+   op->callback = params[2];
+   op->data = params[3];
+
+   if (!async_file_submit(heap, error, proc, op)) {
+      free_async_file_op(op);
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_file_read_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   AsyncFileOp *op;
+   FileHandle *file;
+   int write = (data != NULL);
+   int off = params[2].value;
+   int len = params[3].value;
+   int err, arr_len;
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   file = async_file_get_handle(heap, error, params[0], write? SCRIPT_FILE_WRITE : SCRIPT_FILE_READ);
+   if (!file) {
+      return fixscript_int(0);
+   }
+
+   // check the bounds early so the error is reported to the caller:
+   err = fixscript_get_array_length(heap, params[1], &arr_len);
+   if (!err && (off < 0 || len < 0 || (int64_t)off + (int64_t)len > (int64_t)arr_len)) {
+      err = FIXSCRIPT_ERR_OUT_OF_BOUNDS;
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   op = calloc(1, sizeof(AsyncFileOp));
+   if (!op) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   op->buf = malloc(len > 0? len : 1);
+   if (!op->buf) {
+      free_async_file_op(op);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   if (write) {
+      err = fixscript_get_array_bytes(heap, params[1], off, len, op->buf);
+      if (err) {
+         free_async_file_op(op);
+         return fixscript_error(heap, error, err);
+      }
+   }
+
+   op->type = write? FILE_OP_WRITE : FILE_OP_READ;
+   op->file = file;
+   op->pos = ((uint32_t)params[4].value) | (((uint64_t)params[5].value) << 32);
+   op->len = len;
+   op->array = params[1];
+   op->off = off;
+   if (write) {
+      op->callback = params[6];
+      op->data = params[7];
+   }
+   else {
+      op->read_ahead = params[6].value;
+      op->callback = params[7];
+      op->data = params[8];
+   }
+
+   if (!async_file_submit(heap, error, proc, op)) {
+      free_async_file_op(op);
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_file_sync(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   AsyncFileOp *op;
+   FileHandle *file;
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   file = async_file_get_handle(heap, error, params[0], 0);
+   if (!file) {
+      return fixscript_int(0);
+   }
+
+   op = calloc(1, sizeof(AsyncFileOp));
+   if (!op) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   op->type = FILE_OP_SYNC;
+   op->file = file;
+   op->callback = params[1];
+   op->data = params[2];
+
+   if (!async_file_submit(heap, error, proc, op)) {
+      free_async_file_op(op);
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_file_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   FileHandle *file;
+
+   file = get_file_handle(heap, error, params[0]);
+   if (!file) {
+      return fixscript_int(0);
+   }
+
+   // the file is closed once all pending operations are finished:
+   file->closed = 1;
+   if (__sync_add_and_fetch(&file->async_ops, ASYNC_FILE_CLOSING) == ASYNC_FILE_CLOSING) {
+      async_file_close_handle(file);
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_file_set_concurrency(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   AsyncFileOp *op;
+   int value = params[0].value;
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   if (value < 1) {
+      *error = fixscript_create_error_string(heap, "concurrency must be at least 1");
+      return fixscript_int(0);
+   }
+
+   pthread_mutex_lock(&proc->mutex);
+   proc->file_ops_max = value;
+   pthread_mutex_unlock(&proc->mutex);
+
+   // start additional threads for the already queued operations:
+   for (;;) {
+      pthread_mutex_lock(&proc->mutex);
+      op = proc->file_ops_first;
+      if (!op || proc->file_ops_active >= proc->file_ops_max) {
+         pthread_mutex_unlock(&proc->mutex);
+         break;
+      }
+      proc->file_ops_first = op->next;
+      if (!proc->file_ops_first) {
+         proc->file_ops_last = NULL;
+      }
+      op->next = NULL;
+      proc->file_ops_active++;
+      pthread_mutex_unlock(&proc->mutex);
+
+      if (!async_run_thread(async_file_func, op)) {
+         // put it back, it will be processed by one of the already running threads:
+         pthread_mutex_lock(&proc->mutex);
+         proc->file_ops_active--;
+         op->next = proc->file_ops_first;
+         proc->file_ops_first = op;
+         if (!proc->file_ops_last) {
+            proc->file_ops_last = op;
+         }
+         pthread_mutex_unlock(&proc->mutex);
+         break;
+      }
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+#ifndef __wasm__
+enum {
+   DIR_ERR_NOT_FOUND     = -1,
+   DIR_ERR_NOT_DIRECTORY = -2,
+   DIR_ERR_ACCESS_DENIED = -3,
+   DIR_ERR_IO            = -4,
+   DIR_ERR_OUT_OF_MEMORY = -5
+};
+
+#define DIR_ENTRY_SIZE     6
+#define WALK_BATCH_SIZE    256
+#define WALK_MAX_BATCHES   16
+#define WALK_MAX_THREADS   64
+
+#if defined(_WIN32)
+typedef uint16_t DirChar;
+#define DIR_SEPARATOR '\\'
+#else
+typedef char DirChar;
+#define DIR_SEPARATOR '/'
+#endif
+
+typedef struct {
+#if defined(_WIN32)
+   HANDLE handle;
+   WIN32_FIND_DATA fd;
+   int pending;
+#else
+   DIR *dir;
+#endif
+} DirReader;
+
+typedef struct {
+   const DirChar *name;
+   int type;
+   int64_t length;
+   int64_t mtime;
+   int recurse;
+} DirEntry;
+
+typedef struct {
+   DirReader reader;
+   int open;
+} DirectoryHandle;
+
+typedef struct WalkDir {
+   DirChar *rel;
+   struct WalkDir *next;
+} WalkDir;
+
+typedef struct {
+   int name_off;
+   int type;
+   int64_t length;
+   int64_t mtime;
+} WalkEntry;
+
+typedef struct WalkBatch {
+   DirChar *rel;
+   DirChar *names;
+   int names_len, names_cap;
+   WalkEntry entries[WALK_BATCH_SIZE];
+   int cnt;
+   struct WalkBatch *next;
+} WalkBatch;
+
+typedef struct {
+   pthread_mutex_t mutex;
+   pthread_cond_t work_cond;
+   pthread_cond_t space_cond;
+   pthread_cond_t result_cond;
+   DirChar *root;
+   WalkDir *dirs_first, *dirs_last;
+   WalkBatch *batches_first, *batches_last;
+   int num_batches;
+   int num_busy;
+   int num_threads;
+   int cancel;
+   int error;
+   DirChar *error_path;
+} PathWalk;
+
+
+static int dir_strlen(const DirChar *s)
+{
+#if defined(_WIN32)
+   return wcslen(s);
 #else
-      if (pthread_create(&handle, NULL, thread_main, thread) != 0) {
-         pthread_cond_destroy(&thread->cond);
-         pthread_mutex_destroy(&thread->mutex);
-         free(thread);
-         pthread_mutex_unlock(mutex);
-         return 0;
-      }
-      pthread_detach(handle);
+   return strlen(s);
 #endif
-   }
+}
 
-   pthread_mutex_unlock(mutex);
-   
-   pthread_mutex_lock(&thread->mutex);
-   thread->func = func;
-   thread->data = data;
-   pthread_cond_signal(&thread->cond);
-   pthread_mutex_unlock(&thread->mutex);
-   return 1;
+
+static DirChar *dir_strdup(const DirChar *s)
+{
+   DirChar *copy;
+   int len = dir_strlen(s)+1;
+
+   copy = malloc(len*sizeof(DirChar));
+   if (!copy) return NULL;
+
+   memcpy(copy, s, len*sizeof(DirChar));
+   return copy;
 }
-#endif
 
 
-#ifndef __wasm__
-static void free_async_handle(void *data)
+static DirChar *dir_join(const DirChar *parent, const DirChar *name)
 {
-   AsyncHandle *handle = data;
-#if !defined(_WIN32) && !defined(__wasm__)
-   AsyncProcess *proc = handle->proc;
-#endif
+   DirChar *s;
+   int len1, len2, sep;
 
-#if !defined(_WIN32) && !defined(__wasm__)
-   poll_remove_socket(proc->poll, handle->fd);
-#endif
-   async_process_unref(handle->proc);
+   len1 = dir_strlen(parent);
+   len2 = dir_strlen(name);
+   sep = (len1 > 0 && len2 > 0 && parent[len1-1] != DIR_SEPARATOR && parent[len1-1] != '/');
 
-   if (handle->type == ASYNC_TCP_CONNECTION || handle->type == ASYNC_TCP_SERVER) {
-      #if defined(_WIN32)
-      if (handle->type == ASYNC_TCP_SERVER) {
-         closesocket(((AsyncServerHandle *)handle)->accept_socket);
-      }
-      closesocket(handle->socket);
-      #elif defined(__wasm__)
-      #else
-      close(handle->fd);
-      #endif
+   s = malloc((len1+sep+len2+1)*sizeof(DirChar));
+   if (!s) return NULL;
+
+   memcpy(s, parent, len1*sizeof(DirChar));
+   if (sep) {
+      s[len1] = DIR_SEPARATOR;
    }
-   free(handle);
+   memcpy(s+len1+sep, name, (len2+1)*sizeof(DirChar));
+   return s;
 }
-#endif
 
 
-#if !defined(_WIN32) && !defined(__wasm__)
-static void update_poll_ctl(AsyncHandle *handle)
+static int dir_reader_open(DirReader *reader, const DirChar *path)
 {
-   AsyncServerHandle *server_handle;
+#if defined(_WIN32)
+   uint16_t *pattern;
+   int err;
 
-   if (handle->type == ASYNC_TCP_CONNECTION) {
-      if (handle->active != handle->last_active) {
-         poll_update_socket(handle->proc->poll, handle->fd, handle, handle->active);
-         handle->last_active = handle->active;
+   pattern = dir_join(path, L"*");
+   if (!pattern) {
+      return DIR_ERR_OUT_OF_MEMORY;
+   }
+
+   reader->handle = FindFirstFile(pattern, &reader->fd);
+   free(pattern);
+   if (reader->handle == INVALID_HANDLE_VALUE) {
+      err = GetLastError();
+      if (err == ERROR_PATH_NOT_FOUND || err == ERROR_FILE_NOT_FOUND) {
+         return DIR_ERR_NOT_FOUND;
+      }
+      if (err == ERROR_DIRECTORY) {
+         return DIR_ERR_NOT_DIRECTORY;
       }
+      if (err == ERROR_ACCESS_DENIED) {
+         return DIR_ERR_ACCESS_DENIED;
+      }
+      return DIR_ERR_IO;
    }
-   else if (handle->type == ASYNC_TCP_SERVER) {
-      server_handle = (AsyncServerHandle *)handle;
-      if (server_handle->active != server_handle->last_active) {
-         poll_update_socket(server_handle->proc->poll, server_handle->fd, server_handle, server_handle->active? ASYNC_READ : 0);
-         server_handle->last_active = server_handle->active;
+   reader->pending = 1;
+   return 0;
+#else
+   reader->dir = opendir(path);
+   if (!reader->dir) {
+      if (errno == ENOENT) {
+         return DIR_ERR_NOT_FOUND;
+      }
+      if (errno == ENOTDIR) {
+         return DIR_ERR_NOT_DIRECTORY;
+      }
+      if (errno == EACCES) {
+         return DIR_ERR_ACCESS_DENIED;
       }
+      return DIR_ERR_IO;
    }
-}
+   return 0;
 #endif
+}
 
 
-#ifndef __wasm__
-typedef struct {
-   AsyncProcess *proc;
-   char *hostname;
-   int port;
-   Value callback;
-   Value data;
-   AsyncThreadResult *atr;
-} TCPOpenData;
-
-static void tcp_open_func(void *data)
+// returns 1 when an entry was read, 0 at the end of the directory or negative error code,
+// the name is valid only until the next call:
+static int dir_reader_next(DirReader *reader, DirEntry *entry)
 {
-   TCPOpenData *tod = data;
-   AsyncProcess *proc = tod->proc;
-   AsyncThreadResult *atr = tod->atr;
 #if defined(_WIN32)
-   u_long arg;
-#else
-   int flags;
-#endif
+   WIN32_FIND_DATA *fd = &reader->fd;
+   int64_t time;
 
-   atr->type = ASYNC_TCP_CONNECTION;
-   atr->callback = tod->callback;
-   atr->data = tod->data;
+   for (;;) {
+      if (!reader->pending) {
+         if (!FindNextFile(reader->handle, fd)) {
+            return GetLastError() == ERROR_NO_MORE_FILES? 0 : DIR_ERR_IO;
+         }
+      }
+      reader->pending = 0;
 
-#if defined(_WIN32)
-   if (tcp_connect(tod->hostname, tod->port, &atr->socket, 1)) {
-      arg = 1;
-      if (ioctlsocket(atr->socket, FIONBIO, &arg) != 0) {
-         closesocket(atr->socket);
-         atr->socket = INVALID_SOCKET;
+      if (fd->cFileName[0] == '.') {
+         if (fd->cFileName[1] == 0) continue;
+         if (fd->cFileName[1] == '.' && fd->cFileName[2] == 0) continue;
       }
-   }
-   else {
-      atr->socket = INVALID_SOCKET;
+
+      entry->name = fd->cFileName;
+      entry->length = 0;
+      if (fd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+         entry->type = TYPE_DIRECTORY;
+      }
+      else if (fd->dwFileAttributes & FILE_ATTRIBUTE_DEVICE) {
+         entry->type = TYPE_SPECIAL;
+      }
+      else {
+         entry->type = TYPE_FILE;
+         entry->length = (((uint64_t)fd->nFileSizeHigh) << 32) | ((uint32_t)fd->nFileSizeLow);
+      }
+      time = (((uint64_t)fd->ftLastWriteTime.dwHighDateTime) << 32) | ((uint32_t)fd->ftLastWriteTime.dwLowDateTime);
+      entry->mtime = time / 10000000LL - 11644473600LL;
+      entry->recurse = (entry->type == TYPE_DIRECTORY && (fd->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) == 0);
+      return 1;
    }
 #else
-   if (tcp_connect(tod->hostname, tod->port, &atr->fd)) {
-      flags = fcntl(atr->fd, F_GETFL);
-      if (flags != -1) {
-         flags |= O_NONBLOCK;
-         if (fcntl(atr->fd, F_SETFL, flags) == -1) {
-            close(atr->fd);
-            atr->fd = -1;
+   struct dirent *ent;
+   struct stat st, st2;
+
+   for (;;) {
+      errno = 0;
+      ent = readdir(reader->dir);
+      if (!ent) {
+         return errno? DIR_ERR_IO : 0;
+      }
+
+      if (ent->d_name[0] == '.') {
+         if (ent->d_name[1] == 0) continue;
+         if (ent->d_name[1] == '.' && ent->d_name[2] == 0) continue;
+      }
+
+      if (fstatat(dirfd(reader->dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+         if (errno == ENOENT) {
+            // removed in the meantime
+            continue;
+         }
+         return errno == EACCES? DIR_ERR_ACCESS_DENIED : DIR_ERR_IO;
+      }
+
+      entry->name = ent->d_name;
+      entry->type = 0;
+      entry->length = 0;
+      entry->mtime = st.st_mtime;
+      entry->recurse = 0;
+
+      if (S_ISLNK(st.st_mode)) {
+         if (fstatat(dirfd(reader->dir), ent->d_name, &st2, 0) != 0) {
+            entry->type = TYPE_SPECIAL | TYPE_SYMLINK;
+            return 1;
          }
+         st = st2;
+         entry->type = TYPE_SYMLINK;
+         entry->mtime = st.st_mtime;
+      }
+
+      if (S_ISDIR(st.st_mode)) {
+         entry->type |= TYPE_DIRECTORY;
+         entry->recurse = (entry->type == TYPE_DIRECTORY);
+      }
+      else if (S_ISREG(st.st_mode)) {
+         entry->type |= TYPE_FILE;
+         entry->length = st.st_size;
       }
       else {
-         close(atr->fd);
-         atr->fd = -1;
+         entry->type |= TYPE_SPECIAL;
       }
-   }
-   else {
-      atr->fd = -1;
+      return 1;
    }
 #endif
+}
 
-   pthread_mutex_lock(&proc->mutex);
-   atr->next = proc->thread_results;
-   proc->thread_results = atr;
-   async_process_notify(proc);
-   pthread_mutex_unlock(&proc->mutex);
 
-   async_process_unref(tod->proc);
-   free(tod->hostname);
-   free(tod);
+static void dir_reader_close(DirReader *reader)
+{
+#if defined(_WIN32)
+   FindClose(reader->handle);
+#else
+   closedir(reader->dir);
+#endif
 }
-#endif /* __wasm__ */
 
-static Value native_async_tcp_connection_open(Heap *heap, Value *error, int num_params, Value *params, void *data)
+
+static Value create_dir_string(Heap *heap, const DirChar *s)
 {
-#if defined(__wasm__)
-   *error = fixscript_create_error_string(heap, "not supported");
-   return fixscript_int(0);
+#if defined(_WIN32)
+   return fixscript_create_string_utf16(heap, s, -1);
 #else
-   AsyncProcess *proc;
-   TCPOpenData *tod;
-   int err;
-   
-   proc = get_async_process(heap, error);
-   if (!proc) return fixscript_int(0);
-
-   tod = calloc(1, sizeof(TCPOpenData));
-   if (!tod) {
-      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
-   }
-   
-   tod->atr = calloc(1, sizeof(AsyncThreadResult));
-   if (!tod->atr) {
-      free(tod);
-      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
-   }
+   return fixscript_create_string(heap, s, -1);
+#endif
+}
 
-   err = fixscript_get_string(heap, params[0], 0, -1, &tod->hostname, NULL);
-   if (err) {
-      free(tod->atr);
-      free(tod);
-      return fixscript_error(heap, error, err);
-   }
 
-   tod->proc = proc;
-   tod->port = fixscript_get_int(params[1]);
-   tod->callback = params[2];
-   tod->data = params[3];
-   async_process_ref(proc);
-   fixscript_ref(heap, tod->data);
+static Value create_dir_error(Heap *heap, Value *error, int err, const DirChar *path)
+{
+#if defined(_WIN32)
+   uint16_t buf[256];
 
-   if (!async_run_thread(tcp_open_func, tod)) {
-      async_process_unref(proc);
-      fixscript_unref(heap, tod->data);
-      free(tod->hostname);
-      free(tod->atr);
-      free(tod);
-      *error = fixscript_create_error_string(heap, "can't create thread");
-      return fixscript_int(0);
+   switch (err) {
+      case DIR_ERR_NOT_FOUND:
+         snwprintf(buf, sizeof(buf)/sizeof(uint16_t)-1, L"path '%s' does not exist", path);
+         break;
+      case DIR_ERR_NOT_DIRECTORY:
+         snwprintf(buf, sizeof(buf)/sizeof(uint16_t)-1, L"path '%s' is not a directory", path);
+         break;
+      case DIR_ERR_ACCESS_DENIED:
+         snwprintf(buf, sizeof(buf)/sizeof(uint16_t)-1, L"access denied to '%s'", path);
+         break;
+      case DIR_ERR_OUT_OF_MEMORY:
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      default:
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
    }
+   buf[sizeof(buf)/sizeof(uint16_t)-1] = 0;
+   *error = fixscript_create_error(heap, fixscript_create_string_utf16(heap, buf, -1));
+#else
+   char buf[256];
 
+   switch (err) {
+      case DIR_ERR_NOT_FOUND:
+         snprintf(buf, sizeof(buf), "path '%s' does not exist", path);
+         break;
+      case DIR_ERR_NOT_DIRECTORY:
+         snprintf(buf, sizeof(buf), "path '%s' is not a directory", path);
+         break;
+      case DIR_ERR_ACCESS_DENIED:
+         snprintf(buf, sizeof(buf), "access denied to '%s'", path);
+         break;
+      case DIR_ERR_OUT_OF_MEMORY:
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      default:
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+   }
+   *error = fixscript_create_error_string(heap, buf);
+#endif
    return fixscript_int(0);
-#endif /* __wasm__ */
 }
 
 
-static Value native_async_tcp_connection_read(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static void free_directory_handle(void *data)
 {
-#if defined(__wasm__)
-   *error = fixscript_create_error_string(heap, "not supported");
-   return fixscript_int(0);
-#else
-   AsyncHandle *handle;
-#ifdef _WIN32
-   WSABUF wsabuf;
-   DWORD flags;
-   DWORD read;
-#endif
+   DirectoryHandle *handle = data;
 
-   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
-   if (!handle || handle->type != ASYNC_TCP_CONNECTION) {
-      *error = fixscript_create_error_string(heap, "invalid async stream handle");
-      return fixscript_int(0);
-   }
-   
-   if (handle->active & ASYNC_READ) {
-      *error = fixscript_create_error_string(heap, "only one read operation can be active at a time");
-      return fixscript_int(0);
+   if (handle->open) {
+      dir_reader_close(&handle->reader);
    }
+   free(handle);
+}
 
-#ifdef _WIN32
-   if (params[3].value > sizeof(handle->read.buf)) {
-      params[3].value = sizeof(handle->read.buf);
-   }
-   if (params[3].value < 0) {
-      *error = fixscript_create_error_string(heap, "negative length");
-      return fixscript_int(0);
-   }
-#endif
 
-   handle->active |= ASYNC_READ;
-   handle->read.callback = params[4];
-   handle->read.data = params[5];
-   handle->read.array = params[1];
-   handle->read.off = params[2].value;
-   handle->read.len = params[3].value;
-   fixscript_ref(heap, handle->read.data);
-   fixscript_ref(heap, handle->read.array);
+static int walk_add_name(WalkBatch *batch, const DirChar *name)
+{
+   DirChar *new_names;
+   int len, new_cap;
 
-#ifdef _WIN32
-   memset(&handle->read.overlapped, 0, sizeof(WSAOVERLAPPED));
+   len = dir_strlen(name)+1;
+   if (batch->names_len + len > batch->names_cap) {
+      new_cap = batch->names_cap? batch->names_cap : 4096;
+      while (batch->names_len + len > new_cap) {
+         new_cap *= 2;
+      }
+      new_names = realloc(batch->names, new_cap*sizeof(DirChar));
+      if (!new_names) {
+         return 0;
+      }
+      batch->names = new_names;
+      batch->names_cap = new_cap;
+   }
 
-   wsabuf.len = params[3].value;
-   wsabuf.buf = handle->read.buf;
-   flags = 0;
-   WSARecv(handle->socket, &wsabuf, 1, &read, &flags, &handle->read.overlapped, NULL);
-#else
-   update_poll_ctl(handle);
-#endif
+   memcpy(batch->names + batch->names_len, name, len*sizeof(DirChar));
+   batch->names_len += len;
+   return 1;
+}
 
-   return fixscript_int(0);
-#endif /* __wasm__ */
+
+static void free_walk_batch(WalkBatch *batch)
+{
+   free(batch->rel);
+   free(batch->names);
+   free(batch);
 }
 
 
-#if defined(_WIN32)
-static Value native_async_tcp_connection_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static void free_walk_dirs(WalkDir *dir)
 {
-   AsyncHandle *handle;
-   WSABUF wsabuf;
-   DWORD written;
-   int err;
+   WalkDir *next;
 
-   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
-   if (!handle || handle->type != ASYNC_TCP_CONNECTION) {
-      *error = fixscript_create_error_string(heap, "invalid async stream handle");
-      return fixscript_int(0);
+   while (dir) {
+      next = dir->next;
+      free(dir->rel);
+      free(dir);
+      dir = next;
    }
-   
-   if (handle->active & ASYNC_WRITE) {
-      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
-      return fixscript_int(0);
+}
+
+
+// passes the batch (if any) together with the found subdirectories to the calling thread,
+// returns 0 when the walk was cancelled:
+static int walk_flush(PathWalk *walk, WalkBatch *batch, WalkDir *dirs_first, WalkDir *dirs_last)
+{
+   pthread_mutex_lock(&walk->mutex);
+   while (!walk->cancel && batch && walk->num_batches >= WALK_MAX_BATCHES) {
+      pthread_cond_wait(&walk->space_cond, &walk->mutex);
+   }
+   if (walk->cancel) {
+      pthread_cond_signal(&walk->space_cond);
+      pthread_mutex_unlock(&walk->mutex);
+      if (batch) {
+         free_walk_batch(batch);
+      }
+      free_walk_dirs(dirs_first);
+      return 0;
+   }
+   if (batch) {
+      if (walk->batches_last) {
+         walk->batches_last->next = batch;
+      }
+      else {
+         walk->batches_first = batch;
+      }
+      walk->batches_last = batch;
+      walk->num_batches++;
+      if (walk->num_batches < WALK_MAX_BATCHES) {
+         pthread_cond_signal(&walk->space_cond);
+      }
+      pthread_cond_signal(&walk->result_cond);
+   }
+   if (dirs_first) {
+      if (walk->dirs_last) {
+         walk->dirs_last->next = dirs_first;
+      }
+      else {
+         walk->dirs_first = dirs_first;
+      }
+      walk->dirs_last = dirs_last;
+      pthread_cond_signal(&walk->work_cond);
    }
+   pthread_mutex_unlock(&walk->mutex);
+   return 1;
+}
 
-   if (params[3].value > sizeof(handle->write.buf)) {
-      params[3].value = sizeof(handle->write.buf);
+
+static int walk_directory(PathWalk *walk, const DirChar *rel, DirChar **error_path)
+{
+   DirReader reader;
+   DirEntry entry;
+   WalkBatch *batch = NULL;
+   WalkEntry *we;
+   WalkDir *dir, *dirs_first = NULL, *dirs_last = NULL;
+   DirChar *path;
+   int ret, err = 0;
+
+   path = dir_join(walk->root, rel);
+   if (!path) {
+      return DIR_ERR_OUT_OF_MEMORY;
    }
 
-   err = fixscript_get_array_bytes(heap, params[1], params[2].value, params[3].value, handle->write.buf);
+   err = dir_reader_open(&reader, path);
    if (err) {
-      return fixscript_error(heap, error, err);
+      *error_path = path;
+      return err;
    }
 
-   handle->active |= ASYNC_WRITE;
-   handle->write.callback = params[4];
-   handle->write.data = params[5];
-   fixscript_ref(heap, handle->write.data);
+   for (;;) {
+      ret = dir_reader_next(&reader, &entry);
+      if (ret < 0) {
+         err = ret;
+         break;
+      }
 
-   memset(&handle->write.overlapped, 0, sizeof(WSAOVERLAPPED));
+      if (ret > 0) {
+         if (!batch) {
+            batch = calloc(1, sizeof(WalkBatch));
+            if (!batch) {
+               err = DIR_ERR_OUT_OF_MEMORY;
+               break;
+            }
+            batch->rel = dir_strdup(rel);
+            if (!batch->rel) {
+               err = DIR_ERR_OUT_OF_MEMORY;
+               break;
+            }
+         }
 
-   wsabuf.len = params[3].value;
-   wsabuf.buf = handle->write.buf;
-   WSASend(handle->socket, &wsabuf, 1, &written, 0, &handle->write.overlapped, NULL);
+         we = &batch->entries[batch->cnt];
+         we->name_off = batch->names_len;
+         we->type = entry.type;
+         we->length = entry.length;
+         we->mtime = entry.mtime;
+         if (!walk_add_name(batch, entry.name)) {
+            err = DIR_ERR_OUT_OF_MEMORY;
+            break;
+         }
+         batch->cnt++;
 
-   return fixscript_int(0);
-}
-#elif defined(__wasm__)
-static Value native_async_tcp_connection_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
-{
-   *error = fixscript_create_error_string(heap, "not supported");
-   return fixscript_int(0);
-}
-#else
-static Value native_async_tcp_connection_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
-{
-   AsyncHandle *handle;
-   char *buf;
-   int err;
-   int written;
+         if (entry.recurse) {
+            dir = calloc(1, sizeof(WalkDir));
+            if (!dir) {
+               err = DIR_ERR_OUT_OF_MEMORY;
+               break;
+            }
+            dir->rel = dir_join(rel, entry.name);
+            if (!dir->rel) {
+               free(dir);
+               err = DIR_ERR_OUT_OF_MEMORY;
+               break;
+            }
+            if (dirs_last) {
+               dirs_last->next = dir;
+            }
+            else {
+               dirs_first = dir;
+            }
+            dirs_last = dir;
+         }
+      }
 
-   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
-   if (!handle || handle->type != ASYNC_TCP_CONNECTION) {
-      *error = fixscript_create_error_string(heap, "invalid async stream handle");
-      return fixscript_int(0);
+      if (ret == 0 || batch->cnt == WALK_BATCH_SIZE) {
+         if (batch || dirs_first) {
+            if (!walk_flush(walk, batch, dirs_first, dirs_last)) {
+               batch = NULL;
+               dirs_first = NULL;
+               break;
+            }
+            batch = NULL;
+            dirs_first = NULL;
+            dirs_last = NULL;
+         }
+         if (ret == 0) break;
+      }
    }
-   
-   if (handle->active & ASYNC_WRITE) {
-      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
-      return fixscript_int(0);
+
+   if (batch) {
+      free_walk_batch(batch);
    }
+   free_walk_dirs(dirs_first);
+   dir_reader_close(&reader);
 
-   err = fixscript_lock_array(heap, params[1], params[2].value, params[3].value, (void **)&buf, 1, ACCESS_READ_ONLY);
    if (err) {
-      fixscript_error(heap, error, err);
-      return fixscript_int(0);
+      *error_path = path;
    }
-
-   handle->active |= ASYNC_WRITE;
-   handle->write.callback = params[4];
-   handle->write.data = params[5];
-   fixscript_ref(heap, handle->write.data);
-
-   written = write(handle->fd, buf, params[3].value);
-   if (written < 0 && errno == EAGAIN) {
-      written = 0;
+   else {
+      free(path);
    }
-   handle->write.result = written;
-   update_poll_ctl(handle);
-
-   fixscript_unlock_array(heap, params[1], params[2].value, params[3].value, (void **)&buf, 1, ACCESS_READ_ONLY);
-
-   return fixscript_int(0);
+   return err;
 }
-#endif
 
 
-static Value native_async_tcp_connection_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static void path_walk_func(void *data)
 {
-   AsyncHandle *handle;
+   PathWalk *walk = data;
+   WalkDir *dir;
+   DirChar *error_path;
+   int err;
 
-   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
-   if (!handle || handle->type != ASYNC_TCP_CONNECTION) {
-      *error = fixscript_create_error_string(heap, "invalid async stream handle");
-      return fixscript_int(0);
-   }
+   pthread_mutex_lock(&walk->mutex);
+   for (;;) {
+      while (!walk->cancel && !walk->dirs_first && walk->num_busy > 0) {
+         pthread_cond_wait(&walk->work_cond, &walk->mutex);
+      }
+      if (walk->cancel || !walk->dirs_first) {
+         break;
+      }
 
-#if defined(_WIN32)
-   closesocket(handle->socket);
-   handle->socket = INVALID_SOCKET;
-#elif defined(__wasm__)
-#else
-   poll_remove_socket(handle->proc->poll, handle->fd);
-   close(handle->fd);
-   handle->fd = -1;
-#endif
-   return fixscript_int(0);
+      dir = walk->dirs_first;
+      walk->dirs_first = dir->next;
+      if (!walk->dirs_first) {
+         walk->dirs_last = NULL;
+      }
+      else {
+         // more work is available, wake up another thread:
+         pthread_cond_signal(&walk->work_cond);
+      }
+      walk->num_busy++;
+      pthread_mutex_unlock(&walk->mutex);
+
+      error_path = NULL;
+      err = walk_directory(walk, dir->rel, &error_path);
+      free(dir->rel);
+      free(dir);
+
+      pthread_mutex_lock(&walk->mutex);
+      walk->num_busy--;
+      if (err && !walk->error) {
+         walk->error = err;
+         walk->error_path = error_path;
+         error_path = NULL;
+         walk->cancel = 1;
+         pthread_cond_signal(&walk->space_cond);
+      }
+      free(error_path);
+   }
+
+   // the other threads are either finished or waiting for more work:
+   walk->num_threads--;
+   pthread_cond_signal(&walk->work_cond);
+   pthread_cond_signal(&walk->result_cond);
+   pthread_mutex_unlock(&walk->mutex);
 }
+#endif /* __wasm__ */
 
 
-static Value native_async_tcp_server_create(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value native_path_open_directory(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
 #if defined(__wasm__)
    *error = fixscript_create_error_string(heap, "not supported");
    return fixscript_int(0);
 #else
-   int local_only = data == (void *)1;
-   AsyncProcess *proc;
-   AsyncServerHandle *handle;
-   struct sockaddr_in server;
-#if defined(_WIN32)
-   SOCKET sock = INVALID_SOCKET;
-#else
-   int fd = -1;
-#endif
-   int reuse;
+   DirectoryHandle *handle;
+   DirChar *path = NULL;
    Value retval = fixscript_int(0);
-   
-   proc = get_async_process(heap, error);
-   if (!proc) return fixscript_int(0);
+   int err;
 
 #if defined(_WIN32)
-   sock = socket(AF_INET, SOCK_STREAM, 0);
-   if (sock == INVALID_SOCKET) {
-      goto io_error;
-   }
-
-   reuse = 1;
-   if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
-      goto io_error;
-   }
-
-   server.sin_family = AF_INET;
-   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
-   server.sin_port = htons(params[0].value);
-
-   if (bind(sock, (struct sockaddr *)&server, sizeof(server)) == SOCKET_ERROR) {
-      goto io_error;
-   }
-
-   if (listen(sock, 5) == SOCKET_ERROR) {
-      goto io_error;
-   }
+   err = fixscript_get_string_utf16(heap, params[0], 0, -1, &path, NULL);
 #else
-   fd = socket(AF_INET, SOCK_STREAM, 0);
-   if (fd == -1) {
-      goto io_error;
-   }
-
-   reuse = 1;
-   if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse)) < 0) {
-      goto io_error;
-   }
-
-   server.sin_family = AF_INET;
-   server.sin_addr.s_addr = htonl(local_only? INADDR_LOOPBACK : INADDR_ANY);
-   server.sin_port = htons(params[0].value);
-
-   if (bind(fd, (struct sockaddr *)&server, sizeof(server)) < 0) {
-      goto io_error;
-   }
-
-   if (listen(fd, 5) < 0) {
-      goto io_error;
-   }
+   err = fixscript_get_string(heap, params[0], 0, -1, &path, NULL);
 #endif
+   if (err) {
+      fixscript_error(heap, error, err);
+      goto error;
+   }
 
-   handle = calloc(1, sizeof(AsyncServerHandle));
+   handle = calloc(1, sizeof(DirectoryHandle));
    if (!handle) {
       fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
       goto error;
    }
 
-   handle->proc = proc;
-   async_process_ref(handle->proc);
-   handle->type = ASYNC_TCP_SERVER;
-#if defined(_WIN32)
-   handle->socket = sock;
-   handle->accept_socket = INVALID_SOCKET;
-   if (!CreateIoCompletionPort((HANDLE)handle->socket, proc->iocp, (ULONG_PTR)handle, 0)) {
-      async_process_unref(handle->proc);
-      free(handle);
-      goto io_error;
-   }
-#else
-   handle->fd = fd;
-   if (!poll_add_socket(proc->poll, fd, handle, 0)) {
-      async_process_unref(handle->proc);
+   err = dir_reader_open(&handle->reader, path);
+   if (err) {
       free(handle);
-      goto io_error;
+      create_dir_error(heap, error, err, path);
+      goto error;
    }
-#endif
+   handle->open = 1;
 
-   retval = fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, handle, free_async_handle);
-#if defined(_WIN32)
-   sock = INVALID_SOCKET;
-#else
-   fd = -1;
-#endif
+   retval = fixscript_create_handle(heap, HANDLE_TYPE_DIRECTORY, handle, free_directory_handle);
    if (!retval.value) {
       fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
       goto error;
    }
 
 error:
-#if defined(_WIN32)
-   if (!retval.value && sock != INVALID_SOCKET) {
-      closesocket(sock);
-   }
-#else
-   if (!retval.value && fd != -1) {
-      close(fd);
-   }
-#endif
+   free(path);
    return retval;
+#endif
+}
 
-io_error:
-   *error = fixscript_create_error_string(heap, "I/O error");
-   goto error;
 
+static Value native_path_read_directory(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
    return fixscript_int(0);
-#endif /* __wasm__ */
+#else
+   DirectoryHandle *handle;
+   DirEntry entry;
+   Value arr, values[DIR_ENTRY_SIZE];
+   int i, ret, err, max = params[1].value;
+
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_DIRECTORY, NULL);
+   if (!handle) {
+      *error = fixscript_create_error_string(heap, "invalid directory handle");
+      return fixscript_int(0);
+   }
+
+   if (!handle->open) {
+      *error = fixscript_create_error_string(heap, "directory already closed");
+      return fixscript_int(0);
+   }
+
+   if (max < 1) {
+      *error = fixscript_create_error_string(heap, "invalid maximum number of entries");
+      return fixscript_int(0);
+   }
+
+   arr = fixscript_create_array(heap, 0);
+   if (!arr.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   for (i=0; i<max; i++) {
+      ret = dir_reader_next(&handle->reader, &entry);
+      if (ret == 0) break;
+      if (ret < 0) {
+         *error = fixscript_create_error_string(heap, "I/O error");
+         return fixscript_int(0);
+      }
+
+      values[0] = create_dir_string(heap, entry.name);
+      if (!values[0].value) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      values[1] = fixscript_int(entry.type);
+      values[2] = fixscript_int(entry.length);
+      values[3] = fixscript_int(((uint64_t)entry.length) >> 32);
+      values[4] = fixscript_int(entry.mtime);
+      values[5] = fixscript_int(((uint64_t)entry.mtime) >> 32);
+
+      err = fixscript_set_array_length(heap, arr, (i+1)*DIR_ENTRY_SIZE);
+      if (!err) {
+         err = fixscript_set_array_range(heap, arr, i*DIR_ENTRY_SIZE, DIR_ENTRY_SIZE, values);
+      }
+      if (err) {
+         return fixscript_error(heap, error, err);
+      }
+   }
+   return arr;
+#endif
 }
 
 
-static Value native_async_tcp_server_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value native_path_close_directory(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
 #if defined(__wasm__)
    *error = fixscript_create_error_string(heap, "not supported");
    return fixscript_int(0);
 #else
-   AsyncServerHandle *handle;
+   DirectoryHandle *handle;
 
-   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
-   if (!handle || handle->type != ASYNC_TCP_SERVER) {
-      *error = fixscript_create_error_string(heap, "invalid async TCP server handle");
+   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_DIRECTORY, NULL);
+   if (!handle) {
+      *error = fixscript_create_error_string(heap, "invalid directory handle");
       return fixscript_int(0);
    }
 
-#ifdef _WIN32
-   closesocket(handle->socket);
-   handle->socket = INVALID_SOCKET;
-#else
-   poll_remove_socket(handle->proc->poll, handle->fd);
-   close(handle->fd);
-   handle->fd = -1;
-#endif
+   if (handle->open) {
+      dir_reader_close(&handle->reader);
+      handle->open = 0;
+   }
    return fixscript_int(0);
-#endif /* __wasm__ */
+#endif
 }
 
 
-static Value native_async_tcp_server_accept(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value native_path_walk(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
 #if defined(__wasm__)
    *error = fixscript_create_error_string(heap, "not supported");
    return fixscript_int(0);
 #else
-   AsyncServerHandle *handle;
-#ifdef _WIN32
-   BOOL ret;
-   int flag;
-#endif
+   PathWalk *walk;
+   WalkBatch *batch;
+   WalkEntry *we;
+   Value rel, arr, values[DIR_ENTRY_SIZE], callback_error;
+   int i, err, num_threads = params[1].value;
+   Value callback = params[2];
+   Value callback_data = params[3];
 
-   handle = fixscript_get_handle(heap, params[0], HANDLE_TYPE_ASYNC, NULL);
-   if (!handle || handle->type != ASYNC_TCP_SERVER) {
-      *error = fixscript_create_error_string(heap, "invalid async TCP server handle");
-      return fixscript_int(0);
+   if (num_threads < 1) {
+      num_threads = 1;
    }
-   
-   if (handle->active) {
-      *error = fixscript_create_error_string(heap, "only one accept operation can be active at a time");
-      return fixscript_int(0);
+   if (num_threads > WALK_MAX_THREADS) {
+      num_threads = WALK_MAX_THREADS;
    }
 
-#ifdef _WIN32
-   handle->accept_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-   if (handle->accept_socket == INVALID_SOCKET) {
-      *error = fixscript_create_error_string(heap, "I/O error");
-      return fixscript_int(0);
+   walk = calloc(1, sizeof(PathWalk));
+   if (!walk) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
    }
-   flag = 1;
-   setsockopt(handle->accept_socket, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
+
+#if defined(_WIN32)
+   err = fixscript_get_string_utf16(heap, params[0], 0, -1, &walk->root, NULL);
+#else
+   err = fixscript_get_string(heap, params[0], 0, -1, &walk->root, NULL);
 #endif
+   if (err) {
+      free(walk);
+      return fixscript_error(heap, error, err);
+   }
 
-   handle->active = 1;
-   handle->callback = params[1];
-   handle->data = params[2];
-   fixscript_ref(heap, handle->data);
+   walk->dirs_first = calloc(1, sizeof(WalkDir));
+   if (walk->dirs_first) {
+      walk->dirs_first->rel = calloc(1, sizeof(DirChar));
+   }
+   if (!walk->dirs_first || !walk->dirs_first->rel) {
+      free(walk->dirs_first);
+      free(walk->root);
+      free(walk);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   walk->dirs_last = walk->dirs_first;
 
-#ifdef _WIN32
-   memset(&handle->overlapped, 0, sizeof(OVERLAPPED));
-   ret = AcceptEx(handle->socket, handle->accept_socket, handle->buf, 0, sizeof(struct sockaddr_in) + 16, sizeof(struct sockaddr_in) + 16, NULL, &handle->overlapped);
-   if (ret != 0 || WSAGetLastError() != ERROR_IO_PENDING) {
-      *error = fixscript_create_error_string(heap, "I/O error");
+   if (pthread_mutex_init(&walk->mutex, NULL) != 0) {
+      free_walk_dirs(walk->dirs_first);
+      free(walk->root);
+      free(walk);
+      *error = fixscript_create_error_string(heap, "can't create mutex");
+      return fixscript_int(0);
+   }
+   if (pthread_cond_init(&walk->work_cond, NULL) != 0) {
+      pthread_mutex_destroy(&walk->mutex);
+      free_walk_dirs(walk->dirs_first);
+      free(walk->root);
+      free(walk);
+      *error = fixscript_create_error_string(heap, "can't create condition");
+      return fixscript_int(0);
+   }
+   if (pthread_cond_init(&walk->space_cond, NULL) != 0) {
+      pthread_cond_destroy(&walk->work_cond);
+      pthread_mutex_destroy(&walk->mutex);
+      free_walk_dirs(walk->dirs_first);
+      free(walk->root);
+      free(walk);
+      *error = fixscript_create_error_string(heap, "can't create condition");
+      return fixscript_int(0);
+   }
+   if (pthread_cond_init(&walk->result_cond, NULL) != 0) {
+      pthread_cond_destroy(&walk->space_cond);
+      pthread_cond_destroy(&walk->work_cond);
+      pthread_mutex_destroy(&walk->mutex);
+      free_walk_dirs(walk->dirs_first);
+      free(walk->root);
+      free(walk);
+      *error = fixscript_create_error_string(heap, "can't create condition");
       return fixscript_int(0);
    }
-#else
-   update_poll_ctl((AsyncHandle *)handle);
-#endif
-   return fixscript_int(0);
-#endif /* __wasm__ */
-}
 
+   for (i=0; i<num_threads; i++) {
+      pthread_mutex_lock(&walk->mutex);
+      walk->num_threads++;
+      pthread_mutex_unlock(&walk->mutex);
 
-#ifndef __wasm__
-static uint32_t get_time()
-{
-#if defined(_WIN32)
-   return timeGetTime();
-#elif defined(__APPLE__)
-   uint64_t time;
-   mach_timebase_info_data_t info;
-   time = mach_absolute_time();
-   mach_timebase_info(&info);
-   return time * info.numer / info.denom / 1000000;
-#else
-   struct timespec ts;
-   if (clock_gettime(CLOCK_MONOTONIC, &ts) == -1) {
-      return 0;
+      if (!async_run_thread(path_walk_func, walk)) {
+         pthread_mutex_lock(&walk->mutex);
+         walk->num_threads--;
+         pthread_mutex_unlock(&walk->mutex);
+         break;
+      }
    }
-   return ((uint64_t)ts.tv_sec) * 1000 + ((uint64_t)ts.tv_nsec / 1000000L);
-#endif
-}
-#endif
 
+   if (i == 0) {
+      *error = fixscript_create_error_string(heap, "can't create thread");
+   }
 
-#ifndef __wasm__
-static void wait_events(AsyncProcess *proc, int timeout)
-{
-   AsyncTimer *timer;
-   int32_t diff;
-#ifdef _WIN32
-   CompletedIO *cio;
-#endif
-
-   pthread_mutex_lock(&proc->mutex);
-   timer = proc->timers;
-   if (timer) {
-      if (timer->immediate) {
-         timeout = 0;
-      }
-      else {
-         diff = (int32_t)(timer->time - get_time());
-         if (timeout < 0 || diff < timeout) {
-            timeout = diff;
-            if (timeout < 0) timeout = 0;
+   for (;;) {
+      pthread_mutex_lock(&walk->mutex);
+      while (!walk->batches_first && walk->num_threads > 0) {
+         pthread_cond_wait(&walk->result_cond, &walk->mutex);
+      }
+      batch = walk->batches_first;
+      if (batch) {
+         walk->batches_first = batch->next;
+         if (!walk->batches_first) {
+            walk->batches_last = NULL;
          }
+         walk->num_batches--;
+         pthread_cond_signal(&walk->space_cond);
       }
-   }
-   pthread_mutex_unlock(&proc->mutex);
+      pthread_mutex_unlock(&walk->mutex);
 
-#if defined(_WIN32)
-   if (timeout < 0) {
-      timeout = INFINITE;
-   }
-   proc->num_events = 0;
-   cio = &proc->completed_ios[0];
+      if (!batch) break;
 
-   while (proc->num_events < sizeof(proc->completed_ios)/sizeof(CompletedIO)) {
-      GetQueuedCompletionStatus(proc->iocp, &cio->transferred, &cio->key, (OVERLAPPED **)&cio->overlapped, timeout);
-      if (!cio->overlapped) break;
+      if (!error->value) {
+         rel = create_dir_string(heap, batch->rel);
+         arr = fixscript_create_array(heap, batch->cnt * DIR_ENTRY_SIZE);
+         err = (!rel.value || !arr.value)? FIXSCRIPT_ERR_OUT_OF_MEMORY : FIXSCRIPT_SUCCESS;
+         for (i=0; i<batch->cnt && !err; i++) {
+            we = &batch->entries[i];
+            values[0] = create_dir_string(heap, batch->names + we->name_off);
+            if (!values[0].value) {
+               err = FIXSCRIPT_ERR_OUT_OF_MEMORY;
+               break;
+            }
+            values[1] = fixscript_int(we->type);
+            values[2] = fixscript_int(we->length);
+            values[3] = fixscript_int(((uint64_t)we->length) >> 32);
+            values[4] = fixscript_int(we->mtime);
+            values[5] = fixscript_int(((uint64_t)we->mtime) >> 32);
+            err = fixscript_set_array_range(heap, arr, i*DIR_ENTRY_SIZE, DIR_ENTRY_SIZE, values);
+         }
 
-      cio = &proc->completed_ios[++proc->num_events];
-      timeout = 0;
+         if (err) {
+            fixscript_error(heap, error, err);
+         }
+         else {
+            fixscript_call(heap, callback, 3, &callback_error, callback_data, rel, arr);
+            if (callback_error.value) {
+               *error = callback_error;
+            }
+         }
+
+         if (error->value) {
+            pthread_mutex_lock(&walk->mutex);
+            walk->cancel = 1;
+            pthread_cond_signal(&walk->work_cond);
+            pthread_cond_signal(&walk->space_cond);
+            pthread_mutex_unlock(&walk->mutex);
+         }
+      }
+      free_walk_batch(batch);
    }
-#elif defined(__wasm__)
-#else
-   if (timeout < 0) {
-      timeout = -1;
+
+   if (walk->error && !error->value) {
+      create_dir_error(heap, error, walk->error, walk->error_path);
    }
-   poll_wait(proc->poll, timeout);
+
+   pthread_cond_destroy(&walk->result_cond);
+   pthread_cond_destroy(&walk->space_cond);
+   pthread_cond_destroy(&walk->work_cond);
+   pthread_mutex_destroy(&walk->mutex);
+   free_walk_dirs(walk->dirs_first);
+   free(walk->error_path);
+   free(walk->root);
+   free(walk);
+   return fixscript_int(0);
 #endif
 }
-#endif
 
 
 #ifndef __wasm__
 static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
 {
    AsyncThreadResult *atr = NULL, *atr_next;
-   AsyncTimer *timer;
+   AsyncFileOp *op;
+   AsyncTimer *timer, *timer_next;
    AsyncHandle *handle;
    Value handle_val, callback_error;
-   uint32_t time = 0;
-   int32_t diff;
-   int time_obtained;
 #if defined(_WIN32)
    CompletedIO *cio;
    int i;
@@ -7564,15 +12390,15 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
       }
 
       handle = (AsyncHandle *)(uintptr_t)cio->key;
-      if (handle->type == ASYNC_TCP_CONNECTION) {
+      if (handle->common.type == ASYNC_TCP_CONNECTION) {
          if ((void *)cio->overlapped == &handle->read.overlapped) {
-            if (handle->active & ASYNC_READ) {
+            if (handle->common.active & ASYNC_READ) {
                Value callback, data;
                int result = cio->transferred;
 
                callback = handle->read.callback;
                data = handle->read.data;
-               handle->active &= ~ASYNC_READ;
+               handle->common.active &= ~ASYNC_READ;
 
                if (fixscript_set_array_bytes(heap, handle->read.array, handle->read.off, result, handle->read.buf) != 0) {
                   result = -1;
@@ -7587,13 +12413,45 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
             }
          }
          if ((void *)cio->overlapped == &handle->write.overlapped) {
-            if (handle->active & ASYNC_WRITE) {
+            if (handle->common.active & ASYNC_WRITE) {
                Value callback, data;
                int result = cio->transferred;
 
                callback = handle->write.callback;
                data = handle->write.data;
-               handle->active &= ~ASYNC_WRITE;
+               handle->common.active &= ~ASYNC_WRITE;
+
+               fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(result));
+               if (callback_error.value) {
+                  fixscript_dump_value(heap, callback_error, 1);
+               }
+               fixscript_unref(heap, data);
+            }
+         }
+      }
+      else if (handle->common.type == ASYNC_UDP_SOCKET) {
+         AsyncUDPHandle *udp_handle = (AsyncUDPHandle *)handle;
+         if ((void *)cio->overlapped == &udp_handle->read_overlapped) {
+            if (udp_handle->common.active & ASYNC_READ) {
+               Value callback, data, values[UDP_MSG_SIZE];
+               int j, info[UDP_MSG_SIZE], result = 1;
+
+               callback = udp_handle->read_callback;
+               data = udp_handle->read_data;
+               udp_handle->common.active &= ~ASYNC_READ;
+
+               udp_set_info(info, 0, cio->transferred, &udp_handle->read_addr);
+               for (j=0; j<UDP_MSG_SIZE; j++) {
+                  values[j] = fixscript_int(info[j]);
+               }
+               if (fixscript_set_array_bytes(heap, udp_handle->read_array, 0, cio->transferred, udp_handle->read_buf) != 0) {
+                  result = -1;
+               }
+               else if (fixscript_set_array_range(heap, udp_handle->read_msgs, 0, UDP_MSG_SIZE, values) != 0) {
+                  result = -1;
+               }
+               fixscript_unref(heap, udp_handle->read_array);
+               fixscript_unref(heap, udp_handle->read_msgs);
 
                fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(result));
                if (callback_error.value) {
@@ -7602,8 +12460,23 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
                fixscript_unref(heap, data);
             }
          }
+         if ((void *)cio->overlapped == &udp_handle->write_overlapped) {
+            if (udp_handle->common.active & ASYNC_WRITE) {
+               Value callback, data;
+
+               callback = udp_handle->write_callback;
+               data = udp_handle->write_data;
+               udp_handle->common.active &= ~ASYNC_WRITE;
+
+               fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(udp_handle->write_result));
+               if (callback_error.value) {
+                  fixscript_dump_value(heap, callback_error, 1);
+               }
+               fixscript_unref(heap, data);
+            }
+         }
       }
-      else if (handle->type == ASYNC_TCP_SERVER) {
+      else if (handle->common.type == ASYNC_TCP_SERVER) {
          AsyncServerHandle *server_handle = (AsyncServerHandle *)handle;
          if ((void *)cio->overlapped == &server_handle->overlapped) {
             AsyncHandle *new_handle;
@@ -7619,13 +12492,13 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
                closesocket(socket);
             }
             else {
-               new_handle->proc = proc;
-               async_process_ref(new_handle->proc);
-               new_handle->type = ASYNC_TCP_CONNECTION;
-               new_handle->socket = socket;
-               if (!CreateIoCompletionPort((HANDLE)new_handle->socket, proc->iocp, (ULONG_PTR)new_handle, 0)) {
-                  async_process_unref(new_handle->proc);
-                  closesocket(new_handle->socket);
+               new_handle->common.proc = proc;
+               async_process_ref(new_handle->common.proc);
+               new_handle->common.type = ASYNC_TCP_CONNECTION;
+               new_handle->common.socket = socket;
+               if (!CreateIoCompletionPort((HANDLE)new_handle->common.socket, proc->iocp, (ULONG_PTR)new_handle, 0)) {
+                  async_process_unref(new_handle->common.proc);
+                  closesocket(new_handle->common.socket);
                   free(new_handle);
                }
                else {
@@ -7635,7 +12508,7 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
 
             callback = server_handle->callback;
             data = server_handle->data;
-            server_handle->active = 0;
+            server_handle->common.active = 0;
 
             fixscript_call(heap, callback, 2, &callback_error, data, result);
             if (callback_error.value) {
@@ -7646,24 +12519,52 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
       }
    }
 #else
+   #ifdef USE_IO_URING
+   if (proc->ring) {
+      ring_process_events(proc, heap);
+   }
+   #endif
    for (;;) {
       handle = poll_get_event(proc->poll, &flags);
       if (!handle) break;
 
-      if (handle->type == ASYNC_TCP_CONNECTION) {
+      if (handle->common.type == ASYNC_TCP_CONNECTION || handle->common.type == ASYNC_PROCESS_STREAM) {
          if (flags & ASYNC_READ) {
-            if (handle->active & ASYNC_READ) {
+            if ((handle->common.active & ASYNC_READ) && handle->read.fd_passing) {
+               Value callback, data, result = fixscript_int(0);
+               int ret, fd;
+
+               ret = unix_receive_fd(handle->common.fd, MSG_DONTWAIT, &fd);
+               // spurious wakeups are ignored:
+               if (ret >= 0 || errno != EAGAIN) {
+                  callback = handle->read.callback;
+                  data = handle->read.data;
+                  handle->common.active &= ~ASYNC_READ;
+                  handle->read.fd_passing = 0;
+
+                  if (ret > 0) {
+                     result = create_async_connection(heap, proc, fd);
+                  }
+
+                  fixscript_call(heap, callback, 2, &callback_error, data, result);
+                  if (callback_error.value) {
+                     fixscript_dump_value(heap, callback_error, 1);
+                  }
+                  fixscript_unref(heap, data);
+               }
+            }
+            else if (handle->common.active & ASYNC_READ) {
                Value callback, data;
                char *buf;
                int err = 0, result = -1;
 
                callback = handle->read.callback;
                data = handle->read.data;
-               handle->active &= ~ASYNC_READ;
+               handle->common.active &= ~ASYNC_READ;
 
                err = fixscript_lock_array(heap, handle->read.array, handle->read.off, handle->read.len, (void **)&buf, 1, ACCESS_WRITE_ONLY);
                if (!err) {
-                  result = read(handle->fd, buf, handle->read.len);
+                  result = read(handle->common.fd, buf, handle->read.len);
                   handle->read.len = result;
                   if (handle->read.len < 0) handle->read.len = 0;
                   fixscript_unlock_array(heap, handle->read.array, handle->read.off, handle->read.len, (void **)&buf, 1, ACCESS_WRITE_ONLY);
@@ -7678,12 +12579,12 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
             }
          }
          if (flags & ASYNC_WRITE) {
-            if (handle->active & ASYNC_WRITE) {
+            if (handle->common.active & ASYNC_WRITE) {
                Value callback, data;
 
                callback = handle->write.callback;
                data = handle->write.data;
-               handle->active &= ~ASYNC_WRITE;
+               handle->common.active &= ~ASYNC_WRITE;
 
                fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(handle->write.result));
                if (callback_error.value) {
@@ -7692,16 +12593,62 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
                fixscript_unref(heap, data);
             }
          }
-         update_poll_ctl(handle);
+         update_poll_ctl(&handle->common);
+      }
+      else if (handle->common.type == ASYNC_UDP_SOCKET) {
+         AsyncUDPHandle *udp_handle = (AsyncUDPHandle *)handle;
+         if ((flags & ASYNC_READ) && (udp_handle->common.active & ASYNC_READ)) {
+            Value callback, data;
+            int err, count, result = -1;
+
+            count = udp_get_receive_count(heap, &callback_error, udp_handle->read_array, udp_handle->slot_size, udp_handle->read_msgs);
+            if (count > 0) {
+               err = udp_receive_arrays(heap, udp_handle->common.fd, udp_handle->read_array, udp_handle->slot_size, udp_handle->read_msgs, count, 1, &result);
+               if (err) {
+                  result = -1;
+               }
+            }
+
+            // spurious wakeups are ignored:
+            if (result != 0) {
+               callback = udp_handle->read_callback;
+               data = udp_handle->read_data;
+               udp_handle->common.active &= ~ASYNC_READ;
+               fixscript_unref(heap, udp_handle->read_array);
+               fixscript_unref(heap, udp_handle->read_msgs);
+
+               fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(result));
+               if (callback_error.value) {
+                  fixscript_dump_value(heap, callback_error, 1);
+               }
+               fixscript_unref(heap, data);
+            }
+         }
+         if ((flags & ASYNC_WRITE) && (udp_handle->common.active & ASYNC_WRITE)) {
+            Value callback, data;
+
+            callback = udp_handle->write_callback;
+            data = udp_handle->write_data;
+            udp_handle->common.active &= ~ASYNC_WRITE;
+
+            fixscript_call(heap, callback, 2, &callback_error, data, fixscript_int(udp_handle->write_result));
+            if (callback_error.value) {
+               fixscript_dump_value(heap, callback_error, 1);
+            }
+            fixscript_unref(heap, data);
+         }
+         if (udp_handle->common.fd != -1) {
+            update_poll_ctl(&handle->common);
+         }
       }
-      else if (handle->type == ASYNC_TCP_SERVER) {
+      else if (handle->common.type == ASYNC_TCP_SERVER) {
          AsyncServerHandle *server_handle = (AsyncServerHandle *)handle;
          AsyncHandle *new_handle;
          if (flags & ASYNC_READ) {
             Value callback, data;
             Value result = fixscript_int(0);
             int fd, flag;
-            fd = accept(server_handle->fd, NULL, NULL);
+            fd = accept(server_handle->common.fd, NULL, NULL);
             if (fd >= 0) {
                flag = 1;
                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *)&flag, sizeof(int));
@@ -7714,13 +12661,13 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
                   close(fd);
                }
                else {
-                  new_handle->proc = proc;
-                  async_process_ref(new_handle->proc);
-                  new_handle->type = ASYNC_TCP_CONNECTION;
-                  new_handle->fd = fd;
+                  new_handle->common.proc = proc;
+                  async_process_ref(new_handle->common.proc);
+                  new_handle->common.type = ASYNC_TCP_CONNECTION;
+                  new_handle->common.fd = fd;
                   if (!poll_add_socket(proc->poll, fd, new_handle, 0)) {
-                     async_process_unref(new_handle->proc);
-                     close(new_handle->fd);
+                     async_process_unref(new_handle->common.proc);
+                     close(new_handle->common.fd);
                      free(new_handle);
                   }
                   else {
@@ -7731,7 +12678,7 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
 
             callback = server_handle->callback;
             data = server_handle->data;
-            server_handle->active = 0;
+            server_handle->common.active = 0;
 
             fixscript_call(heap, callback, 2, &callback_error, data, result);
             if (callback_error.value) {
@@ -7739,7 +12686,7 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
             }
             fixscript_unref(heap, data);
          }
-         update_poll_ctl(handle);
+         update_poll_ctl(&handle->common);
       }
    }
 #endif
@@ -7759,31 +12706,31 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
          {
             handle = calloc(1, sizeof(AsyncHandle));
             if (!handle) {
-               #ifdef _WIN32
-               closesocket(handle->socket);
-               #else
-               close(handle->fd);
-               #endif
                fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
                goto error;
             }
-            handle->proc = proc;
-            async_process_ref(handle->proc);
-            handle->type = ASYNC_TCP_CONNECTION;
+            handle->common.proc = proc;
+            async_process_ref(handle->common.proc);
+            handle->common.type = ASYNC_TCP_CONNECTION;
             #ifdef _WIN32
-            handle->socket = atr->socket;
-            if (!CreateIoCompletionPort((HANDLE)handle->socket, proc->iocp, (ULONG_PTR)handle, 0)) {
-               async_process_unref(handle->proc);
-               closesocket(handle->socket);
+            handle->common.socket = atr->socket;
+            atr->socket = INVALID_SOCKET;
+            if (!CreateIoCompletionPort((HANDLE)handle->common.socket, proc->iocp, (ULONG_PTR)handle, 0)) {
+               async_process_unref(handle->common.proc);
+               closesocket(handle->common.socket);
                free(handle);
                *error = fixscript_create_error_string(heap, "can't add socket to IO completion port");
                goto error;
             }
             #else
-            handle->fd = atr->fd;
-            if (!poll_add_socket(proc->poll, atr->fd, handle, 0)) {
-               async_process_unref(handle->proc);
-               close(handle->fd);
+            handle->common.fd = atr->fd;
+            atr->fd = -1;
+            #ifdef USE_IO_URING
+            if (!proc->ring)
+            #endif
+            if (!poll_add_socket(proc->poll, handle->common.fd, handle, 0)) {
+               async_process_unref(handle->common.proc);
+               close(handle->common.fd);
                free(handle);
                *error = fixscript_create_error_string(heap, "can't add socket to poll");
                goto error;
@@ -7806,43 +12753,98 @@ static int process_events(AsyncProcess *proc, Heap *heap, Value *error)
          }
          fixscript_unref(heap, atr->data);
       }
+      else if (atr->type == ASYNC_FILE) {
+         op = atr->file_op;
+         atr->file_op = NULL;
+         switch (op->type) {
+            case FILE_OP_OPEN:
+               handle_val = fixscript_int(0);
+               if (op->file) {
+                  handle_val = fixscript_create_value_handle(heap, HANDLE_TYPE_FILE, op->file, file_handle_func);
+                  op->file = NULL;
+                  if (!handle_val.value) {
+                     free_async_file_op(op);
+                     fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+                     goto error;
+                  }
+               }
+               break;
+
+            case FILE_OP_READ:
+               if (op->result > 0 && fixscript_set_array_bytes(heap, op->array, op->off, op->result, op->buf) != 0) {
+                  op->result = -1;
+               }
+               fixscript_unref(heap, op->array);
+               handle_val = fixscript_int(op->result);
+               break;
+
+            case FILE_OP_SYNC:
+               handle_val = fixscript_int(op->result == 0);
+               break;
+
+            default:
+               handle_val = fixscript_int(op->result);
+               break;
+         }
+
+         fixscript_call(heap, atr->callback, 2, &callback_error, atr->data, handle_val);
+         if (callback_error.value) {
+            fixscript_dump_value(heap, callback_error, 1);
+         }
+         fixscript_unref(heap, atr->data);
+         free_async_file_op(op);
+      }
+      else if (atr->type == ASYNC_PROCESS_SPLICE) {
+         fixscript_call(heap, atr->callback, 3, &callback_error, atr->data, fixscript_int((int)atr->length), fixscript_int((int)(atr->length >> 32)));
+         if (callback_error.value) {
+            fixscript_dump_value(heap, callback_error, 1);
+         }
+         fixscript_unref(heap, atr->data);
+      }
       atr_next = atr->next;
       free(atr);
       atr = atr_next;
    }
 
    pthread_mutex_lock(&proc->mutex);
-   time_obtained = 0;
-   while (proc->timers) {
-      timer = proc->timers;
-      if (!timer->immediate) {
-         if (!time_obtained) {
-            time = get_time();
-            time_obtained = 1;
-         }
-         diff = (int32_t)(timer->time - time);
-         if (diff > 0) break;
-      }
-
-      proc->timers = timer->next;
-      pthread_mutex_unlock(&proc->mutex);
+   timer = timer_wheel_expire(&proc->timers, get_time());
+   pthread_mutex_unlock(&proc->mutex);
 
+   while (timer) {
       fixscript_call(heap, timer->callback, 1, &callback_error, timer->data);
       if (callback_error.value) {
          fixscript_dump_value(heap, callback_error, 1);
       }
       fixscript_unref(heap, timer->data);
 
+      timer_next = timer->next;
       free(timer);
-
-      pthread_mutex_lock(&proc->mutex);
+      timer = timer_next;
    }
-   pthread_mutex_unlock(&proc->mutex);
    return 1;
 
 error:
+   // the current and remaining results are released without calling their callbacks:
    while (atr) {
       atr_next = atr->next;
+      if (atr->type == ASYNC_TCP_CONNECTION) {
+         #ifdef _WIN32
+         if (atr->socket != INVALID_SOCKET) {
+            closesocket(atr->socket);
+         }
+         #else
+         if (atr->fd != -1) {
+            close(atr->fd);
+         }
+         #endif
+      }
+      else if (atr->type == ASYNC_FILE && atr->file_op) {
+         if (atr->file_op->type == FILE_OP_READ) {
+            fixscript_unref(heap, atr->file_op->array);
+         }
+         free_async_file_op(atr->file_op);
+      }
+      fixscript_unref(heap, atr->data);
       free(atr);
       atr = atr_next;
    }
@@ -7905,8 +12907,8 @@ static Value native_async_run_later(Heap *heap, Value *error, int num_params, Va
    return fixscript_int(0);
 #else
    AsyncProcess *proc;
-   AsyncTimer *timer, *t, **p;
-   int32_t diff;
+   AsyncTimer *timer;
+   uint32_t time;
 
    proc = get_async_process(heap, error);
    if (!proc) return fixscript_int(0);
@@ -7916,38 +12918,20 @@ static Value native_async_run_later(Heap *heap, Value *error, int num_params, Va
       return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
    }
 
+   time = get_time();
    if (params[0].value == 0) {
       timer->immediate = 1;
    }
    else {
-      timer->time = get_time() + (uint32_t)params[0].value;
+      timer->time = time + (uint32_t)params[0].value;
    }
 
    timer->callback = params[1];
    timer->data = params[2];
    fixscript_ref(heap, timer->data);
 
-   pthread_mutex_lock(&proc->mutex);
-   if (timer->immediate || !proc->timers) {
-      timer->next = proc->timers;
-      proc->timers = timer;
-   }
-   else {
-      p = &proc->timers;
-      for (t=proc->timers; t; t=t->next) {
-         diff = (int32_t)(timer->time - t->time);
-         if (!t->immediate && diff <= 0) {
-            timer->next = t;
-            *p = timer;
-            break;
-         }
-         if (!t->next) {
-            t->next = timer;
-            break;
-         }
-         p = &t->next;
-      }
-   }
+   pthread_mutex_lock(&proc->mutex);
+   timer_wheel_add(&proc->timers, timer, time);
    pthread_mutex_unlock(&proc->mutex);
 
    if (proc->foreign_notify_func) {
@@ -8780,6 +13764,7 @@ static Value native_process_close(Heap *heap, Value *error, int num_params, Valu
 #else
    ret = close(fd);
 #endif
+   handle->flags &= ~(1 << (int)(intptr_t)data);
 
    if (ret < 0) {
       *error = fixscript_create_error_string(heap, "I/O error");
@@ -8790,6 +13775,390 @@ static Value native_process_close(Heap *heap, Value *error, int num_params, Valu
 }
 
 
+#if !defined(_WIN32) && !defined(__wasm__)
+static int take_process_fd(Heap *heap, Value *error, Value handle_val, int type)
+{
+   ProcessHandle *handle;
+   int fd;
+
+   handle = fixscript_get_handle(heap, handle_val, HANDLE_TYPE_PROCESS, NULL);
+   if (!handle) {
+      *error = fixscript_create_error_string(heap, "invalid process handle");
+      return -1;
+   }
+
+   switch (type) {
+      case 0: fd = (handle->flags & REDIR_IN)? handle->in_fd : -1; break;
+      case 1: fd = (handle->flags & REDIR_OUT)? handle->out_fd : -1; break;
+      case 2: fd = (handle->flags & REDIR_ERR)? handle->err_fd : -1; break;
+      default: fd = -1;
+   }
+
+   if (fd == -1) {
+      *error = fixscript_create_error_string(heap, "stream is not redirected");
+      return -1;
+   }
+
+   // the pipe is owned by the caller from now on:
+   handle->flags &= ~(1 << type);
+   return fd;
+}
+
+
+static AsyncHandle *get_async_process_stream(Heap *heap, Value *error, Value handle_val)
+{
+   AsyncHandle *handle;
+
+   handle = fixscript_get_handle(heap, handle_val, HANDLE_TYPE_ASYNC, NULL);
+   if (!handle || handle->common.type != ASYNC_PROCESS_STREAM) {
+      *error = fixscript_create_error_string(heap, "invalid async stream handle");
+      return NULL;
+   }
+   return handle;
+}
+#endif
+
+
+static Value native_async_process_stream_open(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   AsyncHandle *handle;
+   Value handle_val;
+   int fd, flags;
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   fd = take_process_fd(heap, error, params[0], params[1].value);
+   if (fd == -1) {
+      return fixscript_int(0);
+   }
+
+   flags = fcntl(fd, F_GETFL);
+   if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      close(fd);
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   handle = calloc(1, sizeof(AsyncHandle));
+   if (!handle) {
+      close(fd);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   handle->common.proc = proc;
+   async_process_ref(handle->common.proc);
+   handle->common.type = ASYNC_PROCESS_STREAM;
+   handle->common.fd = fd;
+
+   // pipes are always waited for using the poll (the ring polls it as well when used):
+   if (!poll_add_socket(proc->poll, fd, handle, 0)) {
+      async_process_unref(handle->common.proc);
+      close(fd);
+      free(handle);
+      *error = fixscript_create_error_string(heap, "can't add pipe to poll");
+      return fixscript_int(0);
+   }
+
+   handle_val = fixscript_create_handle(heap, HANDLE_TYPE_ASYNC, handle, free_async_handle);
+   if (!handle_val.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   return handle_val;
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_process_stream_read(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+
+   handle = get_async_process_stream(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   if (handle->common.active & ASYNC_READ) {
+      *error = fixscript_create_error_string(heap, "only one read operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   if (params[3].value < 0) {
+      *error = fixscript_create_error_string(heap, "negative length");
+      return fixscript_int(0);
+   }
+
+   handle->common.active |= ASYNC_READ;
+   handle->read.callback = params[4];
+   handle->read.data = params[5];
+   handle->read.array = params[1];
+   handle->read.off = params[2].value;
+   handle->read.len = params[3].value;
+   fixscript_ref(heap, handle->read.data);
+   fixscript_ref(heap, handle->read.array);
+
+   update_poll_ctl(&handle->common);
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_process_stream_write(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+   char *buf;
+   int err;
+   int written;
+
+   handle = get_async_process_stream(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   if (handle->common.active & ASYNC_WRITE) {
+      *error = fixscript_create_error_string(heap, "only one write operation can be active at a time");
+      return fixscript_int(0);
+   }
+
+   err = fixscript_lock_array(heap, params[1], params[2].value, params[3].value, (void **)&buf, 1, ACCESS_READ_ONLY);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   handle->common.active |= ASYNC_WRITE;
+   handle->write.callback = params[4];
+   handle->write.data = params[5];
+   fixscript_ref(heap, handle->write.data);
+
+   // the data is written immediately, the callback is called once the pipe is writable:
+   written = write(handle->common.fd, buf, params[3].value);
+   if (written < 0 && errno == EAGAIN) {
+      written = 0;
+   }
+   handle->write.result = written;
+   update_poll_ctl(&handle->common);
+
+   fixscript_unlock_array(heap, params[1], params[2].value, params[3].value, (void **)&buf, 1, ACCESS_READ_ONLY);
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+static Value native_async_process_stream_close(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncHandle *handle;
+
+   handle = get_async_process_stream(heap, error, params[0]);
+   if (!handle) {
+      return fixscript_int(0);
+   }
+
+   if (handle->common.fd != -1) {
+      poll_remove_socket(handle->common.proc->poll, handle->common.fd);
+      close(handle->common.fd);
+      handle->common.fd = -1;
+   }
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
+#if !defined(_WIN32) && !defined(__wasm__)
+#define SPLICE_CHUNK_SIZE (1024*1024)
+#define SPLICE_BUF_SIZE   65536
+
+typedef struct {
+   AsyncProcess *proc;
+   int in_fd;
+   int out_fd;
+   Value callback;
+   Value data;
+   AsyncThreadResult *atr;
+} ProcessSpliceData;
+
+static void wait_writable(int fd)
+{
+   struct pollfd pfd;
+
+   pfd.fd = fd;
+   pfd.events = POLLOUT;
+   pfd.revents = 0;
+   poll(&pfd, 1, -1);
+}
+
+static void process_splice_func(void *data)
+{
+   ProcessSpliceData *psd = data;
+   AsyncProcess *proc = psd->proc;
+   AsyncThreadResult *atr = psd->atr;
+   int64_t total = 0;
+   ssize_t ret = 0, written;
+   char *buf;
+   int off, use_copy = 1;
+
+#ifdef __linux__
+   // the data is moved between the pipe and the target without copying to user space:
+   use_copy = 0;
+   for (;;) {
+      ret = splice(psd->in_fd, NULL, psd->out_fd, NULL, SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret < 0 && errno == EAGAIN) {
+         wait_writable(psd->out_fd);
+         continue;
+      }
+      if (ret <= 0) break;
+      total += ret;
+   }
+   if (ret < 0 && errno == EINVAL && total == 0) {
+      // the target doesn't support splicing (eg. files opened in append mode):
+      use_copy = 1;
+   }
+#endif
+
+   if (use_copy) {
+      buf = malloc(SPLICE_BUF_SIZE);
+      ret = buf? 0 : -1;
+      while (buf) {
+         ret = read(psd->in_fd, buf, SPLICE_BUF_SIZE);
+         if (ret < 0 && errno == EINTR) continue;
+         if (ret <= 0) break;
+         for (off=0; off<ret; off+=written) {
+            written = write(psd->out_fd, buf+off, ret-off);
+            if (written < 0 && (errno == EINTR || errno == EAGAIN)) {
+               if (errno == EAGAIN) {
+                  wait_writable(psd->out_fd);
+               }
+               written = 0;
+               continue;
+            }
+            if (written <= 0) break;
+         }
+         if (off < ret) {
+            ret = -1;
+            break;
+         }
+         total += ret;
+      }
+      free(buf);
+   }
+
+   close(psd->in_fd);
+   close(psd->out_fd);
+
+   atr->type = ASYNC_PROCESS_SPLICE;
+   atr->callback = psd->callback;
+   atr->data = psd->data;
+   atr->fd = -1;
+   atr->length = ret < 0? -1 : total;
+
+   pthread_mutex_lock(&proc->mutex);
+   atr->next = proc->thread_results;
+   proc->thread_results = atr;
+   async_process_notify(proc);
+   pthread_mutex_unlock(&proc->mutex);
+
+   async_process_unref(proc);
+   free(psd);
+}
+#endif
+
+
+static Value native_async_process_splice(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#if defined(_WIN32) || defined(__wasm__)
+   *error = fixscript_create_error_string(heap, "not supported");
+   return fixscript_int(0);
+#else
+   AsyncProcess *proc;
+   ProcessSpliceData *psd;
+   FileHandle *file;
+   int target_fd, in_fd, out_fd;
+
+   proc = get_async_process(heap, error);
+   if (!proc) return fixscript_int(0);
+
+   file = fixscript_get_handle(heap, params[2], HANDLE_TYPE_FILE, NULL);
+   if (file) {
+      if (file->closed) {
+         *error = fixscript_create_error_string(heap, "file is already closed");
+         return fixscript_int(0);
+      }
+      target_fd = file->fd;
+   }
+   else {
+      target_fd = get_passed_fd(heap, error, params[2]);
+      if (target_fd == -1) {
+         return fixscript_int(0);
+      }
+   }
+
+   // the thread uses its own descriptor so the target can be closed in the meantime:
+   out_fd = dup(target_fd);
+   if (out_fd == -1) {
+      *error = fixscript_create_error_string(heap, "I/O error");
+      return fixscript_int(0);
+   }
+
+   psd = calloc(1, sizeof(ProcessSpliceData));
+   if (psd) {
+      psd->atr = calloc(1, sizeof(AsyncThreadResult));
+   }
+   if (!psd || !psd->atr) {
+      free(psd);
+      close(out_fd);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   in_fd = take_process_fd(heap, error, params[0], params[1].value);
+   if (in_fd == -1) {
+      free(psd->atr);
+      free(psd);
+      close(out_fd);
+      return fixscript_int(0);
+   }
+
+   psd->proc = proc;
+   psd->in_fd = in_fd;
+   psd->out_fd = out_fd;
+   psd->callback = params[3];
+   psd->data = params[4];
+   async_process_ref(proc);
+   fixscript_ref(heap, psd->data);
+
+   if (!async_run_thread(process_splice_func, psd)) {
+      async_process_unref(proc);
+      fixscript_unref(heap, psd->data);
+      close(in_fd);
+      close(out_fd);
+      free(psd->atr);
+      free(psd);
+      *error = fixscript_create_error_string(heap, "can't create thread");
+      return fixscript_int(0);
+   }
+
+   return fixscript_int(0);
+#endif /* __wasm__ */
+}
+
+
 static Value native_process_wait(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
 #if defined(__wasm__)
@@ -14552,6 +19921,10 @@ void fixio_register_functions(Heap *heap)
    fixscript_register_native_func(heap, "path_create_directory#1", native_path_create_directory, NULL);
    fixscript_register_native_func(heap, "path_delete_file#1", native_path_delete_file, NULL);
    fixscript_register_native_func(heap, "path_delete_directory#1", native_path_delete_directory, NULL);
+   fixscript_register_native_func(heap, "path_open_directory#1", native_path_open_directory, NULL);
+   fixscript_register_native_func(heap, "path_read_directory#2", native_path_read_directory, NULL);
+   fixscript_register_native_func(heap, "path_close_directory#1", native_path_close_directory, NULL);
+   fixscript_register_native_func(heap, "path_walk#4", native_path_walk, NULL);
 
    fixscript_register_native_func(heap, "file_open#2", native_file_open, NULL);
    fixscript_register_native_func(heap, "file_close#1", native_file_close, NULL);
@@ -14566,12 +19939,23 @@ void fixio_register_functions(Heap *heap)
    fixscript_register_native_func(heap, "file_unlock#1", native_file_unlock, NULL);
    fixscript_register_native_func(heap, "file_get_native_descriptor#1", native_file_get_native_descriptor, NULL);
    fixscript_register_native_func(heap, "file_get_native_handle#1", native_file_get_native_handle, NULL);
+   fixscript_register_native_func(heap, "file_map#5", native_file_map, NULL);
+   fixscript_register_native_func(heap, "async_file_open#4", native_async_file_open, NULL);
+   fixscript_register_native_func(heap, "async_file_read#9", native_async_file_read_write, (void *)0);
+   fixscript_register_native_func(heap, "async_file_write#8", native_async_file_read_write, (void *)1);
+   fixscript_register_native_func(heap, "async_file_sync#3", native_async_file_sync, NULL);
+   fixscript_register_native_func(heap, "async_file_close#1", native_async_file_close, NULL);
+   fixscript_register_native_func(heap, "async_file_set_concurrency#1", native_async_file_set_concurrency, NULL);
    fixscript_register_native_func(heap, "file_exists#1", native_file_exists, NULL);
 
    fixscript_register_native_func(heap, "tcp_connection_open#2", native_tcp_connection_open, NULL);
    fixscript_register_native_func(heap, "tcp_connection_close#1", native_tcp_connection_close, NULL);
    fixscript_register_native_func(heap, "tcp_connection_read#5", native_tcp_connection_read, NULL);
    fixscript_register_native_func(heap, "tcp_connection_write#5", native_tcp_connection_write, NULL);
+   fixscript_register_native_func(heap, "tcp_connection_writev#3", native_tcp_connection_writev, NULL);
+   fixscript_register_native_func(heap, "tcp_connection_send_file#6", native_tcp_connection_send_file, NULL);
+   fixscript_register_native_func(heap, "tcp_connection_set_no_delay#2", native_tcp_connection_set_option, (void *)0);
+   fixscript_register_native_func(heap, "tcp_connection_set_cork#2", native_tcp_connection_set_option, (void *)1);
 
    fixscript_register_native_func(heap, "tcp_server_create#1", native_tcp_server_create, (void *)0);
    fixscript_register_native_func(heap, "tcp_server_create_local#1", native_tcp_server_create, (void *)1);
@@ -14581,11 +19965,40 @@ void fixio_register_functions(Heap *heap)
    fixscript_register_native_func(heap, "async_tcp_connection_open#4", native_async_tcp_connection_open, NULL);
    fixscript_register_native_func(heap, "async_tcp_connection_read#6", native_async_tcp_connection_read, NULL);
    fixscript_register_native_func(heap, "async_tcp_connection_write#6", native_async_tcp_connection_write, NULL);
+   fixscript_register_native_func(heap, "async_tcp_connection_writev#4", native_async_tcp_connection_writev, NULL);
+   fixscript_register_native_func(heap, "async_tcp_connection_send_file#7", native_async_tcp_connection_send_file, NULL);
+   fixscript_register_native_func(heap, "async_tcp_connection_set_no_delay#2", native_tcp_connection_set_option, (void *)2);
+   fixscript_register_native_func(heap, "async_tcp_connection_set_cork#2", native_tcp_connection_set_option, (void *)3);
    fixscript_register_native_func(heap, "async_tcp_connection_close#1", native_async_tcp_connection_close, NULL);
    fixscript_register_native_func(heap, "async_tcp_server_create#1", native_async_tcp_server_create, (void *)0);
    fixscript_register_native_func(heap, "async_tcp_server_create_local#1", native_async_tcp_server_create, (void *)1);
+   fixscript_register_native_func(heap, "async_tcp_server_create#2", native_async_tcp_server_create, (void *)0);
+   fixscript_register_native_func(heap, "async_tcp_server_create_local#2", native_async_tcp_server_create, (void *)1);
    fixscript_register_native_func(heap, "async_tcp_server_close#1", native_async_tcp_server_close, NULL);
    fixscript_register_native_func(heap, "async_tcp_server_accept#3", native_async_tcp_server_accept, NULL);
+
+   fixscript_register_native_func(heap, "tcp_connection_open_unix#1", native_tcp_connection_open, (void *)1);
+   fixscript_register_native_func(heap, "tcp_connection_send_connection#2", native_tcp_connection_send_connection, NULL);
+   fixscript_register_native_func(heap, "tcp_connection_receive_connection#2", native_tcp_connection_receive_connection, NULL);
+   fixscript_register_native_func(heap, "tcp_server_create_unix#1", native_tcp_server_create_unix, NULL);
+   fixscript_register_native_func(heap, "async_tcp_connection_open_unix#3", native_async_tcp_connection_open, (void *)1);
+   fixscript_register_native_func(heap, "async_tcp_connection_send_connection#4", native_async_tcp_connection_send_connection, NULL);
+   fixscript_register_native_func(heap, "async_tcp_connection_receive_connection#3", native_async_tcp_connection_receive_connection, NULL);
+   fixscript_register_native_func(heap, "async_tcp_server_create_unix#1", native_async_tcp_server_create_unix, NULL);
+
+   fixscript_register_native_func(heap, "udp_socket_create#1", native_udp_socket_create, (void *)0);
+   fixscript_register_native_func(heap, "udp_socket_create_local#1", native_udp_socket_create, (void *)1);
+   fixscript_register_native_func(heap, "udp_socket_close#1", native_udp_socket_close, NULL);
+   fixscript_register_native_func(heap, "udp_socket_get_port#1", native_udp_socket_get_port, NULL);
+   fixscript_register_native_func(heap, "udp_socket_resolve#1", native_udp_socket_resolve, NULL);
+   fixscript_register_native_func(heap, "udp_socket_receive#5", native_udp_socket_receive, NULL);
+   fixscript_register_native_func(heap, "udp_socket_send#4", native_udp_socket_send, NULL);
+   fixscript_register_native_func(heap, "async_udp_socket_create#1", native_async_udp_socket_create, (void *)0);
+   fixscript_register_native_func(heap, "async_udp_socket_create_local#1", native_async_udp_socket_create, (void *)1);
+   fixscript_register_native_func(heap, "async_udp_socket_close#1", native_async_udp_socket_close, NULL);
+   fixscript_register_native_func(heap, "async_udp_socket_get_port#1", native_async_udp_socket_get_port, NULL);
+   fixscript_register_native_func(heap, "async_udp_socket_receive#6", native_async_udp_socket_receive, NULL);
+   fixscript_register_native_func(heap, "async_udp_socket_send#6", native_async_udp_socket_send, NULL);
    fixscript_register_native_func(heap, "async_process#0", native_async_process, NULL);
    fixscript_register_native_func(heap, "async_process#1", native_async_process, NULL);
    fixscript_register_native_func(heap, "async_run_later#3", native_async_run_later, NULL);
@@ -14602,6 +20015,11 @@ void fixio_register_functions(Heap *heap)
    fixscript_register_native_func(heap, "process_close_in#1", native_process_close, (void *)0);
    fixscript_register_native_func(heap, "process_close_out#1", native_process_close, (void *)1);
    fixscript_register_native_func(heap, "process_close_err#1", native_process_close, (void *)2);
+   fixscript_register_native_func(heap, "async_process_stream_open#2", native_async_process_stream_open, NULL);
+   fixscript_register_native_func(heap, "async_process_stream_read#6", native_async_process_stream_read, NULL);
+   fixscript_register_native_func(heap, "async_process_stream_write#6", native_async_process_stream_write, NULL);
+   fixscript_register_native_func(heap, "async_process_stream_close#1", native_async_process_stream_close, NULL);
+   fixscript_register_native_func(heap, "async_process_splice#5", native_async_process_splice, NULL);
    fixscript_register_native_func(heap, "process_wait#1", native_process_wait, NULL);
    fixscript_register_native_func(heap, "process_kill#1", native_process_kill, NULL);
    fixscript_register_native_func(heap, "process_kill#2", native_process_kill, NULL);
@@ -14750,6 +20168,13 @@ void fixio_integrate_event_loop(Heap *heap, IOEventNotifyFunc notify_func, void
    async_process_ref(proc);
    proc->foreign_notify_func = notify_func;
    proc->foreign_notify_data = notify_data;
+#ifdef USE_IO_URING
+   if (proc->ring) {
+      // the waiting is done in other thread so the operations must be submitted directly:
+      proc->ring->immediate = 1;
+      ring_submit(proc->ring);
+   }
+#endif
 
    if (pthread_mutex_init(&proc->foreign_mutex, NULL) != 0) {
       fprintf(stderr, "can't initialize mutex for foreign event loop integration!\n");
@@ -66,6 +66,9 @@
 #include <unistd.h>
 #endif
 #endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "fixscript.h"
 
 #ifdef _WIN32
@@ -217,6 +220,7 @@ struct Heap {
 
    DynArray native_functions;
    StringHash native_functions_hash;
+   Value fast_native_error;
 
    DynArray error_stack;
 
@@ -238,6 +242,8 @@ struct Heap {
 
    uint64_t time_limit;
    int time_counter;
+
+   int lazy_compilation;
    volatile int stop_execution;
 
    char *compiler_error;
@@ -272,6 +278,7 @@ struct Heap {
    int jit_entry_func_end;
 #ifdef JIT_X86_64
    int jit_reinit_regs_func;
+   int jit_lazy_compile_code;
 #endif
    int jit_error_code;
    int jit_invalid_array_stack_error_code;
@@ -280,6 +287,7 @@ struct Heap {
    int jit_out_of_memory_stack_error_code;
    int jit_upgrade_code[6];
    DynArray jit_pc_mappings;
+   DynArray jit_pc_remaps;
    DynArray jit_heap_data_refs;
    DynArray jit_array_get_refs;
    DynArray jit_array_set_refs;
@@ -358,6 +366,10 @@ typedef struct {
    int max_stack;
 #ifndef FIXSCRIPT_NO_JIT
    int jit_addr;
+   int jit_lazy;
+   int jit_pc_base, jit_pc_len;
+   int reload_id;
+   uint64_t jit_hash;
 #endif
 } Function;
 
@@ -367,6 +379,9 @@ typedef struct {
    int id;
    int num_params;
    int bytecode_ident_pc;
+   FastNativeFunc fast_func;
+   void *fast_data;
+   char fast_sig[6];
 } NativeFunction;
 
 struct Script {
@@ -736,7 +751,10 @@ void fixembed_dump_tokens(const char *fname, Tokenizer *tok);
 #ifndef FIXSCRIPT_NO_JIT
 static void jit_update_exec(Heap *heap, int exec);
 static const char *jit_compile(Heap *heap, int func_start);
+static const char *jit_compile_functions(Heap *heap, int func_start, Function *lazy_func);
 static void jit_update_heap_refs(Heap *heap);
+static void jit_update_heap_refs_range(Heap *heap, int heap_data_refs, int array_get_refs, int array_set_refs, int array_append_refs, int length_refs, int adjustments);
+static int jit_remap_pc(Heap *heap, int pc);
 #endif
 
 #if !defined(_WIN32) && !defined(__SYMBIAN32__)
@@ -2450,6 +2468,64 @@ Value fixscript_create_or_get_shared_array(Heap *heap, int type, void *ptr, int
 }
 
 
+int fixscript_move_to_shared_array(Heap *heap, Value arr_val, Value *shared_val)
+{
+   Array *arr;
+   void *ptr;
+   int len, size, elem_size;
+
+   if (!arr_val.is_array || arr_val.value <= 0 || arr_val.value >= heap->size) {
+      return FIXSCRIPT_ERR_INVALID_ACCESS;
+   }
+
+   arr = &heap->data[arr_val.value];
+   if (arr->len == -1 || arr->hash_slots >= 0 || arr->is_handle) {
+      return FIXSCRIPT_ERR_INVALID_ACCESS;
+   }
+
+   if (arr->is_shared) {
+      add_root(heap, arr_val);
+      *shared_val = arr_val;
+      return FIXSCRIPT_SUCCESS;
+   }
+
+   if (arr->is_const) {
+      return FIXSCRIPT_ERR_CONST_WRITE;
+   }
+
+   if (!flags_is_array_clear_in_range(arr, 0, arr->len)) {
+      return FIXSCRIPT_ERR_INVALID_SHARED_ARRAY_OPERATION;
+   }
+
+   elem_size = arr->type == ARR_BYTE? 1 : arr->type == ARR_SHORT? 2 : 4;
+   len = arr->len;
+   if (len == 0) {
+      *shared_val = fixscript_create_shared_array(heap, 0, elem_size);
+      return shared_val->value? FIXSCRIPT_SUCCESS : FIXSCRIPT_ERR_OUT_OF_MEMORY;
+   }
+
+   // the data buffer is taken over by the shared array, the original array is left empty:
+   ptr = arr->data;
+   size = arr->size;
+   arr->data = NULL;
+   arr->size = 0;
+   arr->len = 0;
+
+   // the free function is set only after success so the buffer can be given back on failure:
+   *shared_val = create_shared_array_from(heap, -1, ptr, len, elem_size, NULL, ptr, NULL, NULL);
+   if (!shared_val->value) {
+      arr = &heap->data[arr_val.value];
+      arr->data = ptr;
+      arr->size = size;
+      arr->len = len;
+      return FIXSCRIPT_ERR_OUT_OF_MEMORY;
+   }
+   ARRAY_SHARED_HEADER(&heap->data[shared_val->value])->free_func = free;
+   heap->total_size -= (int64_t)size * elem_size;
+   return FIXSCRIPT_SUCCESS;
+}
+
+
 int fixscript_set_array_length(Heap *heap, Value arr_val, int len)
 {
    Array *arr;
@@ -4876,6 +4952,10 @@ static void add_stack_entry(Heap *heap, Value trace, int pc)
    Constant *constant;
    char *buf;
 
+#ifndef FIXSCRIPT_NO_JIT
+   pc = jit_remap_pc(heap, pc);
+#endif
+
    for (i=0; i<heap->native_functions.len; i++) {
       nfunc = heap->native_functions.data[i];
       if (pc == nfunc->bytecode_ident_pc) {
@@ -5571,208 +5651,888 @@ static Value builtin_array_fill(Heap *heap, Value *error, int num_params, Value
 }
 
 
-static Value builtin_array_extract(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static int get_double_array(Heap *heap, Value arr_val, int off, int count, int write, Array **arr_out)
 {
-   Value array, new_array;
-   int off, count;
-   int ret;
+   Array *arr;
+   int err;
 
-   if (!fixscript_is_int(params[1])) {
-      *error = fixscript_create_error_string(heap, "off must be an integer");
-      return fixscript_int(0);
-   }
-   if (!fixscript_is_int(params[2])) {
-      *error = fixscript_create_error_string(heap, "count must be an integer");
-      return fixscript_int(0);
+   if (!arr_val.is_array || arr_val.value <= 0 || arr_val.value >= heap->size) {
+      return FIXSCRIPT_ERR_INVALID_ACCESS;
    }
 
-   array = params[0];
-   off = fixscript_get_int(params[1]);
-   count = fixscript_get_int(params[2]);
-
-   if (off < 0) {
-      *error = fixscript_create_error_string(heap, "negative off");
-      return fixscript_int(0);
-   }
-   if (count < 0) {
-      *error = fixscript_create_error_string(heap, "negative count");
-      return fixscript_int(0);
+   arr = &heap->data[arr_val.value];
+   if (arr->len == -1 || arr->hash_slots >= 0) {
+      return FIXSCRIPT_ERR_INVALID_ACCESS;
    }
 
-   new_array = fixscript_create_array(heap, count);
-   if (!new_array.value) {
-      *error = fixscript_create_error_string(heap, "out of memory");
-      return fixscript_int(0);
+   if (off < 0 || count < 0 || ((int64_t)off)*2 + ((int64_t)count)*2 > ((int64_t)arr->len)) {
+      return FIXSCRIPT_ERR_OUT_OF_BOUNDS;
    }
-   if (fixscript_is_array(heap, array)) {
-      heap->data[new_array.value].is_string = heap->data[array.value].is_string;
+
+   if (write && arr->is_const) {
+      return FIXSCRIPT_ERR_CONST_WRITE;
    }
 
-   ret = fixscript_copy_array(heap, new_array, 0, array, off, count);
-   if (ret != FIXSCRIPT_SUCCESS) {
-      return fixscript_error(heap, error, ret);
+   // only the written arrays are upgraded, the reading handles the smaller types:
+   if (write && arr->type != ARR_INT) {
+      err = upgrade_array(heap, arr, arr_val.value, -1);
+      if (err) {
+         return err;
+      }
    }
 
-   return new_array;
+   *arr_out = arr;
+   return FIXSCRIPT_SUCCESS;
 }
 
 
-static Value builtin_array_insert(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static inline double load_double(int *data)
 {
-   Value array, value;
-   int off;
-   int err, len;
-   int64_t new_len;
+   union {
+      double d;
+      uint64_t i;
+   } u;
 
-   if (!fixscript_is_int(params[1])) {
-      *error = fixscript_create_error_string(heap, "off must be an integer");
-      return fixscript_int(0);
-   }
+   u.i = ((uint64_t)(uint32_t)data[0]) | (((uint64_t)(uint32_t)data[1]) << 32);
+   return u.d;
+}
 
-   array = params[0];
-   off = fixscript_get_int(params[1]);
-   value = params[2];
 
-   if (off < 0) {
-      *error = fixscript_create_error_string(heap, "negative off");
-      return fixscript_int(0);
-   }
+static inline double load_array_double(Array *arr, int idx)
+{
+   int value[2];
 
-   err = fixscript_get_array_length(heap, array, &len);
-   if (err) {
-      return fixscript_error(heap, error, err);
+   if (arr->type == ARR_INT) {
+      return load_double(arr->data + idx*2);
    }
+   value[0] = get_array_value(arr, idx*2+0);
+   value[1] = get_array_value(arr, idx*2+1);
+   return load_double(value);
+}
 
-   new_len = ((int64_t)len) + ((int64_t)1);
-   if (new_len > INT_MAX) {
-      *error = fixscript_create_error_string(heap, "array out of bounds access");
-      return fixscript_int(0);
-   }
 
-   err = fixscript_set_array_length(heap, array, (int)new_len);
-   if (err) {
-      return fixscript_error(heap, error, err);
-   }
+static inline void store_double(int *data, double value)
+{
+   union {
+      double d;
+      uint64_t i;
+   } u;
 
-   err = fixscript_copy_array(heap, array, off + 1, array, off, len - off);
-   if (err) {
-      return fixscript_error(heap, error, err);
+   u.d = value;
+   data[0] = (int)u.i;
+   data[1] = (int)(u.i >> 32);
+}
+
+
+static Value return_double(Value *error, double value)
+{
+   union {
+      double d;
+      uint64_t i;
+   } u;
+
+   u.d = value;
+   *error = fixscript_int((int)(u.i >> 32));
+   return fixscript_int((int)u.i);
+}
+
+
+static Value builtin_array_get_double(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Array *arr;
+   int idx, err;
+
+   if (!fixscript_is_int(params[1])) {
+      *error = fixscript_create_error_string(heap, "index must be an integer");
+      return fixscript_int(0);
    }
+   idx = fixscript_get_int(params[1]);
 
-   err = fixscript_set_array_elem(heap, array, off, value);
+   err = get_double_array(heap, params[0], idx, 1, 0, &arr);
    if (err) {
       return fixscript_error(heap, error, err);
    }
 
-   return fixscript_int(0);
+   *error = fixscript_int(get_array_value(arr, idx*2+1));
+   return fixscript_int(get_array_value(arr, idx*2+0));
 }
 
 
-static Value builtin_array_append(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value builtin_array_set_double(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   int64_t sum;
-   int err, len1, len2, off;
+   Array *arr;
+   int off=0, count=1;
+   int i, err;
+   int lo, hi;
 
-   err = fixscript_get_array_length(heap, params[0], &len1);
-   if (err) {
-      return fixscript_error(heap, error, err);
+   if (!fixscript_is_int(params[1])) {
+      *error = fixscript_create_error_string(heap, data? "off must be an integer" : "index must be an integer");
+      return fixscript_int(0);
    }
-
-   if (num_params == 4) {
-      off = fixscript_get_int(params[2]);
-      len2 = fixscript_get_int(params[3]);
-      if (off < 0 || len2 < 0) {
-         *error = fixscript_create_error_string(heap, "negative offset or count");
+   off = fixscript_get_int(params[1]);
+   if (data) {
+      if (!fixscript_is_int(params[2])) {
+         *error = fixscript_create_error_string(heap, "count must be an integer");
          return fixscript_int(0);
       }
+      count = fixscript_get_int(params[2]);
    }
-   else {
-      off = 0;
-      err = fixscript_get_array_length(heap, params[1], &len2);
-      if (err) {
-         return fixscript_error(heap, error, err);
-      }
-   }
+   lo = params[num_params-2].value;
+   hi = params[num_params-1].value;
 
-   sum = (int64_t)len1 + (int64_t)len2;
-   if (sum > 0xFFFFFFFF) {
-      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   err = get_double_array(heap, params[0], off, count, 1, &arr);
+   if (err) {
+      return fixscript_error(heap, error, err);
    }
 
-   err = fixscript_set_array_length(heap, params[0], (int)sum);
-   if (!err) {
-      err = fixscript_copy_array(heap, params[0], len1, params[1], off, len2);
+   for (i=0; i<count; i++) {
+      arr->data[(off+i)*2+0] = lo;
+      arr->data[(off+i)*2+1] = hi;
    }
-   if (err) {
-      return fixscript_error(heap, error, err);
+   if (!arr->is_shared) {
+      flags_clear_range(arr, off*2, count*2);
    }
    return fixscript_int(0);
 }
 
 
-static Value builtin_array_replace_range(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value builtin_array_add_double(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   int err, start, end, off, len, remove_len, old_len;
+   Array *dest, *src;
+   int *dest_data, *src_data;
+   int dest_off, src_off, count;
+   int i, err;
 
-   start = fixscript_get_int(params[1]);
-   end = fixscript_get_int(params[2]);
-   if (start < 0 || end < 0) {
-      *error = fixscript_create_error_string(heap, "negative start or end");
-      return fixscript_int(0);
-   }
-   if (start > end) {
-      *error = fixscript_create_error_string(heap, "invalid range");
+   if (!fixscript_is_int(params[1]) || !fixscript_is_int(params[3]) || !fixscript_is_int(params[4])) {
+      *error = fixscript_create_error_string(heap, "offsets and count must be integers");
       return fixscript_int(0);
    }
+   dest_off = fixscript_get_int(params[1]);
+   src_off = fixscript_get_int(params[3]);
+   count = fixscript_get_int(params[4]);
 
-   if (num_params == 6) {
-      off = fixscript_get_int(params[4]);
-      len = fixscript_get_int(params[5]);
-      if (off < 0 || len < 0) {
-         *error = fixscript_create_error_string(heap, "negative offset or length");
-         return fixscript_int(0);
-      }
-   }
-   else {
-      off = 0;
-      err = fixscript_get_array_length(heap, params[3], &len);
-      if (err) {
-         return fixscript_error(heap, error, err);
-      }
+   err = get_double_array(heap, params[0], dest_off, count, 1, &dest);
+   if (!err) {
+      err = get_double_array(heap, params[2], src_off, count, 0, &src);
    }
-
-   err = fixscript_get_array_length(heap, params[0], &old_len);
    if (err) {
       return fixscript_error(heap, error, err);
    }
 
-   remove_len = end - start;
-   if (len >= remove_len) {
-      err = fixscript_set_array_length(heap, params[0], old_len + (len - remove_len));
-      if (!err) {
-         err = fixscript_copy_array(heap, params[0], start + len, params[0], end, old_len - end);
+   dest_data = dest->data + dest_off*2;
+   src_data = src->type == ARR_INT? src->data + src_off*2 : NULL;
+   if (!src_data) {
+      // can't be the same array as the destination which is always upgraded:
+      for (i=0; i<count; i++) {
+         store_double(dest_data + i*2, load_double(dest_data + i*2) + load_array_double(src, src_off+i));
+      }
+   }
+   else if (dest_data > src_data) {
+      for (i=count-1; i>=0; i--) {
+         store_double(dest_data + i*2, load_double(dest_data + i*2) + load_double(src_data + i*2));
       }
    }
    else {
-      err = fixscript_copy_array(heap, params[0], start + len, params[0], end, old_len - end);
-      if (!err) {
-         err = fixscript_set_array_length(heap, params[0], old_len + (len - remove_len));
+      for (i=0; i<count; i++) {
+         store_double(dest_data + i*2, load_double(dest_data + i*2) + load_double(src_data + i*2));
       }
    }
+   if (!dest->is_shared) {
+      flags_clear_range(dest, dest_off*2, count*2);
+   }
+   return fixscript_int(0);
+}
 
-   if (!err) {
-      err = fixscript_copy_array(heap, params[0], start, params[3], off, len);
+
+static Value builtin_array_scale_double(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Array *arr;
+   int *arr_data;
+   int off, count;
+   int i, err;
+   int value[2];
+   double factor;
+
+   if (!fixscript_is_int(params[1]) || !fixscript_is_int(params[2])) {
+      *error = fixscript_create_error_string(heap, "off and count must be integers");
+      return fixscript_int(0);
    }
+   off = fixscript_get_int(params[1]);
+   count = fixscript_get_int(params[2]);
+   value[0] = params[3].value;
+   value[1] = params[4].value;
+   factor = load_double(value);
+
+   err = get_double_array(heap, params[0], off, count, 1, &arr);
    if (err) {
       return fixscript_error(heap, error, err);
    }
+
+   arr_data = arr->data + off*2;
+   for (i=0; i<count; i++) {
+      store_double(arr_data + i*2, load_double(arr_data + i*2) * factor);
+   }
+   if (!arr->is_shared) {
+      flags_clear_range(arr, off*2, count*2);
+   }
    return fixscript_int(0);
 }
 
 
-static Value builtin_array_insert_array(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value builtin_array_sum_double(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   Value p[6];
+   Array *arr;
+   int *arr_data;
+   int off, count;
+   int i, err;
+   double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+   if (!fixscript_is_int(params[1]) || !fixscript_is_int(params[2])) {
+      *error = fixscript_create_error_string(heap, "off and count must be integers");
+      return fixscript_int(0);
+   }
+   off = fixscript_get_int(params[1]);
+   count = fixscript_get_int(params[2]);
+
+   err = get_double_array(heap, params[0], off, count, 0, &arr);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   if (arr->type != ARR_INT) {
+      for (i=0; i<count; i++) {
+         sum[0] += load_array_double(arr, off+i);
+      }
+      return return_double(error, sum[0]);
+   }
+
+   // independent partial sums allow the compiler to use packed additions:
+   arr_data = arr->data + off*2;
+   for (i=0; i+4<=count; i+=4) {
+      sum[0] += load_double(arr_data + i*2+0);
+      sum[1] += load_double(arr_data + i*2+2);
+      sum[2] += load_double(arr_data + i*2+4);
+      sum[3] += load_double(arr_data + i*2+6);
+   }
+   for (; i<count; i++) {
+      sum[0] += load_double(arr_data + i*2);
+   }
+   return return_double(error, (sum[0] + sum[1]) + (sum[2] + sum[3]));
+}
+
+
+static Value builtin_array_dot_double(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Array *arr1, *arr2;
+   int *data1, *data2;
+   int off1, off2, count;
+   int i, err;
+   double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+   if (!fixscript_is_int(params[1]) || !fixscript_is_int(params[3]) || !fixscript_is_int(params[4])) {
+      *error = fixscript_create_error_string(heap, "offsets and count must be integers");
+      return fixscript_int(0);
+   }
+   off1 = fixscript_get_int(params[1]);
+   off2 = fixscript_get_int(params[3]);
+   count = fixscript_get_int(params[4]);
+
+   err = get_double_array(heap, params[0], off1, count, 0, &arr1);
+   if (!err) {
+      err = get_double_array(heap, params[2], off2, count, 0, &arr2);
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   if (arr1->type != ARR_INT || arr2->type != ARR_INT) {
+      for (i=0; i<count; i++) {
+         sum[0] += load_array_double(arr1, off1+i) * load_array_double(arr2, off2+i);
+      }
+      return return_double(error, sum[0]);
+   }
+
+   data1 = arr1->data + off1*2;
+   data2 = arr2->data + off2*2;
+   for (i=0; i+4<=count; i+=4) {
+      sum[0] += load_double(data1 + i*2+0) * load_double(data2 + i*2+0);
+      sum[1] += load_double(data1 + i*2+2) * load_double(data2 + i*2+2);
+      sum[2] += load_double(data1 + i*2+4) * load_double(data2 + i*2+4);
+      sum[3] += load_double(data1 + i*2+6) * load_double(data2 + i*2+6);
+   }
+   for (; i<count; i++) {
+      sum[0] += load_double(data1 + i*2) * load_double(data2 + i*2);
+   }
+   return return_double(error, (sum[0] + sum[1]) + (sum[2] + sum[3]));
+}
+
+
+static int find_raw_value(Array *arr, int off, int end, int value)
+{
+   void *ptr;
+   int i;
+#ifdef __SSE2__
+   __m128i cmp;
+   int mask;
+#endif
+
+   switch (arr->type) {
+      case ARR_BYTE:
+         if (value < 0 || value > 0xFF) return -1;
+         ptr = memchr(arr->byte_data + off, value, end - off);
+         return ptr? (int)((unsigned char *)ptr - arr->byte_data) : -1;
+
+      case ARR_SHORT:
+         if (value < 0 || value > 0xFFFF) return -1;
+         i = off;
+         #ifdef __SSE2__
+            cmp = _mm_set1_epi16((short)value);
+            for (; i+8<=end; i+=8) {
+               mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((__m128i *)(arr->short_data + i)), cmp));
+               if (mask) {
+                  return i + (__builtin_ctz(mask) >> 1);
+               }
+            }
+         #endif
+         for (; i<end; i++) {
+            if (arr->short_data[i] == value) return i;
+         }
+         return -1;
+
+      case ARR_INT:
+         i = off;
+         #ifdef __SSE2__
+            cmp = _mm_set1_epi32(value);
+            for (; i+4<=end; i+=4) {
+               mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(arr->data + i)), cmp));
+               if (mask) {
+                  return i + (__builtin_ctz(mask) >> 2);
+               }
+            }
+         #endif
+         for (; i<end; i++) {
+            if (arr->data[i] == value) return i;
+         }
+         return -1;
+   }
+   return -1;
+}
+
+
+static int find_raw_mismatch(Array *arr1, int off1, Array *arr2, int off2, int count)
+{
+   int i = 0;
+#ifdef __SSE2__
+   int mask;
+#endif
+
+   if (arr1->type != arr2->type) {
+      for (i=0; i<count; i++) {
+         if (get_array_value(arr1, off1+i) != get_array_value(arr2, off2+i)) return i;
+      }
+      return -1;
+   }
+
+   switch (arr1->type) {
+      case ARR_BYTE:
+         #ifdef __SSE2__
+            for (; i+16<=count; i+=16) {
+               mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(arr1->byte_data + off1 + i)), _mm_loadu_si128((__m128i *)(arr2->byte_data + off2 + i))));
+               if (mask != 0xFFFF) {
+                  return i + __builtin_ctz(~mask);
+               }
+            }
+         #endif
+         for (; i<count; i++) {
+            if (arr1->byte_data[off1+i] != arr2->byte_data[off2+i]) return i;
+         }
+         return -1;
+
+      case ARR_SHORT:
+         #ifdef __SSE2__
+            for (; i+8<=count; i+=8) {
+               mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((__m128i *)(arr1->short_data + off1 + i)), _mm_loadu_si128((__m128i *)(arr2->short_data + off2 + i))));
+               if (mask != 0xFFFF) {
+                  return i + (__builtin_ctz(~mask) >> 1);
+               }
+            }
+         #endif
+         for (; i<count; i++) {
+            if (arr1->short_data[off1+i] != arr2->short_data[off2+i]) return i;
+         }
+         return -1;
+
+      case ARR_INT:
+         #ifdef __SSE2__
+            for (; i+4<=count; i+=4) {
+               mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(arr1->data + off1 + i)), _mm_loadu_si128((__m128i *)(arr2->data + off2 + i))));
+               if (mask != 0xFFFF) {
+                  return i + (__builtin_ctz(~mask) >> 2);
+               }
+            }
+         #endif
+         for (; i<count; i++) {
+            if (arr1->data[off1+i] != arr2->data[off2+i]) return i;
+         }
+         return -1;
+   }
+   return -1;
+}
+
+
+static int get_array_range(Heap *heap, Value arr_val, int off, int count, Array **arr_out)
+{
+   Array *arr;
+
+   if (!arr_val.is_array || arr_val.value <= 0 || arr_val.value >= heap->size) {
+      return FIXSCRIPT_ERR_INVALID_ACCESS;
+   }
+
+   arr = &heap->data[arr_val.value];
+   if (arr->len == -1 || arr->hash_slots >= 0) {
+      return FIXSCRIPT_ERR_INVALID_ACCESS;
+   }
+
+   if (off < 0 || count < 0 || ((int64_t)off) + ((int64_t)count) > ((int64_t)arr->len)) {
+      return FIXSCRIPT_ERR_OUT_OF_BOUNDS;
+   }
+
+   *arr_out = arr;
+   return FIXSCRIPT_SUCCESS;
+}
+
+
+static int find_in_array(Array *arr, int off, int end, Value value, int count_only)
+{
+   int i, cnt;
+
+   if (!count_only) {
+      if (arr->is_shared && value.is_array) {
+         return -1;
+      }
+      for (i=off; i<end; i++) {
+         i = find_raw_value(arr, i, end, value.value);
+         if (i < 0) break;
+         if (arr->is_shared || (IS_ARRAY(arr, i) != 0) == value.is_array) {
+            return i;
+         }
+      }
+      return -1;
+   }
+
+   cnt = 0;
+   if (arr->is_shared || (!value.is_array && flags_is_array_clear_in_range(arr, off, end - off))) {
+      if (arr->is_shared && value.is_array) {
+         return 0;
+      }
+      switch (arr->type) {
+         case ARR_BYTE:
+            for (i=off; i<end; i++) {
+               cnt += (arr->byte_data[i] == value.value);
+            }
+            break;
+
+         case ARR_SHORT:
+            for (i=off; i<end; i++) {
+               cnt += (arr->short_data[i] == value.value);
+            }
+            break;
+
+         case ARR_INT:
+            for (i=off; i<end; i++) {
+               cnt += (arr->data[i] == value.value);
+            }
+            break;
+      }
+   }
+   else {
+      for (i=off; i<end; i++) {
+         cnt += (get_array_value(arr, i) == value.value && (IS_ARRAY(arr, i) != 0) == value.is_array);
+      }
+   }
+   return cnt;
+}
+
+
+static Value builtin_array_find(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Array *arr;
+   Value value;
+   int off=0, count, err;
+
+   if (num_params == 4) {
+      if (!fixscript_is_int(params[1])) {
+         *error = fixscript_create_error_string(heap, "off must be an integer");
+         return fixscript_int(0);
+      }
+      if (!fixscript_is_int(params[2])) {
+         *error = fixscript_create_error_string(heap, "count must be an integer");
+         return fixscript_int(0);
+      }
+      off = fixscript_get_int(params[1]);
+      count = fixscript_get_int(params[2]);
+      value = params[3];
+   }
+   else {
+      value = params[1];
+      err = fixscript_get_array_length(heap, params[0], &count);
+      if (err) {
+         return fixscript_error(heap, error, err);
+      }
+   }
+
+   err = get_array_range(heap, params[0], off, count, &arr);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   return fixscript_int(find_in_array(arr, off, off + count, value, data == (void *)1));
+}
+
+
+// variant called directly by JIT for integer values (bit 0 of data is set for
+// array_count, bit 1 when the range is passed):
+static int fast_array_find(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   Array *arr;
+   Value error;
+   int off=0, count, value, err=0;
+
+   if ((intptr_t)data & 2) {
+      off = p2;
+      count = p3;
+      value = p4;
+   }
+   else {
+      value = p2;
+      err = fixscript_get_array_length(heap, (Value) { p1, 1 }, &count);
+   }
+
+   if (!err) {
+      err = get_array_range(heap, (Value) { p1, 1 }, off, count, &arr);
+   }
+   if (err) {
+      fixscript_error(heap, &error, err);
+      fixscript_set_fast_native_error(heap, error);
+      return 0;
+   }
+   return find_in_array(arr, off, off + count, fixscript_int(value), (intptr_t)data & 1);
+}
+
+
+static Value builtin_array_compare_range(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Array *arr1, *arr2;
+   int off1, off2, count;
+   int i, idx, flag1, flag2, value1, value2, err;
+
+   if (!fixscript_is_int(params[1]) || !fixscript_is_int(params[3]) || !fixscript_is_int(params[4])) {
+      *error = fixscript_create_error_string(heap, "offsets and count must be integers");
+      return fixscript_int(0);
+   }
+   off1 = fixscript_get_int(params[1]);
+   off2 = fixscript_get_int(params[3]);
+   count = fixscript_get_int(params[4]);
+
+   err = get_array_range(heap, params[0], off1, count, &arr1);
+   if (!err) {
+      err = get_array_range(heap, params[2], off2, count, &arr2);
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   if ((arr1->is_shared || flags_is_array_clear_in_range(arr1, off1, count)) && (arr2->is_shared || flags_is_array_clear_in_range(arr2, off2, count))) {
+      idx = find_raw_mismatch(arr1, off1, arr2, off2, count);
+      if (idx < 0) {
+         return fixscript_int(0);
+      }
+      return fixscript_int(get_array_value(arr1, off1+idx) < get_array_value(arr2, off2+idx)? -1 : 1);
+   }
+
+   for (i=0; i<count; i++) {
+      flag1 = arr1->is_shared? 0 : IS_ARRAY(arr1, off1+i) != 0;
+      flag2 = arr2->is_shared? 0 : IS_ARRAY(arr2, off2+i) != 0;
+      if (flag1 != flag2) {
+         return fixscript_int(flag1 < flag2? -1 : 1);
+      }
+      value1 = get_array_value(arr1, off1+i);
+      value2 = get_array_value(arr2, off2+i);
+      if (value1 != value2) {
+         return fixscript_int(value1 < value2? -1 : 1);
+      }
+   }
+   return fixscript_int(0);
+}
+
+
+static Value builtin_array_min_max(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Array *arr;
+   int off=0, count, end;
+   int i, min, max, err;
+
+   if (num_params == 3) {
+      if (!fixscript_is_int(params[1]) || !fixscript_is_int(params[2])) {
+         *error = fixscript_create_error_string(heap, "off and count must be integers");
+         return fixscript_int(0);
+      }
+      off = fixscript_get_int(params[1]);
+      count = fixscript_get_int(params[2]);
+   }
+   else {
+      err = fixscript_get_array_length(heap, params[0], &count);
+      if (err) {
+         return fixscript_error(heap, error, err);
+      }
+   }
+
+   err = get_array_range(heap, params[0], off, count, &arr);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   end = off + count;
+
+   if (count == 0) {
+      *error = fixscript_create_error_string(heap, "empty range");
+      return fixscript_int(0);
+   }
+   if (!arr->is_shared && !flags_is_array_clear_in_range(arr, off, count)) {
+      *error = fixscript_create_error_string(heap, "range must contain only integers");
+      return fixscript_int(0);
+   }
+
+   min = INT_MAX;
+   max = INT_MIN;
+   switch (arr->type) {
+      case ARR_BYTE:
+         for (i=off; i<end; i++) {
+            min = arr->byte_data[i] < min? arr->byte_data[i] : min;
+            max = arr->byte_data[i] > max? arr->byte_data[i] : max;
+         }
+         break;
+
+      case ARR_SHORT:
+         for (i=off; i<end; i++) {
+            min = arr->short_data[i] < min? arr->short_data[i] : min;
+            max = arr->short_data[i] > max? arr->short_data[i] : max;
+         }
+         break;
+
+      case ARR_INT:
+         for (i=off; i<end; i++) {
+            min = arr->data[i] < min? arr->data[i] : min;
+            max = arr->data[i] > max? arr->data[i] : max;
+         }
+         break;
+   }
+
+   *error = fixscript_int(max);
+   return fixscript_int(min);
+}
+
+
+static Value builtin_array_extract(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Value array, new_array;
+   int off, count;
+   int ret;
+
+   if (!fixscript_is_int(params[1])) {
+      *error = fixscript_create_error_string(heap, "off must be an integer");
+      return fixscript_int(0);
+   }
+   if (!fixscript_is_int(params[2])) {
+      *error = fixscript_create_error_string(heap, "count must be an integer");
+      return fixscript_int(0);
+   }
+
+   array = params[0];
+   off = fixscript_get_int(params[1]);
+   count = fixscript_get_int(params[2]);
+
+   if (off < 0) {
+      *error = fixscript_create_error_string(heap, "negative off");
+      return fixscript_int(0);
+   }
+   if (count < 0) {
+      *error = fixscript_create_error_string(heap, "negative count");
+      return fixscript_int(0);
+   }
+
+   new_array = fixscript_create_array(heap, count);
+   if (!new_array.value) {
+      *error = fixscript_create_error_string(heap, "out of memory");
+      return fixscript_int(0);
+   }
+   if (fixscript_is_array(heap, array)) {
+      heap->data[new_array.value].is_string = heap->data[array.value].is_string;
+   }
+
+   ret = fixscript_copy_array(heap, new_array, 0, array, off, count);
+   if (ret != FIXSCRIPT_SUCCESS) {
+      return fixscript_error(heap, error, ret);
+   }
+
+   return new_array;
+}
+
+
+static Value builtin_array_insert(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Value array, value;
+   int off;
+   int err, len;
+   int64_t new_len;
+
+   if (!fixscript_is_int(params[1])) {
+      *error = fixscript_create_error_string(heap, "off must be an integer");
+      return fixscript_int(0);
+   }
+
+   array = params[0];
+   off = fixscript_get_int(params[1]);
+   value = params[2];
+
+   if (off < 0) {
+      *error = fixscript_create_error_string(heap, "negative off");
+      return fixscript_int(0);
+   }
+
+   err = fixscript_get_array_length(heap, array, &len);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   new_len = ((int64_t)len) + ((int64_t)1);
+   if (new_len > INT_MAX) {
+      *error = fixscript_create_error_string(heap, "array out of bounds access");
+      return fixscript_int(0);
+   }
+
+   err = fixscript_set_array_length(heap, array, (int)new_len);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   err = fixscript_copy_array(heap, array, off + 1, array, off, len - off);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   err = fixscript_set_array_elem(heap, array, off, value);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   return fixscript_int(0);
+}
+
+
+static Value builtin_array_append(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   int64_t sum;
+   int err, len1, len2, off;
+
+   err = fixscript_get_array_length(heap, params[0], &len1);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   if (num_params == 4) {
+      off = fixscript_get_int(params[2]);
+      len2 = fixscript_get_int(params[3]);
+      if (off < 0 || len2 < 0) {
+         *error = fixscript_create_error_string(heap, "negative offset or count");
+         return fixscript_int(0);
+      }
+   }
+   else {
+      off = 0;
+      err = fixscript_get_array_length(heap, params[1], &len2);
+      if (err) {
+         return fixscript_error(heap, error, err);
+      }
+   }
+
+   sum = (int64_t)len1 + (int64_t)len2;
+   if (sum > 0xFFFFFFFF) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   err = fixscript_set_array_length(heap, params[0], (int)sum);
+   if (!err) {
+      err = fixscript_copy_array(heap, params[0], len1, params[1], off, len2);
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   return fixscript_int(0);
+}
+
+
+static Value builtin_array_replace_range(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   int err, start, end, off, len, remove_len, old_len;
+
+   start = fixscript_get_int(params[1]);
+   end = fixscript_get_int(params[2]);
+   if (start < 0 || end < 0) {
+      *error = fixscript_create_error_string(heap, "negative start or end");
+      return fixscript_int(0);
+   }
+   if (start > end) {
+      *error = fixscript_create_error_string(heap, "invalid range");
+      return fixscript_int(0);
+   }
+
+   if (num_params == 6) {
+      off = fixscript_get_int(params[4]);
+      len = fixscript_get_int(params[5]);
+      if (off < 0 || len < 0) {
+         *error = fixscript_create_error_string(heap, "negative offset or length");
+         return fixscript_int(0);
+      }
+   }
+   else {
+      off = 0;
+      err = fixscript_get_array_length(heap, params[3], &len);
+      if (err) {
+         return fixscript_error(heap, error, err);
+      }
+   }
+
+   err = fixscript_get_array_length(heap, params[0], &old_len);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   remove_len = end - start;
+   if (len >= remove_len) {
+      err = fixscript_set_array_length(heap, params[0], old_len + (len - remove_len));
+      if (!err) {
+         err = fixscript_copy_array(heap, params[0], start + len, params[0], end, old_len - end);
+      }
+   }
+   else {
+      err = fixscript_copy_array(heap, params[0], start + len, params[0], end, old_len - end);
+      if (!err) {
+         err = fixscript_set_array_length(heap, params[0], old_len + (len - remove_len));
+      }
+   }
+
+   if (!err) {
+      err = fixscript_copy_array(heap, params[0], start, params[3], off, len);
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   return fixscript_int(0);
+}
+
+
+static Value builtin_array_insert_array(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Value p[6];
 
    if (num_params == 3) {
       p[0] = params[0];
@@ -7543,6 +8303,19 @@ static Value builtin_token_escape_string(Heap *heap, Value *error, int num_param
 }
 
 
+// unlike fixscript_register_fast_native_func the native function is kept, it's used by the
+// interpreter and by JIT when the types of the parameters don't match the signature:
+static void register_fast_variant(Heap *heap, const char *name, FastNativeFunc func, const char *signature, void *data)
+{
+   NativeFunction *nfunc;
+
+   nfunc = string_hash_get(&heap->native_functions_hash, name);
+   nfunc->fast_func = func;
+   nfunc->fast_data = data;
+   strcpy(nfunc->fast_sig, signature);
+}
+
+
 Heap *fixscript_create_heap()
 {
    Heap *heap;
@@ -7601,6 +8374,24 @@ Heap *fixscript_create_heap()
    fixscript_register_native_func(heap, "array_copy#5", builtin_array_copy, NULL);
    fixscript_register_native_func(heap, "array_fill#2", builtin_array_fill, NULL);
    fixscript_register_native_func(heap, "array_fill#4", builtin_array_fill, NULL);
+   fixscript_register_native_func(heap, "array_get_double#2", builtin_array_get_double, NULL);
+   fixscript_register_native_func(heap, "array_set_double#4", builtin_array_set_double, (void *)0);
+   fixscript_register_native_func(heap, "array_fill_double#5", builtin_array_set_double, (void *)1);
+   fixscript_register_native_func(heap, "array_add_double#5", builtin_array_add_double, NULL);
+   fixscript_register_native_func(heap, "array_scale_double#5", builtin_array_scale_double, NULL);
+   fixscript_register_native_func(heap, "array_sum_double#3", builtin_array_sum_double, NULL);
+   fixscript_register_native_func(heap, "array_dot_double#5", builtin_array_dot_double, NULL);
+   fixscript_register_native_func(heap, "array_find#2", builtin_array_find, (void *)0);
+   fixscript_register_native_func(heap, "array_find#4", builtin_array_find, (void *)0);
+   fixscript_register_native_func(heap, "array_count#2", builtin_array_find, (void *)1);
+   fixscript_register_native_func(heap, "array_count#4", builtin_array_find, (void *)1);
+   register_fast_variant(heap, "array_find#2", fast_array_find, "iai", (void *)0);
+   register_fast_variant(heap, "array_find#4", fast_array_find, "iaiii", (void *)2);
+   register_fast_variant(heap, "array_count#2", fast_array_find, "iai", (void *)1);
+   register_fast_variant(heap, "array_count#4", fast_array_find, "iaiii", (void *)3);
+   fixscript_register_native_func(heap, "array_compare_range#5", builtin_array_compare_range, NULL);
+   fixscript_register_native_func(heap, "array_min_max#1", builtin_array_min_max, NULL);
+   fixscript_register_native_func(heap, "array_min_max#3", builtin_array_min_max, NULL);
    fixscript_register_native_func(heap, "array_extract#3", builtin_array_extract, NULL);
    fixscript_register_native_func(heap, "array_insert#3", builtin_array_insert, NULL);
    fixscript_register_native_func(heap, "array_insert_array#3", builtin_array_insert_array, NULL);
@@ -7857,6 +8648,7 @@ void fixscript_free_heap(Heap *heap)
          #endif
       }
       free(heap->jit_pc_mappings.data);
+      free(heap->jit_pc_remaps.data);
       free(heap->jit_heap_data_refs.data);
       free(heap->jit_array_get_refs.data);
       free(heap->jit_array_set_refs.data);
@@ -8082,6 +8874,18 @@ void *fixscript_get_heap_data(Heap *heap, int key)
 }
 
 
+void fixscript_set_lazy_compilation(Heap *heap, int enable)
+{
+   heap->lazy_compilation = enable != 0;
+}
+
+
+int fixscript_get_lazy_compilation(Heap *heap)
+{
+   return heap->lazy_compilation;
+}
+
+
 void fixscript_set_time_limit(Heap *heap, int limit)
 {
    if (limit < 0) {
@@ -15094,6 +15898,16 @@ static Script *load_script(Heap *heap, const char *src, const char *fname, Value
             if (!heap->token_dump_mode)
             #endif
             {
+               if (reload && par.old_script) {
+                  for (i=0; i<script->functions.size; i+=2) {
+                     if (script->functions.data[i+0]) {
+                        Function *old_func = string_hash_get(&par.old_script->functions, script->functions.data[i+0]);
+                        if (old_func) {
+                           ((Function *)script->functions.data[i+1])->reload_id = old_func->id;
+                        }
+                     }
+                  }
+               }
                jit_error = jit_compile(heap, state.functions_len);
                if (jit_error) {
                   heap->bytecode_size -= par.buf_len;
@@ -18298,13 +19112,88 @@ Value fixscript_call(Heap *heap, Value func, int num_params, Value *error, ...)
 }
 
 
-Value fixscript_call_args(Heap *heap, Value func, int num_params, Value *error, Value *args)
+Value fixscript_call_args(Heap *heap, Value func, int num_params, Value *error, Value *args)
+{
+#ifdef FIXSCRIPT_ASYNC
+   return call_func(heap, func, num_params, error, args, NULL, NULL, NULL);
+#else
+   return call_func(heap, func, num_params, error, args, NULL);
+#endif
+}
+
+
+static int check_fast_native_type(char type, Value value)
+{
+   switch (type) {
+      case 'i': return !value.is_array;
+      case 'f': return fixscript_is_float(value);
+      case 'a': return value.is_array && !fixscript_is_float(value);
+   }
+   return 0;
+}
+
+
+static Value fast_native_return_value(char type, int value)
+{
+   switch (type) {
+      case 'i': return fixscript_int(value);
+      case 'f':
+         // flush denormals to zero the same way as fixscript_float:
+         if ((value & (0xFF << 23)) == 0) {
+            value &= ~((1<<23)-1);
+         }
+         return (Value) { value, 1 };
+      case 'a': return (Value) { value, value != 0 };
+   }
+   return fixscript_int(0);
+}
+
+
+static Value fast_native_adapter(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   NativeFunction *nfunc = data;
+   int i, p[4] = { 0, 0, 0, 0 }, ret;
+
+   for (i=0; i<num_params; i++) {
+      if (!check_fast_native_type(nfunc->fast_sig[i+1], params[i])) {
+         *error = fixscript_create_error_string(heap, "invalid native function parameter type");
+         return fixscript_int(0);
+      }
+      p[i] = params[i].value;
+   }
+
+   ret = nfunc->fast_func(heap, nfunc->fast_data, p[0], p[1], p[2], p[3]);
+   if (heap->fast_native_error.value) {
+      *error = heap->fast_native_error;
+      heap->fast_native_error = fixscript_int(0);
+      return fixscript_int(0);
+   }
+   return fast_native_return_value(nfunc->fast_sig[0], ret);
+}
+
+
+static int fast_native_fallback(Heap *heap, void *data, int p1, int p2, int p3, int p4)
 {
-#ifdef FIXSCRIPT_ASYNC
-   return call_func(heap, func, num_params, error, args, NULL, NULL, NULL);
-#else
-   return call_func(heap, func, num_params, error, args, NULL);
-#endif
+   NativeFunction *nfunc = data;
+   Value params[4], ret, error = fixscript_int(0);
+   int i, p[4] = { p1, p2, p3, p4 };
+
+   for (i=0; i<nfunc->num_params; i++) {
+      params[i] = (Value) { p[i], nfunc->fast_sig[i+1] != 'i' };
+   }
+
+   ret = nfunc->func(heap, &error, nfunc->num_params, params, nfunc->data);
+   if (!error.value && nfunc->fast_sig[0] != 'v' && !check_fast_native_type(nfunc->fast_sig[0], ret)) {
+      if (nfunc->fast_sig[0] == 'a' && ret.value == 0) {
+         return 0;
+      }
+      error = fixscript_create_error_string(heap, "invalid native function return type");
+   }
+   if (error.value) {
+      fixscript_set_fast_native_error(heap, error);
+      return 0;
+   }
+   return ret.value;
 }
 
 
@@ -18320,10 +19209,15 @@ void fixscript_register_native_func(Heap *heap, const char *name, NativeFunc fun
    if (nfunc) {
       nfunc->func = func;
       nfunc->data = data;
+      if (nfunc->fast_sig[0]) {
+         // already compiled code calls the fast variant directly:
+         nfunc->fast_func = fast_native_fallback;
+         nfunc->fast_data = nfunc;
+      }
       return;
    }
 
-   nfunc = malloc(sizeof(NativeFunction));
+   nfunc = calloc(1, sizeof(NativeFunction));
    nfunc->func = func;
    nfunc->data = data;
    nfunc->id = heap->native_functions.len;
@@ -18338,6 +19232,45 @@ void fixscript_register_native_func(Heap *heap, const char *name, NativeFunc fun
 }
 
 
+void fixscript_register_fast_native_func(Heap *heap, const char *name, FastNativeFunc func, const char *signature, void *data)
+{
+   NativeFunction *nfunc;
+   char *s;
+   int i, len;
+
+   s = strrchr(name, '#');
+   if (!s) return;
+
+   len = strlen(signature);
+   if (len < 1 || len-1 != atoi(s+1) || len-1 > 4) return;
+   if (!strchr("vifa", signature[0])) return;
+   for (i=1; i<len; i++) {
+      if (!strchr("ifa", signature[i])) return;
+   }
+
+   nfunc = string_hash_get(&heap->native_functions_hash, name);
+   if (nfunc && nfunc->fast_sig[0] && strcmp(nfunc->fast_sig, signature) != 0) {
+      return;
+   }
+
+   fixscript_register_native_func(heap, name, fast_native_adapter, NULL);
+   nfunc = string_hash_get(&heap->native_functions_hash, name);
+   nfunc->data = nfunc;
+   nfunc->fast_func = func;
+   nfunc->fast_data = data;
+   strcpy(nfunc->fast_sig, signature);
+}
+
+
+void fixscript_set_fast_native_error(Heap *heap, Value error)
+{
+   if (error.is_array && !fixscript_is_float(error)) {
+      add_root(heap, error);
+   }
+   heap->fast_native_error = error;
+}
+
+
 NativeFunc fixscript_get_native_func(Heap *heap, const char *name, void **data)
 {
    NativeFunction *nfunc;
@@ -18687,6 +19620,26 @@ error:
 }
 
 
+// internal accessor for the test suite (not part of the public API), returns the offset
+// of the JIT code of the current version of the function or -1 when it wasn't compiled:
+int fixscript_get_function_jit_addr(Heap *heap, Value func_val)
+{
+#ifdef FIXSCRIPT_NO_JIT
+   return -1;
+#else
+   int func_id = func_val.value - FUNC_REF_OFFSET;
+   Function *func;
+
+   if (!func_val.is_array || func_id < 1 || func_id >= heap->functions.len) {
+      return -1;
+   }
+
+   func = heap->functions.data[func_id];
+   return func->jit_addr? func->jit_addr : -1;
+#endif
+}
+
+
 static void dump_heap_value(String *out, Heap *heap, Value value)
 {
    char buf[32], *s;
@@ -18973,7 +19926,8 @@ enum {
    JIT_ERROR_INVALID_FUNCREF,
    JIT_ERROR_IMPROPER_PARAMS,
    JIT_ERROR_EXECUTION_STOP,
-   JIT_ERROR_TIME_LIMIT
+   JIT_ERROR_TIME_LIMIT,
+   JIT_ERROR_NATIVE_PARAM_TYPE
 };
 
 #define JIT_PC_ERR(pc, err) (((pc) << 8) | (err))
@@ -19040,6 +19994,7 @@ static void jit_emit_error(Heap *heap, uint32_t pc_and_code)
       case JIT_ERROR_IMPROPER_PARAMS:  msg = "improper number of function parameters"; break;
       case JIT_ERROR_EXECUTION_STOP:   msg = "execution stop"; break;
       case JIT_ERROR_TIME_LIMIT:       msg = "execution time limit reached"; break;
+      case JIT_ERROR_NATIVE_PARAM_TYPE:msg = "invalid native function parameter type"; break;
 
       default:
          msg = "internal error: wrong JIT error";
@@ -19108,6 +20063,82 @@ error:
 }
 
 
+#ifdef JIT_X86_64
+static int jit_lazy_compile(Heap *heap, Function *func, void **native_ret, void **native_fp)
+{
+   StackBlock block;
+   const char *error;
+   int stub_addr = func->jit_addr, rel;
+
+   if (!func->jit_lazy) {
+      return func->jit_addr;
+   }
+
+   block.ret = native_ret;
+   block.fp = native_fp;
+   block.next = heap->jit_stack_block;
+   heap->jit_stack_block = &block;
+
+   error = jit_compile_functions(heap, 0, func);
+
+   heap->jit_stack_block = block.next;
+
+   if (error) {
+      func->jit_addr = stub_addr;
+      func->jit_lazy = 1;
+   }
+   else {
+      // redirect the stub directly to the compiled code:
+      rel = func->jit_addr - (stub_addr + 5);
+      heap->jit_code[stub_addr] = 0xE9;
+      memcpy(heap->jit_code + stub_addr + 1, &rel, 4);
+   }
+   jit_update_exec(heap, 1);
+
+   if (error) {
+      jit_return_error(heap, error, func->addr);
+      return 0;
+   }
+   return func->jit_addr;
+}
+#endif
+
+
+static int jit_fast_native_call(Heap *heap, NativeFunction *nfunc, int p1, int p2, int p3, int p4)
+{
+   int ret;
+
+   ret = nfunc->fast_func(heap, nfunc->fast_data, p1, p2, p3, p4);
+
+   // the code is made non-executable when the heap references are updated after
+   // the heap has grown, it must be executable again before returning to it:
+   jit_update_exec(heap, 1);
+   return ret;
+}
+
+
+static int jit_fast_native_finish(Heap *heap)
+{
+   Value error = heap->fast_native_error;
+
+   clear_roots(heap);
+   jit_update_exec(heap, 1);
+
+   if (!error.value) {
+      return 1;
+   }
+
+   heap->fast_native_error = fixscript_int(0);
+   heap->stack_len = heap->jit_error_base;
+   heap->stack_data[heap->stack_len+0] = 0;
+   heap->stack_flags[heap->stack_len+0] = 0;
+   heap->stack_data[heap->stack_len+1] = error.value;
+   heap->stack_flags[heap->stack_len+1] = error.is_array;
+   heap->stack_len += 2;
+   return 0;
+}
+
+
 static int jit_string_concat(Heap *heap, int num, int pc)
 {
    Value value, result;
@@ -19335,6 +20366,51 @@ static int jit_get_pc(Heap *heap, void *ptr)
 }
 
 
+// the reused JIT code refers to the bytecode of the function it was compiled from,
+// the remaps translate such PCs to the current version of the function:
+static int jit_reserve_pc_remap(Heap *heap, int base, int len)
+{
+   int i;
+
+   for (i=0; i<heap->jit_pc_remaps.len; i+=3) {
+      if ((intptr_t)heap->jit_pc_remaps.data[i+0] == base) {
+         return 1;
+      }
+   }
+   if (dynarray_add(&heap->jit_pc_remaps, (void *)(intptr_t)base)) return 0;
+   if (dynarray_add(&heap->jit_pc_remaps, (void *)(intptr_t)len)) return 0;
+   if (dynarray_add(&heap->jit_pc_remaps, (void *)(intptr_t)base)) return 0;
+   return 1;
+}
+
+
+static void jit_set_pc_remap(Heap *heap, int base, int target)
+{
+   int i;
+
+   for (i=0; i<heap->jit_pc_remaps.len; i+=3) {
+      if ((intptr_t)heap->jit_pc_remaps.data[i+0] == base) {
+         heap->jit_pc_remaps.data[i+2] = (void *)(intptr_t)target;
+         return;
+      }
+   }
+}
+
+
+static int jit_remap_pc(Heap *heap, int pc)
+{
+   int i, base;
+
+   for (i=0; i<heap->jit_pc_remaps.len; i+=3) {
+      base = (intptr_t)heap->jit_pc_remaps.data[i+0];
+      if (pc >= base && pc < base + (intptr_t)heap->jit_pc_remaps.data[i+1]) {
+         return pc - base + (intptr_t)heap->jit_pc_remaps.data[i+2];
+      }
+   }
+   return pc;
+}
+
+
 static int jit_add_heap_data_ref(Heap *heap)
 {
    if (dynarray_add(&heap->jit_heap_data_refs, (void *)(intptr_t)heap->jit_code_len)) return 0;
@@ -19565,6 +20641,7 @@ static inline int jit_append8(Heap *heap, uint64_t value, int len)
 #define cmp____BYTE_PTR_resi_imm32__bl(value)        JIT_APPEND(2, 0x38,0x9E); JIT_APPEND_INT(value)
 #define cmp____DWORD_PTR_recx_imm8__imm8(val1, val2) JIT_APPEND(2, 0x83,0x79); JIT_APPEND_BYTE(val1); JIT_APPEND_BYTE(val2)
 #define cmp____DWORD_PTR_recx_imm8__imm32(val1, val2)JIT_APPEND(2, 0x81,0x79); JIT_APPEND_BYTE(val1); JIT_APPEND_INT(val2)
+#define cmp____DWORD_PTR_rebx_imm32__imm8(val1, val2)JIT_APPEND(2, 0x83,0xBB); JIT_APPEND_INT(val1); JIT_APPEND_BYTE(val2)
 #define dec____eax()                                 JIT_APPEND(1, 0x48)
 #define dec____edx()                                 JIT_APPEND(1, 0x4A)
 #define dec____DWORD_PTR_redx_imm32(value)           JIT_APPEND(2, 0xFF,0x8A); JIT_APPEND_INT(value)
@@ -19621,6 +20698,7 @@ static inline int jit_append8(Heap *heap, uint64_t value, int len)
 #define inc____DWORD_PTR_redi_imm8(value)            JIT_APPEND(2, 0xFF,0x47); JIT_APPEND_BYTE(value)
 #define inc____DWORD_PTR_redi_imm32(value)           JIT_APPEND(2, 0xFF,0x87); JIT_APPEND_INT(value)
 #define ja_____rel8(value)                           JIT_APPEND(1, 0x77); JIT_APPEND_BYTE(value)
+#define jae____rel8(value)                           JIT_APPEND(1, 0x73); JIT_APPEND_BYTE(value)
 #define jae____rel32(value)                          JIT_APPEND(2, 0x0F,0x83); JIT_APPEND_INT(value)
 #define jb_____rel8(value)                           JIT_APPEND(1, 0x72); JIT_APPEND_BYTE(value)
 #define jb_____rel32(value)                          JIT_APPEND(2, 0x0F,0x82); JIT_APPEND_INT(value)
@@ -19832,6 +20910,7 @@ static inline int jit_append8(Heap *heap, uint64_t value, int len)
 #define addss__xmm0__DWORD_PTR_rdi_imm32(value)      JIT_APPEND(4, 0xF3,0x0F,0x58,0x87); JIT_APPEND_INT(value)
 #define call___rdx()                                 JIT_APPEND(2, 0xFF,0xD2)
 #define call___rsi()                                 JIT_APPEND(2, 0xFF,0xD6)
+#define call___QWORD_PTR_rax_imm8(value)             JIT_APPEND(2, 0xFF,0x50); JIT_APPEND_BYTE(value)
 #define cmp____rax__r8()                             JIT_APPEND(3, 0x4C,0x39,0xC0)
 #define cmp____rcx__imm8(value)                      JIT_APPEND(3, 0x48,0x83,0xF9); JIT_APPEND_BYTE(value)
 #define cmpsd__xmm0__xmm1(value)                     JIT_APPEND(4, 0xF2,0x0F,0xC2,0xC1); JIT_APPEND_BYTE(value)
@@ -19891,6 +20970,7 @@ static inline int jit_append8(Heap *heap, uint64_t value, int len)
 #define mov____esi__DWORD_PTR_redi_imm8(value)       JIT_APPEND(2, 0x8B,0x77); JIT_APPEND_BYTE(value)
 #define mov____esi__DWORD_PTR_redi_imm32(value)      JIT_APPEND(2, 0x8B,0xB7); JIT_APPEND_INT(value)
 #define mov____rsi__imm64(value)                     JIT_APPEND(2, 0x48,0xBE); JIT_APPEND_LONG(value)
+#define mov____rsi__rax()                            JIT_APPEND(3, 0x48,0x89,0xC6)
 #define mov____rsi__rbx()                            JIT_APPEND(3, 0x48,0x89,0xDE)
 #define mov____rdi__r12()                            JIT_APPEND(3, 0x4C,0x89,0xE7)
 #define mov____r8d__eax()                            JIT_APPEND(3, 0x41,0x89,0xC0)
@@ -19906,6 +20986,7 @@ static inline int jit_append8(Heap *heap, uint64_t value, int len)
 #define mov____rsi__QWORD_PTR_rsp()                  JIT_APPEND(4, 0x48,0x8B,0x34,0x24)
 #define mov____esi__DWORD_PTR_r12_imm8(value)        JIT_APPEND(4, 0x41,0x8B,0x74,0x24); JIT_APPEND_BYTE(value)
 #define mov____rsi__QWORD_PTR_rdx_imm8(value)        JIT_APPEND(3, 0x48,0x8B,0x72); JIT_APPEND_BYTE(value)
+#define mov____rsi__QWORD_PTR_rax_imm8(value)        JIT_APPEND(3, 0x48,0x8B,0x70); JIT_APPEND_BYTE(value)
 #define mov____rdi__QWORD_PTR_rdx_imm8(value)        JIT_APPEND(3, 0x48,0x8B,0x7A); JIT_APPEND_BYTE(value)
 #define mov____rbp__rsp()                            JIT_APPEND(3, 0x48,0x89,0xE5)
 #define mov____rsp__rbp()                            JIT_APPEND(3, 0x48,0x89,0xEC)
@@ -19914,6 +20995,8 @@ static inline int jit_append8(Heap *heap, uint64_t value, int len)
 #define mov____r8__r12()                             JIT_APPEND(3, 0x4D,0x89,0xE0)
 #define mov____r8__imm64(value)                      JIT_APPEND(2, 0x49,0xB8); JIT_APPEND_LONG(value)
 #define mov____r9d__edx()                            JIT_APPEND(3, 0x41,0x89,0xD1)
+#define mov____r9d__DWORD_PTR_rdi_imm8(value)        JIT_APPEND(3, 0x44,0x8B,0x4F); JIT_APPEND_BYTE(value)
+#define mov____r9d__DWORD_PTR_rdi_imm32(value)       JIT_APPEND(3, 0x44,0x8B,0x8F); JIT_APPEND_INT(value)
 #define mov____r10__QWORD_PTR_r12_imm32(value)       JIT_APPEND(4, 0x4D,0x8B,0x94,0x24); JIT_APPEND_INT(value)
 #define mov____r12__rcx()                            JIT_APPEND(3, 0x49,0x89,0xCC)
 #define mov____r12__rdi()                            JIT_APPEND(3, 0x49,0x89,0xFC)
@@ -21157,74 +22240,261 @@ static inline int jit_append_return(Heap *heap, int stack_pos)
 }
 
 
-static inline int jit_append_return2(Heap *heap, int slot1, int slot2)
-{
-#ifdef JIT_DEBUG
-   printf("   return2 %d, %d\n", slot1, slot2);
-#endif
-#if defined(JIT_X86)
-   #ifdef JIT_X86_64
-      mov____rdx__r12();
-   #else
-      mov____edx__DWORD_PTR_ebp_imm8(0x08); // heap
-   #endif
-   mov____ebx__DWORD_PTR_redx_imm8(OFFSETOF(Heap, jit_error_base));
-   #ifdef JIT_X86_64
-      mov____rcx__QWORD_PTR_rdx_imm8(OFFSETOF(Heap, stack_flags));
-   #else
-      mov____ecx__DWORD_PTR_redx_imm8(OFFSETOF(Heap, stack_flags));
-   #endif
-   lea____eax__rebx_imm8(0x02);
-   mov____DWORD_PTR_redx_imm8__eax(OFFSETOF(Heap, stack_len));
+static inline int jit_append_return2(Heap *heap, int slot1, int slot2)
+{
+#ifdef JIT_DEBUG
+   printf("   return2 %d, %d\n", slot1, slot2);
+#endif
+#if defined(JIT_X86)
+   #ifdef JIT_X86_64
+      mov____rdx__r12();
+   #else
+      mov____edx__DWORD_PTR_ebp_imm8(0x08); // heap
+   #endif
+   mov____ebx__DWORD_PTR_redx_imm8(OFFSETOF(Heap, jit_error_base));
+   #ifdef JIT_X86_64
+      mov____rcx__QWORD_PTR_rdx_imm8(OFFSETOF(Heap, stack_flags));
+   #else
+      mov____ecx__DWORD_PTR_redx_imm8(OFFSETOF(Heap, stack_flags));
+   #endif
+   lea____eax__rebx_imm8(0x02);
+   mov____DWORD_PTR_redx_imm8__eax(OFFSETOF(Heap, stack_len));
+
+   #ifdef JIT_X86_64
+      add____rcx__rbx();
+   #else
+      add____ecx__ebx();
+   #endif
+   shl____ebx__imm(2);
+   #ifdef JIT_X86_64
+      add____rbx__QWORD_PTR_rdx_imm8(OFFSETOF(Heap, stack_data));
+   #else
+      add____ebx__DWORD_PTR_edx_imm8(OFFSETOF(Heap, stack_data));
+   #endif
+
+#define COPY_SLOT(dest, src) \
+   if (SH(src*4 >= -128 && src*4 < 128)) { \
+      mov____eax__DWORD_PTR_redi_imm8(src*4); \
+   } \
+   else { \
+      mov____eax__DWORD_PTR_redi_imm32(src*4); \
+   } \
+   mov____DWORD_PTR_rebx_imm8__eax(dest*4); \
+   \
+   if (SH(src >= -128 && src < 128)) { \
+      movzx__eax__BYTE_PTR_resi_imm8(src); \
+   } \
+   else { \
+      movzx__eax__BYTE_PTR_resi_imm32(src); \
+   } \
+   mov____BYTE_PTR_recx_imm8__al(dest)
+
+   COPY_SLOT(0, slot1);
+   COPY_SLOT(1, slot2);
+
+#undef COPY_SLOT
+
+   if (!jit_append_unwind(heap)) return 0;
+#else
+   return 0;
+#endif
+   return 1;
+}
+
+
+#if defined(JIT_X86_64) && !defined(JIT_WIN64)
+static inline int jit_append_fast_native_call(Heap *heap, int stack_pos, int marker_pos, int marker_value, NativeFunction *nfunc, int *generic_ref)
+{
+   int i, slot, ref1, ref3, ref4, ref5=0, label;
+   int generic = (nfunc->func != fast_native_adapter);
+   int type_refs[8], num_type_refs=0;
+   char type;
+
+   // type checks of parameters (native functions that also have a generic variant
+   // continue with the regular native call instead of reporting an error):
+   mov____edx__imm(JIT_PC_ERR(marker_value & 0x7FFFFFFF, JIT_ERROR_NATIVE_PARAM_TYPE));
+   for (i=0; i<nfunc->num_params; i++) {
+      slot = marker_pos+1+i;
+      type = nfunc->fast_sig[i+1];
+      if (SH(slot*4 >= -128 && slot*4 < 128)) {
+         cmp____BYTE_PTR_resi_imm8__imm8(slot, type == 'i'? 0 : 1);
+      }
+      else {
+         cmp____BYTE_PTR_resi_imm32__imm8(slot, type == 'i'? 0 : 1);
+      }
+      jne____rel32(generic? 0 : heap->jit_error_code - heap->jit_code_len - 4);
+      type_refs[num_type_refs++] = heap->jit_code_len;
+      if (type == 'i') continue;
+
+      if (SH(slot*4 >= -128 && slot*4 < 128)) {
+         mov____eax__DWORD_PTR_redi_imm8(slot*4);
+      }
+      else {
+         mov____eax__DWORD_PTR_redi_imm32(slot*4);
+      }
+      sub____eax__imm8(1);
+      cmp____eax__imm32(0x7FFFFF);
+      if (type == 'f') {
+         jb_____rel32(generic? 0 : heap->jit_error_code - heap->jit_code_len - 4);
+      }
+      else {
+         jae____rel32(generic? 0 : heap->jit_error_code - heap->jit_code_len - 4);
+      }
+      type_refs[num_type_refs++] = heap->jit_code_len;
+   }
+
+   if (SH(marker_pos*4 >= -128 && marker_pos*4 < 128)) {
+      mov____DWORD_PTR_redi_imm8__imm(marker_pos*4, marker_value);
+      mov____BYTE_PTR_resi_imm8__imm(marker_pos, 1);
+   }
+   else {
+      mov____DWORD_PTR_redi_imm32__imm(marker_pos*4, marker_value);
+      mov____BYTE_PTR_resi_imm32__imm(marker_pos, 1);
+   }
+
+   // parameters are passed directly in registers:
+   for (i=0; i<nfunc->num_params; i++) {
+      slot = (marker_pos+1+i)*4;
+      if (SH(slot >= -128 && slot < 128)) {
+         switch (i) {
+            case 0: mov____edx__DWORD_PTR_redi_imm8(slot); break;
+            case 1: mov____ecx__DWORD_PTR_redi_imm8(slot); break;
+            case 2: mov____r8d__DWORD_PTR_rdi_imm8(slot); break;
+            case 3: mov____r9d__DWORD_PTR_rdi_imm8(slot); break;
+         }
+      }
+      else {
+         switch (i) {
+            case 0: mov____edx__DWORD_PTR_redi_imm32(slot); break;
+            case 1: mov____ecx__DWORD_PTR_redi_imm32(slot); break;
+            case 2: mov____r8d__DWORD_PTR_rdi_imm32(slot); break;
+            case 3: mov____r9d__DWORD_PTR_rdi_imm32(slot); break;
+         }
+      }
+   }
+
+   sub____rdi__QWORD_PTR_rbx_imm8(OFFSETOF(Heap, stack_data));
+   sub____rsi__QWORD_PTR_rbx_imm8(OFFSETOF(Heap, stack_flags));
+   if (SH(stack_pos < 128)) {
+      lea____eax__resi_imm8(stack_pos);
+   }
+   else {
+      lea____eax__resi_imm32(stack_pos);
+   }
+   mov____DWORD_PTR_rebx_imm8__eax(OFFSETOF(Heap, stack_len));
+
+   push___resi();
+   push___redi();
+   mov____rdi__r12();
+   mov____rsi__imm64((intptr_t)nfunc);
+   if (!emit_func_call(heap, jit_fast_native_call, 0)) return 0;
+   pop____redi();
+   pop____resi();
+   if (!emit_call_reinit_regs(heap)) return 0;
+
+   // slow path is needed only when the native function has created new values
+   // or reported an error:
+   mov____rbx__r12();
+   cmp____DWORD_PTR_rebx_imm32__imm8(OFFSETOF(Heap, roots.len), 0);
+   jne____rel8(0); // label 1
+   ref1 = heap->jit_code_len;
+   cmp____DWORD_PTR_rebx_imm32__imm8(OFFSETOF(Heap, fast_native_error.value), 0);
+   je_____rel8(0); // label 2
+   ref3 = heap->jit_code_len;
+
+   // label 1:
+   heap->jit_code[ref1-1] = heap->jit_code_len - ref1;
+   push___resi();
+   push___redi();
+   push___reax();
+   push___reax();
+   mov____rdi__r12();
+   if (!emit_func_call(heap, jit_fast_native_finish, 0)) return 0;
+   pop____redx();
+   pop____redx();
+   pop____redi();
+   pop____resi();
+   if (!emit_call_reinit_regs(heap)) return 0;
+   cmp____eax__imm8(0);
+   mov____eax__edx();
+   jne____rel8(0); // label 2
+   ref4 = heap->jit_code_len;
+
+   if (!jit_append_unwind(heap)) return 0;
 
-   #ifdef JIT_X86_64
-      add____rcx__rbx();
-   #else
-      add____ecx__ebx();
-   #endif
-   shl____ebx__imm(2);
-   #ifdef JIT_X86_64
-      add____rbx__QWORD_PTR_rdx_imm8(OFFSETOF(Heap, stack_data));
-   #else
-      add____ebx__DWORD_PTR_edx_imm8(OFFSETOF(Heap, stack_data));
-   #endif
+   // label 2:
+   heap->jit_code[ref3-1] = heap->jit_code_len - ref3;
+   heap->jit_code[ref4-1] = heap->jit_code_len - ref4;
 
-#define COPY_SLOT(dest, src) \
-   if (SH(src*4 >= -128 && src*4 < 128)) { \
-      mov____eax__DWORD_PTR_redi_imm8(src*4); \
-   } \
-   else { \
-      mov____eax__DWORD_PTR_redi_imm32(src*4); \
-   } \
-   mov____DWORD_PTR_rebx_imm8__eax(dest*4); \
-   \
-   if (SH(src >= -128 && src < 128)) { \
-      movzx__eax__BYTE_PTR_resi_imm8(src); \
-   } \
-   else { \
-      movzx__eax__BYTE_PTR_resi_imm32(src); \
-   } \
-   mov____BYTE_PTR_recx_imm8__al(dest)
+   mov____rbx__r12();
+   add____rdi__QWORD_PTR_rbx_imm8(OFFSETOF(Heap, stack_data));
+   add____rsi__QWORD_PTR_rbx_imm8(OFFSETOF(Heap, stack_flags));
 
-   COPY_SLOT(0, slot1);
-   COPY_SLOT(1, slot2);
+   type = nfunc->fast_sig[0];
+   if (type == 'v') {
+      xor____eax__eax();
+   }
+   else if (type == 'f') {
+      // flush denormals to zero the same way as fixscript_float so they can't be mistaken for references:
+      test___eax__imm(0x7F800000);
+      jne____rel8(5);
+      and____eax__imm32(0xFF800000);
+   }
 
-#undef COPY_SLOT
+   if (SH(marker_pos*4 >= -128 && marker_pos*4 < 128)) {
+      mov____DWORD_PTR_redi_imm8__eax(marker_pos*4);
+      if (type == 'a') {
+         mov____BYTE_PTR_resi_imm8__imm(marker_pos, 0);
+         cmp____eax__imm8(0);
+         je_____rel8(0); // label 3
+         ref5 = heap->jit_code_len;
+      }
+      mov____BYTE_PTR_resi_imm8__imm(marker_pos, type == 'f' || type == 'a'? 1 : 0);
+   }
+   else {
+      mov____DWORD_PTR_redi_imm32__eax(marker_pos*4);
+      if (type == 'a') {
+         mov____BYTE_PTR_resi_imm32__imm(marker_pos, 0);
+         cmp____eax__imm8(0);
+         je_____rel8(0); // label 3
+         ref5 = heap->jit_code_len;
+      }
+      mov____BYTE_PTR_resi_imm32__imm(marker_pos, type == 'f' || type == 'a'? 1 : 0);
+   }
 
-   if (!jit_append_unwind(heap)) return 0;
-#else
-   return 0;
-#endif
+   if (type == 'a') {
+      // label 3:
+      heap->jit_code[ref5-1] = heap->jit_code_len - ref5;
+   }
+
+   *generic_ref = 0;
+   if (generic) {
+      jmp____rel32(0);
+      *generic_ref = heap->jit_code_len;
+
+      for (i=0; i<num_type_refs; i++) {
+         label = heap->jit_code_len - type_refs[i];
+         memcpy(&heap->jit_code[type_refs[i]-4], &label, 4);
+      }
+   }
    return 1;
 }
+#endif
 
 
 static inline int jit_append_call(Heap *heap, int stack_pos, int marker_pos, int marker_value, int dest_addr, int *label_addr, NativeFunction *nfunc, int call2)
 {
-   int ref1=0, ref2, ref3, ref4=0, label;
+   int ref1=0, ref2, ref3, ref4=0, label, generic_ref=0;
 #ifdef JIT_DEBUG
    printf("   call%s_%s (%d, %d, %d)\n", call2? "2":"", nfunc? "native" : dest_addr >= 0? "direct" : "dynamic", stack_pos, marker_pos, marker_value & 0x7FFFFFFF);
 #endif
+#if defined(JIT_X86_64) && !defined(JIT_WIN64)
+   if (nfunc && nfunc->fast_sig[0] && !call2) {
+      mov____rbx__r12();
+      if (!jit_append_fast_native_call(heap, stack_pos, marker_pos, marker_value, nfunc, &generic_ref)) return 0;
+      if (!generic_ref) return 1;
+   }
+#endif
 #if defined(JIT_X86)
    #ifdef JIT_X86_64
       mov____rbx__r12();
@@ -21456,6 +22726,11 @@ static inline int jit_append_call(Heap *heap, int stack_pos, int marker_pos, int
          pop____DWORD_PTR_edx_imm8(OFFSETOF(Heap, jit_error_sp));
       #endif
    }
+
+   if (generic_ref) {
+      label = heap->jit_code_len - generic_ref;
+      memcpy(&heap->jit_code[generic_ref-4], &label, 4);
+   }
 #else
    return 0;
 #endif
@@ -21471,6 +22746,47 @@ static inline int jit_add_error_stub(Heap *heap, DynArray *error_stubs, int pc,
 }
 
 
+#ifdef JIT_X86_64
+static inline int jit_append_lazy_compile_code(Heap *heap)
+{
+   int ref1;
+
+   push___rebp();
+   mov____rbp__rsp();
+   push___resi();
+   push___redi();
+   #ifdef JIT_WIN64
+      mov____rcx__r12();
+      mov____rdx__rax();
+      lea____r8__rsp_imm8(-0x28);
+      mov____r9__rbp();
+   #else
+      mov____rdi__r12();
+      mov____rsi__rax();
+      lea____rdx__rsp_imm8(-8);
+      mov____rcx__rbp();
+   #endif
+   if (!emit_func_call(heap, jit_lazy_compile, 0)) return 0;
+   if (!emit_call_reinit_regs(heap)) return 0;
+   pop____redi();
+   pop____resi();
+   pop____rebp();
+   cmp____eax__imm8(0);
+   je_____rel8(0); // label 1
+   ref1 = heap->jit_code_len;
+
+   mov____eax__eax();
+   add____rax__QWORD_PTR_r12_imm32(OFFSETOF(Heap, jit_code));
+   jmp____reax();
+
+   // label 1:
+   heap->jit_code[ref1-1] = heap->jit_code_len - ref1;
+   if (!jit_append_unwind(heap)) return 0;
+   return 1;
+}
+#endif
+
+
 static inline int jit_append_stack_error_stub(Heap *heap, int error)
 {
 #if defined(JIT_X86)
@@ -24834,6 +26150,152 @@ static void jit_scan_jump_targets(Heap *heap, int addr_start, int addr_end, uint
 }
 
 
+static inline uint64_t jit_hash_bytes(uint64_t hash, const void *data, int len)
+{
+   const unsigned char *p = data;
+   int i;
+
+   for (i=0; i<len; i++) {
+      hash = (hash ^ p[i]) * 0x100000001B3ULL;
+   }
+   return hash;
+}
+
+
+static inline uint64_t jit_hash_int(uint64_t hash, int value)
+{
+   return jit_hash_bytes(hash, &value, sizeof(int));
+}
+
+
+// computes hash of the function bytecode that is independent of its position and of the
+// function IDs assigned by reloading, when reuse is given it also clears reusable flag
+// when the function calls directly any function that can't keep its JIT code:
+static uint64_t jit_hash_function(Heap *heap, Function *func, int func_start, const char *reuse, int *reusable)
+{
+   struct SwitchTable {
+      int start, end;
+      struct SwitchTable *next;
+   };
+   uint64_t hash = 0xCBF29CE484222325ULL;
+   int i, pc, op, len, value, target, start, end;
+   unsigned short short_val;
+   int int_val;
+   int table_idx, size;
+   int *table;
+   Function *callee;
+   struct SwitchTable *switch_table = NULL, *new_switch_table;
+
+   start = func->addr;
+   end = func->addr + func->jit_pc_len;
+
+   for (pc = start; pc < end; pc += len) {
+      if (switch_table && pc == switch_table->start) {
+         pc = switch_table->end;
+         new_switch_table = switch_table->next;
+         free(switch_table);
+         switch_table = new_switch_table;
+         if (pc >= end) break;
+      }
+
+      op = heap->bytecode[pc];
+      len = 1;
+      value = 0;
+      switch (op) {
+         case BC_CONST_P8:    len = 2; value = heap->bytecode[pc+1]+1; break;
+         case BC_CONST_N8:    len = 2; value = -(heap->bytecode[pc+1]+1); break;
+         case BC_CONST_P16:   len = 3; memcpy(&short_val, &heap->bytecode[pc+1], 2); value = short_val+1; break;
+         case BC_CONST_N16:   len = 3; memcpy(&short_val, &heap->bytecode[pc+1], 2); value = -(short_val+1); break;
+         case BC_CONST_I32:   len = 5; memcpy(&value, &heap->bytecode[pc+1], 4); break;
+
+         case BC_INC:
+         case BC_DEC:
+         case BC_LOOP_I8:
+         case BC_EXTENDED:
+            len = 2;
+            break;
+
+         case BC_LOOP_I16:
+         case BC_CHECK_STACK:
+            len = 3;
+            break;
+
+         case BC_CONST_F32:
+         case BC_BRANCH_LONG:
+         case BC_JUMP_LONG:
+         case BC_LOOP_I32:
+         case BC_LOAD_LOCAL:
+         case BC_STORE_LOCAL:
+            len = 5;
+            break;
+
+         case BC_SWITCH:
+            len = 5;
+            memcpy(&int_val, &heap->bytecode[pc+1], 4);
+            table_idx = int_val;
+            table = &((int *)heap->bytecode)[table_idx];
+            size = table[-2];
+            hash = jit_hash_int(hash, op);
+            hash = jit_hash_int(hash, table_idx*4 - start);
+            hash = jit_hash_int(hash, size);
+            hash = jit_hash_int(hash, table[-1] - start);
+            for (i=0; i<size; i++) {
+               target = table[i*2+1];
+               hash = jit_hash_int(hash, table[i*2+0]);
+               hash = jit_hash_int(hash, target > 0? target - start : target < 0? -(-target - start) : 0);
+            }
+
+            new_switch_table = malloc(sizeof(struct SwitchTable));
+            if (!new_switch_table) {
+               if (reusable) *reusable = 0;
+               break;
+            }
+            new_switch_table->start = (table_idx-2)*4;
+            new_switch_table->end = (table_idx+size*2)*4;
+            new_switch_table->next = switch_table;
+            switch_table = new_switch_table;
+            continue;
+
+         default:
+            if ((op >= BC_BRANCH0 && op <= BC_BRANCH0+7) || (op >= BC_JUMP0 && op <= BC_JUMP0+7)) {
+               len = 2;
+            }
+            else if ((op >= BC_CONSTM1 && op <= BC_CONST0+32) || op == BC_CONST0+63 || op == BC_CONST0+64) {
+               value = op - BC_CONST0;
+            }
+      }
+
+      if (pc+len < end && (heap->bytecode[pc+len] == BC_CALL_DIRECT || heap->bytecode[pc+len] == BC_CALL2_DIRECT) && value > 0 && value < heap->functions.len) {
+         callee = heap->functions.data[value];
+         if (reusable) {
+            if (callee->id >= func_start) {
+               if (!reuse[callee->id - func_start]) {
+                  *reusable = 0;
+               }
+            }
+            else if (callee->id != value) {
+               // the called function was replaced by reloading of other script:
+               *reusable = 0;
+            }
+         }
+         hash = jit_hash_int(hash, op);
+         hash = jit_hash_int(hash, callee->reload_id? callee->reload_id : value);
+         continue;
+      }
+
+      hash = jit_hash_bytes(hash, &heap->bytecode[pc], MIN(len, end - pc));
+   }
+
+   while (switch_table) {
+      new_switch_table = switch_table->next;
+      free(switch_table);
+      switch_table = new_switch_table;
+   }
+
+   return hash? hash : 1;
+}
+
+
 enum {
    SLOT_VALUE,
    SLOT_INDIRECT,
@@ -26128,6 +27590,9 @@ static int jit_init(Heap *heap)
    #ifdef JIT_X86_64
       heap->jit_reinit_regs_func = heap->jit_code_len;
       if (!emit_reinit_regs(heap, 1)) return 0;
+
+      heap->jit_lazy_compile_code = heap->jit_code_len;
+      if (!jit_append_lazy_compile_code(heap)) return 0;
    #endif
 
    heap->jit_error_code = heap->jit_code_len;
@@ -26294,16 +27759,19 @@ static int jit_init(Heap *heap)
 }
 
 
-static const char *jit_compile(Heap *heap, int func_start)
+static const char *jit_compile_functions(Heap *heap, int func_start, Function *lazy_func)
 {
-   Function *func;
+   Function *func, **funcs;
    const char *error = NULL;
    uint16_t *labels = NULL;
    int *addrs = NULL;
    uint32_t *jump_targets = NULL;
    DynArray forward_refs, func_refs, error_stubs;
    StackEntry *stack = NULL;
+   Function *prev;
+   char *reuse = NULL;
    int i, j, start, end, max_stack, max_code_size, max_total_stack, max_num_params, orig_code_len, orig_pc_mappings, orig_heap_data_refs, orig_array_get_refs, orig_array_set_refs, orig_array_append_refs, orig_length_refs, orig_adjustments;
+   int num_funcs, has_reload = 0, changed, reusable, lazy;
 
    memset(&forward_refs, 0, sizeof(DynArray));
    memset(&func_refs, 0, sizeof(DynArray));
@@ -26325,15 +27793,37 @@ static const char *jit_compile(Heap *heap, int func_start)
    orig_length_refs = heap->jit_length_refs.len;
    orig_adjustments = heap->jit_adjustments.len;
 
+   if (lazy_func) {
+      funcs = &lazy_func;
+      num_funcs = 1;
+      lazy = 0;
+   }
+   else {
+      funcs = (Function **)heap->functions.data + func_start;
+      num_funcs = heap->functions.len - func_start;
+      #ifdef JIT_X86_64
+         lazy = heap->lazy_compilation;
+      #else
+         lazy = 0;
+      #endif
+   }
+
    max_code_size = 0;
    max_total_stack = 0;
    max_num_params = 0;
-   for (i=func_start; i<heap->functions.len; i++) {
-      func = heap->functions.data[i];
-      start = func->addr;
-      end = i+1 < heap->functions.len? ((Function *)heap->functions.data[i+1])->addr : heap->bytecode_size;
-      if (end - start > max_code_size) {
-         max_code_size = end - start;
+   for (i=0; i<num_funcs; i++) {
+      func = funcs[i];
+      if (!lazy_func) {
+         start = func->addr;
+         end = func_start+i+1 < heap->functions.len? ((Function *)heap->functions.data[func_start+i+1])->addr : heap->bytecode_size;
+         func->jit_pc_base = start;
+         func->jit_pc_len = end - start;
+         if (func->reload_id) {
+            has_reload = 1;
+         }
+      }
+      if (func->jit_pc_len > max_code_size) {
+         max_code_size = func->jit_pc_len;
       }
       if (func->max_stack > max_total_stack) {
          max_total_stack = func->max_stack;
@@ -26356,10 +27846,67 @@ static const char *jit_compile(Heap *heap, int func_start)
       stack[i].type = SLOT_VALUE;
    }
 
-   for (i=func_start; i<heap->functions.len; i++) {
-      func = heap->functions.data[i];
+   if (has_reload) {
+      // reuse JIT code of functions that haven't changed since the previous version of the script:
+      reuse = calloc(heap->functions.len - func_start, 1);
+      if (!reuse) {
+         error = "out of memory";
+         goto error;
+      }
+      for (i=func_start; i<heap->functions.len; i++) {
+         func = heap->functions.data[i];
+         if (!func->reload_id) continue;
+         prev = heap->functions.data[func->reload_id];
+         if (prev == func || !prev->jit_addr || prev->num_params != func->num_params || prev->max_stack != func->max_stack || prev->jit_pc_len != func->jit_pc_len) continue;
+         if (!prev->jit_hash) {
+            prev->jit_hash = jit_hash_function(heap, prev, 0, NULL, NULL);
+         }
+         func->jit_hash = jit_hash_function(heap, func, 0, NULL, NULL);
+         reuse[i-func_start] = (func->jit_hash == prev->jit_hash);
+      }
+
+      do {
+         changed = 0;
+         for (i=func_start; i<heap->functions.len; i++) {
+            if (!reuse[i-func_start]) continue;
+            reusable = 1;
+            jit_hash_function(heap, heap->functions.data[i], func_start, reuse, &reusable);
+            if (!reusable) {
+               reuse[i-func_start] = 0;
+               changed = 1;
+            }
+         }
+      }
+      while (changed);
+
+      for (i=func_start; i<heap->functions.len; i++) {
+         if (!reuse[i-func_start]) continue;
+         func = heap->functions.data[i];
+         prev = heap->functions.data[func->reload_id];
+         func->jit_addr = prev->jit_addr;
+         func->jit_pc_base = prev->jit_pc_base;
+         if (!jit_reserve_pc_remap(heap, func->jit_pc_base, func->jit_pc_len)) {
+            error = "out of memory";
+            goto error;
+         }
+      }
+   }
+
+   for (i=0; i<num_funcs; i++) {
+      if (reuse && reuse[i]) continue;
+      func = funcs[i];
+      if (lazy) {
+         // function bodies are compiled on the first call:
+         func->jit_addr = heap->jit_code_len;
+         func->jit_lazy = 1;
+         #ifdef JIT_X86_64
+            mov____rax__imm64((intptr_t)func);
+            jmp____rel32(heap->jit_lazy_compile_code - heap->jit_code_len - 4);
+         #endif
+         continue;
+      }
       start = func->addr;
-      end = i+1 < heap->functions.len? ((Function *)heap->functions.data[i+1])->addr : heap->bytecode_size;
+      end = start + func->jit_pc_len;
       for (j=0; j<end-start; j++) {
          labels[j] = 0xFFFF;
       }
@@ -26369,6 +27916,7 @@ static const char *jit_compile(Heap *heap, int func_start)
          printf("%s\n", fixscript_dump_code(heap, func->script, string_hash_find_name(&func->script->functions, func)));
       #endif
       func->jit_addr = heap->jit_code_len;
+      func->jit_lazy = 0;
       jit_scan_jump_targets(heap, start, end, jump_targets);
       error = jit_compile_function(heap, start, end, func->num_params, labels, addrs, jump_targets, &forward_refs, &func_refs, &error_stubs, stack + max_num_params, &max_stack);
       #ifdef JIT_DEBUG
@@ -26403,7 +27951,16 @@ static const char *jit_compile(Heap *heap, int func_start)
       #endif
    }
 
-   jit_update_heap_refs(heap);
+   if (reuse) {
+      for (i=func_start; i<heap->functions.len; i++) {
+         if (!reuse[i-func_start]) continue;
+         func = heap->functions.data[i];
+         jit_set_pc_remap(heap, func->jit_pc_base, func->addr);
+      }
+   }
+
+   // references in the previously compiled code are kept updated on each change:
+   jit_update_heap_refs_range(heap, orig_heap_data_refs, orig_array_get_refs, orig_array_set_refs, orig_array_append_refs, orig_length_refs, orig_adjustments);
 
    #ifdef JIT_DEBUG
       {
@@ -26435,11 +27992,18 @@ error:
    free(func_refs.data);
    free(error_stubs.data);
    free(stack);
+   free(reuse);
    return error;
 }
 
 
-static void jit_update_heap_refs(Heap *heap)
+static const char *jit_compile(Heap *heap, int func_start)
+{
+   return jit_compile_functions(heap, func_start, NULL);
+}
+
+
+static void jit_update_heap_refs_range(Heap *heap, int heap_data_refs, int array_get_refs, int array_set_refs, int array_append_refs, int length_refs, int adjustments)
 {
    void *ptr;
    intptr_t value;
@@ -26447,33 +28011,33 @@ static void jit_update_heap_refs(Heap *heap)
 
    jit_update_exec(heap, 0);
 
-   for (i=0; i<heap->jit_heap_data_refs.len; i++) {
+   for (i=heap_data_refs; i<heap->jit_heap_data_refs.len; i++) {
       offset = (intptr_t)heap->jit_heap_data_refs.data[i];
       value = (intptr_t)heap->data;
       memcpy(heap->jit_code + (offset - sizeof(intptr_t)), &value, sizeof(intptr_t));
    }
 
-   for (i=0; i<heap->jit_array_get_refs.len; i++) {
+   for (i=array_get_refs; i<heap->jit_array_get_refs.len; i++) {
       offset = (intptr_t)heap->jit_array_get_refs.data[i];
       jit_update_array_get(heap, heap->jit_code + offset);
    }
 
-   for (i=0; i<heap->jit_array_set_refs.len; i++) {
+   for (i=array_set_refs; i<heap->jit_array_set_refs.len; i++) {
       offset = (intptr_t)heap->jit_array_set_refs.data[i];
       jit_update_array_set(heap, heap->jit_code + offset, 0);
    }
 
-   for (i=0; i<heap->jit_array_append_refs.len; i++) {
+   for (i=array_append_refs; i<heap->jit_array_append_refs.len; i++) {
       offset = (intptr_t)heap->jit_array_append_refs.data[i];
       jit_update_array_set(heap, heap->jit_code + offset, 1);
    }
 
-   for (i=0; i<heap->jit_length_refs.len; i++) {
+   for (i=length_refs; i<heap->jit_length_refs.len; i++) {
       offset = (intptr_t)heap->jit_length_refs.data[i];
       jit_update_length(heap, heap->jit_code + offset);
    }
 
-   for (i=0; i<heap->jit_adjustments.len; i+=2) {
+   for (i=adjustments; i<heap->jit_adjustments.len; i+=2) {
       offset = (intptr_t)heap->jit_adjustments.data[i+0];
       if (offset >= 0) {
          ptr = ((JitAdjPtrFunc)heap->jit_adjustments.data[i+1])(heap);
@@ -26487,4 +28051,10 @@ static void jit_update_heap_refs(Heap *heap)
    }
 }
 
+
+static void jit_update_heap_refs(Heap *heap)
+{
+   jit_update_heap_refs_range(heap, 0, 0, 0, 0, 0, 0);
+}
+
 #endif /* FIXSCRIPT_NO_JIT */
@@ -39,6 +39,7 @@ typedef void (*HandleFreeFunc)(void *p);
 typedef void *(*HandleFunc)(Heap *heap, int op, void *p1, void *p2);
 typedef Script *(*LoadScriptFunc)(Heap *heap, const char *fname, Value *error, void *data);
 typedef Value (*NativeFunc)(Heap *heap, Value *error, int num_params, Value *params, void *data);
+typedef int (*FastNativeFunc)(Heap *heap, void *data, int p1, int p2, int p3, int p4);
 
 #ifdef FIXSCRIPT_ASYNC
 typedef void (*ContinuationFunc)(void *data);
@@ -106,6 +107,8 @@ void *fixscript_get_heap_data(Heap *heap, int key);
 void fixscript_set_time_limit(Heap *heap, int limit);
 int fixscript_get_remaining_time(Heap *heap);
 void fixscript_stop_execution(Heap *heap);
+void fixscript_set_lazy_compilation(Heap *heap, int enable);
+int fixscript_get_lazy_compilation(Heap *heap);
 
 void fixscript_mark_ref(Heap *heap, Value value);
 Value fixscript_copy_ref(void *ctx, Value value);
@@ -130,6 +133,7 @@ void fixscript_unlock_array(Heap *heap, Value arr_val, int off, int len, void **
 
 Value fixscript_create_shared_array(Heap *heap, int len, int elem_size);
 Value fixscript_create_or_get_shared_array(Heap *heap, int type, void *ptr, int len, int elem_size, HandleFreeFunc free_func, void *data, int *created);
+int fixscript_move_to_shared_array(Heap *heap, Value arr_val, Value *shared_val);
 void fixscript_ref_shared_array(SharedArrayHandle *sah);
 void fixscript_unref_shared_array(SharedArrayHandle *sah);
 int fixscript_get_shared_array_reference_count(SharedArrayHandle *sah);
@@ -203,6 +207,8 @@ Value fixscript_call(Heap *heap, Value func, int num_params, Value *error, ...);
 Value fixscript_call_args(Heap *heap, Value func, int num_params, Value *error, Value *args);
 void fixscript_register_native_func(Heap *heap, const char *name, NativeFunc func, void *data);
 NativeFunc fixscript_get_native_func(Heap *heap, const char *name, void **data);
+void fixscript_register_fast_native_func(Heap *heap, const char *name, FastNativeFunc func, const char *signature, void *data);
+void fixscript_set_fast_native_error(Heap *heap, Value error);
 
 char *fixscript_dump_code(Heap *heap, Script *script, const char *func_name);
 char *fixscript_dump_heap(Heap *heap);
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "fixscript.h"
 
 #ifdef __wasm__
@@ -32,6 +33,9 @@ typedef struct {
    Value value;
 } NativeRef;
 
+// internal accessor, not part of the public API:
+int fixscript_get_function_jit_addr(Heap *heap, Value func_val);
+
 #ifdef __wasm__
 typedef struct {
    Heap *heap;
@@ -141,6 +145,95 @@ static Value overrided_native_func(Heap *heap, Value *error, int num_params, Val
 }
 
 
+static int fast_add_extra = 1;
+
+
+static int fast_add(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   return p1 + p2 + *(int *)data;
+}
+
+
+static int fast_mul_float(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   union { int i; float f; } u1, u2;
+
+   u1.i = p1;
+   u2.i = p2;
+   u1.f *= u2.f;
+   return u1.i;
+}
+
+
+static int fast_array_length(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   int len;
+
+   if (fixscript_get_array_length(heap, (Value) { p1, 1 }, &len) != FIXSCRIPT_SUCCESS) {
+      fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "not an array"));
+      return 0;
+   }
+   return len;
+}
+
+
+static int fast_create_array(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   Value arr;
+
+   if (p1 < 0) {
+      return 0;
+   }
+   arr = fixscript_create_array(heap, p1);
+   if (!arr.value) {
+      fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "out of memory"));
+   }
+   return arr.value;
+}
+
+
+static int fast_create_arrays(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   Value arr, elem;
+   int i;
+
+   arr = fixscript_create_array(heap, p1);
+   if (!arr.value) {
+      fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "out of memory"));
+      return 0;
+   }
+   for (i=0; i<p1; i++) {
+      elem = fixscript_create_array(heap, 1);
+      if (!elem.value || fixscript_set_array_elem(heap, arr, i, elem) != FIXSCRIPT_SUCCESS) {
+         fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "out of memory"));
+         return 0;
+      }
+   }
+   return arr.value;
+}
+
+
+static int fast_check(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   if (!p1) {
+      fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "check failed"));
+   }
+   return 0;
+}
+
+
+static int fast_bench(Heap *heap, void *data, int p1, int p2, int p3, int p4)
+{
+   return p1 + 1;
+}
+
+
+static Value native_bench(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   return fixscript_int(params[0].value + 1);
+}
+
+
 static Value test_alt_heap(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
    Heap *alt_heap = data;
@@ -308,6 +401,9 @@ static Value create_heap(Heap *heap, Value *error, int num_params, Value *params
    if (!heap2) {
       return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
    }
+   if (num_params == 1 && params[0].value) {
+      fixscript_set_lazy_compilation(heap2, 1);
+   }
 
    ret = fixscript_create_handle(heap, 2, heap2, (HandleFreeFunc)fixscript_free_heap);
    if (!ret.value) {
@@ -355,6 +451,47 @@ static Value heap_reload_script(Heap *heap, Value *error, int num_params, Value
 }
 
 
+static Value heap_get_jit_addr(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Heap *heap2;
+   Script *script;
+   char *fname = NULL;
+   char *func_name = NULL;
+   Value func = fixscript_int(0);
+   int err;
+
+   heap2 = fixscript_get_handle(heap, params[0], 2, NULL);
+   if (!heap2) {
+      *error = fixscript_create_error_string(heap, "invalid heap handle");
+      return fixscript_int(0);
+   }
+
+   err = fixscript_get_string(heap, params[1], 0, -1, &fname, NULL);
+   if (!err) {
+      err = fixscript_get_string(heap, params[2], 0, -1, &func_name, NULL);
+   }
+   if (err) {
+      free(fname);
+      free(func_name);
+      return fixscript_error(heap, error, err);
+   }
+
+   script = fixscript_get(heap2, fname);
+   if (script) {
+      func = fixscript_get_function(heap2, script, func_name);
+   }
+   free(fname);
+   free(func_name);
+   if (!func.value) {
+      *error = fixscript_create_error_string(heap, "function not found");
+      return fixscript_int(0);
+   }
+
+   // the function reference resolves to the current version of the function after reloads:
+   return fixscript_int(fixscript_get_function_jit_addr(heap2, func));
+}
+
+
 static Value heap_run_func(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
    Heap *heap2;
@@ -477,9 +614,19 @@ int main(int argc, char **argv)
    fixscript_register_native_func(heap, "overrided_native_func2#0", overrided_native_func, NULL);
    fixscript_register_native_func(heap, "create_native_ref#1", create_native_ref, NULL);
    fixscript_register_native_func(heap, "create_heap#0", create_heap, NULL);
+   fixscript_register_native_func(heap, "create_heap#1", create_heap, NULL);
    fixscript_register_native_func(heap, "heap_reload_script#3", heap_reload_script, NULL);
    fixscript_register_native_func(heap, "heap_run_func#3", heap_run_func, NULL);
+   fixscript_register_native_func(heap, "heap_get_jit_addr#3", heap_get_jit_addr, NULL);
    fixscript_register_native_func(heap, "run_later#1", run_later, NULL);
+   fixscript_register_fast_native_func(heap, "fast_add#2", fast_add, "iii", &fast_add_extra);
+   fixscript_register_fast_native_func(heap, "fast_mul_float#2", fast_mul_float, "fff", NULL);
+   fixscript_register_fast_native_func(heap, "fast_array_length#1", fast_array_length, "ia", NULL);
+   fixscript_register_fast_native_func(heap, "fast_create_array#1", fast_create_array, "ai", NULL);
+   fixscript_register_fast_native_func(heap, "fast_create_arrays#1", fast_create_arrays, "ai", NULL);
+   fixscript_register_fast_native_func(heap, "fast_check#1", fast_check, "vi", NULL);
+   fixscript_register_fast_native_func(heap, "fast_bench#1", fast_bench, "ii", NULL);
+   fixscript_register_native_func(heap, "native_bench#1", native_bench, NULL);
 
    alt_heap = fixscript_create_heap();
    fixscript_register_native_func(heap, "test_alt_heap#2", test_alt_heap, alt_heap);
@@ -499,9 +646,19 @@ int main(int argc, char **argv)
    fixscript_register_native_func(alt_heap, "dummy_native_func#0", dummy_func, NULL);
    fixscript_register_native_func(alt_heap, "create_native_ref#1", dummy_func, NULL);
    fixscript_register_native_func(alt_heap, "create_heap#0", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "create_heap#1", dummy_func, NULL);
    fixscript_register_native_func(alt_heap, "heap_reload_script#3", dummy_func, NULL);
    fixscript_register_native_func(alt_heap, "heap_run_func#3", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "heap_get_jit_addr#3", dummy_func, NULL);
    fixscript_register_native_func(alt_heap, "run_later#1", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_add#2", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_mul_float#2", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_array_length#1", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_create_array#1", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_create_arrays#1", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_check#1", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "fast_bench#1", dummy_func, NULL);
+   fixscript_register_native_func(alt_heap, "native_bench#1", dummy_func, NULL);
 
 #ifdef __wasm__
    fixscript_set_auto_suspend_handler(heap, 10000, auto_suspend_func, NULL);
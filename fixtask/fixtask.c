@@ -39,6 +39,7 @@
 #endif
 #endif
 #include "fixtask.h"
+#include "fiximage.h"
 
 enum {
    HANDLE_destroy,
@@ -120,6 +121,27 @@ typedef struct {
 #endif
 } Task;
 
+typedef struct {
+   volatile int refcnt;
+   HeapCreateData hc;
+   char **scripts;
+   int num_scripts;
+} HeapPoolConfig;
+
+typedef struct {
+   HeapPoolConfig *config;
+   Heap **heaps;
+   int num_heaps, size;
+   int hits, misses;
+} HeapPool;
+
+typedef struct {
+   volatile uint64_t *ranges;
+   int num_cores;
+   int from, to, grain;
+   volatile int abort;
+} ParallelSchedule;
+
 typedef struct ComputeHeap {
    Heap *heap;
    Value process_func;
@@ -133,6 +155,7 @@ typedef struct ComputeHeap {
    Heap *parent_heap;
    int from, to;
    int core_id;
+   ParallelSchedule *sched;
    struct ComputeHeap *active_next;
    struct ComputeHeap *inactive_next;
    struct ComputeHeap *finished_next;
@@ -152,6 +175,8 @@ typedef struct {
    pthread_cond_t cond;
    int parallel_mode;
    int from, to, core_id;
+   ParallelSchedule *sched;
+   volatile int affinity;
 } ComputeTasks;
 
 typedef struct {
@@ -159,6 +184,38 @@ typedef struct {
    Value map;
 } ParentHeap;
 
+typedef struct ParallelJob ParallelJob;
+
+typedef struct {
+   ParallelJob *job;
+   ComputeHeap *cheap;
+   int idx;
+   int from, to;
+   Value func;
+   Value combine;
+   Value data;
+   Value range;
+   Value input;
+   int input_off;
+   Value output;
+   Value result;
+   Value error;
+   int ready;
+   int consumed;
+} ParallelChunk;
+
+struct ParallelJob {
+   Heap *parent_heap;
+   Value input;
+   int reduce;
+   int has_data;
+   int num_chunks;
+   ParallelChunk *chunks;
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   volatile int abort;
+};
+
 typedef struct ScriptHandle ScriptHandle;
 
 typedef struct {
@@ -239,6 +296,8 @@ typedef struct Channel {
       struct {
          Heap *queue_heap;
          Value queue;
+         int queue_head;
+         volatile int queue_count;
       };
       struct {
          Heap *send_heap;
@@ -264,6 +323,9 @@ typedef struct ChannelEntry {
    Value key;
    struct ChannelEntry *next;
    struct ChannelEntry *notify_next;
+   struct ChannelEntry *ready_prev;
+   struct ChannelEntry *ready_next;
+   int ready;
 } ChannelEntry;
 
 typedef struct ChannelSet {
@@ -271,8 +333,9 @@ typedef struct ChannelSet {
    pthread_cond_t cond;
    ChannelEntry **entries;
    int entries_cnt, entries_cap;
-   ChannelEntry **notify_list;
-   int notify_cnt, notify_cap;
+   ChannelEntry *ready_first;
+   ChannelEntry *ready_last;
+   int ready_cnt;
 #ifdef __wasm__
    void *cont_data;
 #endif
@@ -290,6 +353,19 @@ typedef struct {
    int sending_signal;
 } AsyncIntegration;
 
+#define NUM_GLOBAL_SHARDS 16
+
+typedef struct {
+   pthread_mutex_t mutex;
+   Heap *heap;
+   Value hash;
+   volatile uint32_t version;
+} GlobalShard;
+
+typedef struct {
+   Value hash;
+} GlobalCache;
+
 #define NUM_HANDLE_TYPES 7
 #define HANDLE_TYPE_TASK        (handles_offset+0)
 #define HANDLE_TYPE_HEAP        (handles_offset+1)
@@ -306,6 +382,7 @@ static volatile int compute_tasks_key;
 static volatile int is_queue_heap_key;
 static volatile int parent_heap_key;
 static volatile int async_integration_key;
+static volatile int global_cache_key;
 
 #define GET_PTR(ptr) (void *)((intptr_t)(ptr) & ~3)
 #define GET_FLAGS(ptr) ((intptr_t)(ptr) & 3)
@@ -314,8 +391,8 @@ static volatile int async_integration_key;
 static volatile pthread_mutex_t *global_mutex;
 static volatile int atomic_initialized = 0;
 static pthread_mutex_t atomic_mutex[16];
-static Heap *global_heap;
-static Value global_hash;
+static GlobalShard * volatile global_shards;
+static HeapPool heap_pool;
 #ifdef _WIN32
 #define RECURSIVE_MUTEX_ATTR NULL
 #else
@@ -542,6 +619,257 @@ static void thread_run(void *data)
 #endif
 
 
+static pthread_mutex_t *get_global_mutex();
+
+static void unref_heap_pool_config(HeapPoolConfig *config)
+{
+   int i;
+
+   if (config && __sync_sub_and_fetch(&config->refcnt, 1) == 0) {
+      for (i=0; i<config->num_scripts; i++) {
+         free(config->scripts[i]);
+      }
+      free(config->scripts);
+      free(config);
+   }
+}
+
+
+static int is_same_heap_create_data(HeapCreateData *hc1, HeapCreateData *hc2)
+{
+   return hc1->create_func == hc2->create_func && hc1->create_data == hc2->create_data &&
+          hc1->load_func == hc2->load_func && hc1->load_data == hc2->load_data;
+}
+
+
+static Heap *create_pool_heap(HeapPoolConfig *config, Heap *err_heap, Value *err_value)
+{
+   Heap *heap;
+   Value error;
+   int i;
+
+   heap = config->hc.create_func(config->hc.create_data);
+   if (!heap) {
+      if (err_heap) {
+         fixscript_error(err_heap, err_value, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      return NULL;
+   }
+
+   for (i=0; i<config->num_scripts; i++) {
+      if (!config->hc.load_func(heap, config->scripts[i], &error, config->hc.load_data)) {
+         if (err_heap) {
+            *err_value = fixscript_create_error_string(err_heap, fixscript_get_compiler_error(heap, error));
+         }
+         fixscript_free_heap(heap);
+         return NULL;
+      }
+   }
+
+   return heap;
+}
+
+
+static Heap *heap_pool_take(HeapCreateData *hc)
+{
+   pthread_mutex_t *mutex;
+   Heap *heap = NULL;
+
+   mutex = get_global_mutex();
+   if (!mutex) {
+      return NULL;
+   }
+
+   pthread_mutex_lock(mutex);
+   if (heap_pool.config && is_same_heap_create_data(&heap_pool.config->hc, hc)) {
+      if (heap_pool.num_heaps > 0) {
+         heap = heap_pool.heaps[--heap_pool.num_heaps];
+         heap_pool.hits++;
+      }
+      else {
+         heap_pool.misses++;
+      }
+   }
+   pthread_mutex_unlock(mutex);
+   return heap;
+}
+
+
+static void heap_pool_refill(HeapCreateData *hc)
+{
+   pthread_mutex_t *mutex;
+   HeapPoolConfig *config;
+   Heap *heap;
+
+   mutex = get_global_mutex();
+   if (!mutex) {
+      return;
+   }
+
+   pthread_mutex_lock(mutex);
+   config = heap_pool.config;
+   if (!config || !is_same_heap_create_data(&config->hc, hc) || heap_pool.num_heaps >= heap_pool.size) {
+      pthread_mutex_unlock(mutex);
+      return;
+   }
+   (void)__sync_add_and_fetch(&config->refcnt, 1);
+   pthread_mutex_unlock(mutex);
+
+   // create the replacement heap in the finishing thread so the next task can start right away:
+   heap = create_pool_heap(config, NULL, NULL);
+
+   pthread_mutex_lock(mutex);
+   if (heap && heap_pool.config == config && heap_pool.num_heaps < heap_pool.size) {
+      heap_pool.heaps[heap_pool.num_heaps++] = heap;
+      heap = NULL;
+   }
+   pthread_mutex_unlock(mutex);
+
+   if (heap) {
+      fixscript_free_heap(heap);
+   }
+   unref_heap_pool_config(config);
+}
+
+
+static int get_script_names(Heap *heap, Value *error, Value arr, char ***names_out, int *count_out)
+{
+   char **names;
+   Value value;
+   int i, err, count;
+
+   err = fixscript_get_array_length(heap, arr, &count);
+   if (err) {
+      fixscript_error(heap, error, err);
+      return 0;
+   }
+
+   names = calloc(count+1, sizeof(char *));
+   if (!names) {
+      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      return 0;
+   }
+
+   for (i=0; i<count; i++) {
+      err = fixscript_get_array_elem(heap, arr, i, &value);
+      if (!err) {
+         err = fixscript_get_string(heap, value, 0, -1, &names[i], NULL);
+      }
+      if (err) {
+         while (--i >= 0) {
+            free(names[i]);
+         }
+         free(names);
+         fixscript_error(heap, error, err);
+         return 0;
+      }
+   }
+
+   *names_out = names;
+   *count_out = count;
+   return 1;
+}
+
+
+static Value task_set_heap_pool(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   HeapCreateData *hc = data;
+   pthread_mutex_t *mutex;
+   HeapPoolConfig *config = NULL, *old_config;
+   Heap **heaps = NULL, **old_heaps;
+   int i, size, old_num_heaps;
+
+   size = params[0].value;
+   if (size < 0) {
+      *error = fixscript_create_error_string(heap, "negative pool size");
+      return fixscript_int(0);
+   }
+
+   mutex = get_global_mutex();
+   if (!mutex) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   if (size > 0) {
+      config = calloc(1, sizeof(HeapPoolConfig));
+      heaps = calloc(size, sizeof(Heap *));
+      if (!config || !heaps) {
+         free(config);
+         free(heaps);
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      config->refcnt = 1;
+      config->hc = *hc;
+      if (!get_script_names(heap, error, params[1], &config->scripts, &config->num_scripts)) {
+         free(config);
+         free(heaps);
+         return fixscript_int(0);
+      }
+
+      for (i=0; i<size; i++) {
+         heaps[i] = create_pool_heap(config, heap, error);
+         if (!heaps[i]) {
+            while (--i >= 0) {
+               fixscript_free_heap(heaps[i]);
+            }
+            free(heaps);
+            unref_heap_pool_config(config);
+            return fixscript_int(0);
+         }
+      }
+   }
+
+   pthread_mutex_lock(mutex);
+   old_config = heap_pool.config;
+   old_heaps = heap_pool.heaps;
+   old_num_heaps = heap_pool.num_heaps;
+   heap_pool.config = config;
+   heap_pool.heaps = heaps;
+   heap_pool.num_heaps = size;
+   heap_pool.size = size;
+   heap_pool.hits = 0;
+   heap_pool.misses = 0;
+   pthread_mutex_unlock(mutex);
+
+   for (i=0; i<old_num_heaps; i++) {
+      fixscript_free_heap(old_heaps[i]);
+   }
+   free(old_heaps);
+   unref_heap_pool_config(old_config);
+   return fixscript_int(0);
+}
+
+
+static Value task_get_heap_pool_stats(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   pthread_mutex_t *mutex;
+   Value arr, values[4];
+   int err;
+
+   mutex = get_global_mutex();
+   if (!mutex) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   pthread_mutex_lock(mutex);
+   values[0] = fixscript_int(heap_pool.num_heaps);
+   values[1] = fixscript_int(heap_pool.size);
+   values[2] = fixscript_int(heap_pool.hits);
+   values[3] = fixscript_int(heap_pool.misses);
+   pthread_mutex_unlock(mutex);
+
+   arr = fixscript_create_array(heap, 4);
+   if (!arr.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   err = fixscript_set_array_range(heap, arr, 0, 4, values);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   return arr;
+}
+
+
 #if defined(_WIN32)
 static DWORD WINAPI thread_main(void *data)
 #else
@@ -549,6 +877,7 @@ static void *thread_main(void *data)
 #endif
 {
    Task *task = data;
+   HeapCreateData hc = task->hc;
    Heap *heap;
    Script *script;
    Value params, *values = NULL, func_val, error;
@@ -558,7 +887,10 @@ static void *thread_main(void *data)
    ThreadData *td;
 #endif
 
-   heap = task->hc.create_func(task->hc.create_data);
+   heap = heap_pool_take(&task->hc);
+   if (!heap) {
+      heap = task->hc.create_func(task->hc.create_data);
+   }
    if (!heap) {
       goto error;
    }
@@ -636,10 +968,12 @@ error:
    free(values);
    fixscript_unref(task->comm_heap, task->task_val);
    fixscript_collect_heap(task->comm_heap);
+   // the task can be freed by releasing the reference, the local copy is used for refilling:
    task_handle_func(NULL, HANDLE_OP_FREE, task, NULL);
    if (heap) {
       fixscript_free_heap(heap);
    }
+   heap_pool_refill(&hc);
 #if defined(_WIN32)
    return 0;
 #else
@@ -1046,6 +1380,68 @@ static void task_receive_cancel(void *data)
 #endif
 
 
+static Value channel_send(Heap *heap, Value *error, int num_params, Value *params, void *data);
+
+static Value send_move(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   Value new_params[2], msg, retval;
+   void *ptr;
+   int err, len;
+
+   // the target is checked first so the message isn't lost on the common errors:
+   if (data) {
+      ptr = fixscript_get_handle(heap, params[0], HANDLE_TYPE_CHANNEL, NULL);
+      if (!ptr) {
+         *error = fixscript_create_error_string(heap, "invalid channel handle");
+         return fixscript_int(0);
+      }
+      if (GET_FLAGS(ptr) == CHANNEL_RECEIVER) {
+         *error = fixscript_create_error_string(heap, "can't send on receiver channel");
+         return fixscript_int(0);
+      }
+   }
+   else if (num_params == 1) {
+      if (!fixscript_get_heap_data(heap, cur_task_key)) {
+         *error = fixscript_create_error_string(heap, "not in task thread");
+         return fixscript_int(0);
+      }
+   }
+   else if (!fixscript_get_handle(heap, params[0], HANDLE_TYPE_TASK, NULL)) {
+      *error = fixscript_create_error_string(heap, "invalid task");
+      return fixscript_int(0);
+   }
+
+   new_params[0] = params[0];
+   new_params[1] = num_params > 1? params[1] : fixscript_int(0);
+
+   msg = params[num_params-1];
+   err = fixscript_move_to_shared_array(heap, msg, &new_params[num_params-1]);
+   if (err == FIXSCRIPT_ERR_INVALID_ACCESS || err == FIXSCRIPT_ERR_INVALID_SHARED_ARRAY_OPERATION) {
+      *error = fixscript_create_error_string(heap, "message must be an array of integers");
+      return fixscript_int(0);
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   if (data) {
+      retval = channel_send(heap, error, num_params, new_params, NULL);
+   }
+   else {
+      retval = task_send(heap, error, num_params, new_params, NULL);
+   }
+
+   // the content is copied back to the passed array when the sending failed,
+   // the original error is kept even when the copying fails:
+   if (error->value && new_params[num_params-1].value != msg.value) {
+      if (fixscript_get_array_length(heap, new_params[num_params-1], &len) == 0 && fixscript_set_array_length(heap, msg, len) == 0) {
+         fixscript_copy_array(heap, msg, 0, new_params[num_params-1], 0, len);
+      }
+   }
+   return retval;
+}
+
+
 static Value task_receive(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
    int wait = (data != NULL);
@@ -1237,6 +1633,55 @@ static void unref_compute_tasks(ComputeTasks *tasks)
 
 
 #ifndef __wasm__
+#define SCHED_RANGE_STRIDE 8 // keep each range in a separate cache line
+#define SCHED_RANGE(sched, id) (sched)->ranges[(id)*SCHED_RANGE_STRIDE]
+#define SCHED_PACK(head, tail) ((uint64_t)(uint32_t)(head) | ((uint64_t)(uint32_t)(tail) << 32))
+
+static int get_parallel_chunk(ParallelSchedule *sched, int id, int *from, int *to)
+{
+   uint64_t value, own;
+   uint32_t head, tail, steal;
+   int i, victim, chunk;
+
+   for (;;) {
+      value = SCHED_RANGE(sched, id);
+      head = (uint32_t)value;
+      tail = (uint32_t)(value >> 32);
+      if (head >= tail) break;
+      if (__sync_bool_compare_and_swap(&SCHED_RANGE(sched, id), value, SCHED_PACK(head+1, tail))) {
+         chunk = head;
+         goto found;
+      }
+   }
+
+   // own range is empty, steal the upper half of the remaining range of another core:
+   own = value;
+   for (i=1; i<sched->num_cores; i++) {
+      victim = (id + i) % sched->num_cores;
+      for (;;) {
+         value = SCHED_RANGE(sched, victim);
+         head = (uint32_t)value;
+         tail = (uint32_t)(value >> 32);
+         if (head >= tail) break;
+         steal = (tail - head + 1) >> 1;
+         if (__sync_bool_compare_and_swap(&SCHED_RANGE(sched, victim), value, SCHED_PACK(head, tail - steal))) {
+            chunk = tail - steal;
+            if (steal > 1) {
+               // nobody else can modify an empty range so the swap always succeeds:
+               __sync_bool_compare_and_swap(&SCHED_RANGE(sched, id), own, SCHED_PACK(chunk+1, tail));
+            }
+            goto found;
+         }
+      }
+   }
+   return 0;
+
+found:
+   *from = sched->from + (int)((int64_t)chunk * (int64_t)sched->grain);
+   *to = (sched->to - *from) > sched->grain? *from + sched->grain : sched->to;
+   return 1;
+}
+
 typedef struct {
    ComputeTasks *tasks;
    int id;
@@ -1250,10 +1695,10 @@ static void *compute_thread_main(void *data)
 {
    ComputeThreadData *ctd = data;
    ComputeTasks *tasks;
-   ComputeHeap *heap;
+   ComputeHeap *heap, **prev;
    ParentHeap parent_heap;
    pthread_cond_t *cond;
-   int id, err;
+   int id, err, from, to, core, cur_core = -1;
 
    tasks = ctd->tasks;
    id = ctd->id;
@@ -1268,11 +1713,28 @@ static void *compute_thread_main(void *data)
       if (tasks->quit) {
          break;
       }
-      heap = tasks->active_heaps;
-      tasks->active_heaps = heap->active_next;
+      prev = &tasks->active_heaps;
+      if (tasks->affinity) {
+         // prefer the part of parallel work that belongs to this core so it touches the same memory each time:
+         for (heap = tasks->active_heaps; heap; heap = heap->active_next) {
+            if (heap->parent_heap && heap->core_id == id) break;
+            prev = &heap->active_next;
+         }
+         if (!heap) {
+            prev = &tasks->active_heaps;
+         }
+      }
+      heap = *prev;
+      *prev = heap->active_next;
       heap->active_next = NULL;
+      core = tasks->affinity? id : -1;
       pthread_mutex_unlock(&tasks->mutex);
 
+      if (core != cur_core) {
+         fiximage_bind_thread_to_core(core);
+         cur_core = core;
+      }
+
       if (heap->run_func) {
          heap->run_func(heap->heap, heap->core_id, heap->run_data);
       }
@@ -1285,6 +1747,19 @@ static void *compute_thread_main(void *data)
             if (err) {
                heap->result = fixscript_error(heap->heap, &heap->error, err);
             }
+            else if (heap->sched) {
+               heap->result = fixscript_int(0);
+               heap->error = fixscript_int(0);
+               while (!heap->sched->abort && get_parallel_chunk(heap->sched, heap->core_id, &from, &to)) {
+                  fixscript_call(heap->heap, heap->process_func, 4, &heap->error, heap->process_data, fixscript_int(from), fixscript_int(to), fixscript_int(heap->core_id));
+                  if (heap->error.value) {
+                     heap->sched->abort = 1;
+                     break;
+                  }
+               }
+               fixscript_unref(heap->heap, parent_heap.map);
+               fixscript_set_heap_data(heap->heap, parent_heap_key, NULL, NULL);
+            }
             else {
                heap->result = fixscript_call(heap->heap, heap->process_func, 4, &heap->error, heap->process_data, fixscript_int(heap->from), fixscript_int(heap->to), fixscript_int(heap->core_id));
                fixscript_unref(heap->heap, parent_heap.map);
@@ -1310,6 +1785,7 @@ static void *compute_thread_main(void *data)
          heap->finished_next = tasks->finished_heaps;
          tasks->finished_heaps = heap;
          heap->parent_heap = NULL;
+         heap->sched = NULL;
       }
       pthread_cond_signal(&tasks->cond);
    }
@@ -1687,6 +2163,7 @@ static Value compute_task_run(Heap *heap, Value *error, int num_params, Value *p
       cheap->from = tasks->from;
       cheap->to = tasks->to;
       cheap->core_id = tasks->core_id;
+      cheap->sched = tasks->sched;
    }
 
    pthread_mutex_lock(&tasks->mutex);
@@ -1766,13 +2243,105 @@ static Value compute_task_finish_all(Heap *heap, Value *error, int num_params, V
 }
 
 
-static Value compute_task_get_core_count(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static Value compute_task_preload(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   return fixscript_int(fixtask_get_core_count(heap));
-}
-
-
-static Value compute_task_run_parallel(Heap *heap, Value *error, int num_params, Value *params, void *data)
+#ifdef __wasm__
+   return fixscript_int(0);
+#else
+   HeapCreateData *hc = data;
+   ComputeTasks *tasks;
+   ComputeHeap *cheap, *taken = NULL;
+   Value load_error;
+   char **names;
+   int i, count, num_taken = 0;
+
+   tasks = get_compute_tasks(heap, hc);
+   if (!tasks) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   if (!get_script_names(heap, error, params[0], &names, &count)) {
+      return fixscript_int(0);
+   }
+
+   // take every heap out of the pool so the scripts can be loaded while the heap isn't used:
+   while (num_taken < tasks->num_heaps && !error->value) {
+      pthread_mutex_lock(&tasks->mutex);
+      for (;;) {
+         if (tasks->inactive_heaps) break;
+
+         finish_tasks(heap, error, tasks);
+         if (error->value) break;
+      
+         if (tasks->inactive_heaps) break;
+
+         pthread_cond_wait(&tasks->cond, &tasks->mutex);
+      }
+      cheap = error->value? NULL : tasks->inactive_heaps;
+      if (cheap) {
+         tasks->inactive_heaps = cheap->inactive_next;
+      }
+      pthread_mutex_unlock(&tasks->mutex);
+      if (!cheap) break;
+
+      for (i=0; i<count; i++) {
+         if (!hc->load_func(cheap->heap, names[i], &load_error, hc->load_data)) {
+            *error = fixscript_create_error_string(heap, fixscript_get_compiler_error(cheap->heap, load_error));
+            break;
+         }
+      }
+      fixscript_collect_heap(cheap->heap);
+
+      cheap->inactive_next = taken;
+      taken = cheap;
+      num_taken++;
+   }
+
+   pthread_mutex_lock(&tasks->mutex);
+   while (taken) {
+      cheap = taken;
+      taken = cheap->inactive_next;
+      cheap->inactive_next = tasks->inactive_heaps;
+      tasks->inactive_heaps = cheap;
+   }
+   pthread_cond_signal(&tasks->cond);
+   pthread_mutex_unlock(&tasks->mutex);
+
+   for (i=0; i<count; i++) {
+      free(names[i]);
+   }
+   free(names);
+   return fixscript_int(0);
+#endif
+}
+
+
+static Value compute_task_set_thread_affinity(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#ifdef __wasm__
+   return fixscript_int(0);
+#else
+   HeapCreateData *hc = data;
+   ComputeTasks *tasks;
+
+   tasks = get_compute_tasks(heap, hc);
+   if (!tasks) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   tasks->affinity = (params[0].value != 0);
+   return fixscript_int(0);
+#endif
+}
+
+
+static Value compute_task_get_core_count(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   return fixscript_int(fixtask_get_core_count(heap));
+}
+
+
+static Value compute_task_run_parallel(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
 #ifdef __wasm__
    ContinuationResultFunc cont_func;
@@ -1858,6 +2427,534 @@ static Value compute_task_run_parallel(Heap *heap, Value *error, int num_params,
 }
 
 
+static Value compute_task_run_parallel_dynamic(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+#ifdef __wasm__
+   ContinuationResultFunc cont_func;
+   void *cont_data;
+
+   fixscript_suspend(heap, &cont_func, &cont_data);
+   fixscript_call_async(heap, params[num_params-2], 4, (Value[]) { params[num_params-1], params[0], params[1], fixscript_int(0) }, cont_func, cont_data);
+   return fixscript_int(0);
+#else
+   HeapCreateData *hc = data;
+   ComputeTasks *tasks;
+   ParallelSchedule sched;
+   Value params2[2], error2 = fixscript_int(0);
+   int i, from, to, grain, num_cores, num_chunks;
+
+   tasks = get_compute_tasks(heap, hc);
+   if (!tasks) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   from = params[0].value;
+   to = params[1].value;
+   num_cores = tasks->num_cores;
+
+   if (from >= to) {
+      return fixscript_int(0);
+   }
+
+   if (num_params == 5) {
+      grain = params[2].value;
+      if (grain < 1) {
+         grain = 1;
+      }
+   }
+   else {
+      grain = (int)(((int64_t)to - (int64_t)from) / (num_cores * 16));
+      if (grain < 1) {
+         grain = 1;
+      }
+   }
+
+   num_chunks = (int)(((int64_t)to - (int64_t)from + grain - 1) / grain);
+   if (num_chunks < 2 || num_cores == 1) {
+      fixscript_call(heap, params[num_params-2], 4, error, params[num_params-1], fixscript_int(from), fixscript_int(to), fixscript_int(0));
+      return fixscript_int(0);
+   }
+   if (num_cores > num_chunks) {
+      num_cores = num_chunks;
+   }
+
+   compute_task_finish_all(heap, error, 0, NULL, NULL);
+   if (error->value) {
+      return fixscript_int(0);
+   }
+
+   sched.ranges = calloc(num_cores * SCHED_RANGE_STRIDE, sizeof(uint64_t));
+   if (!sched.ranges) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   sched.num_cores = num_cores;
+   sched.from = from;
+   sched.to = to;
+   sched.grain = grain;
+   sched.abort = 0;
+   for (i=0; i<num_cores; i++) {
+      SCHED_RANGE(&sched, i) = SCHED_PACK((int64_t)num_chunks * i / num_cores, (int64_t)num_chunks * (i+1) / num_cores);
+   }
+
+   params2[0] = params[num_params-2];
+   params2[1] = params[num_params-1];
+   tasks->parallel_mode = 1;
+   tasks->sched = &sched;
+
+   for (i=0; i<num_cores; i++) {
+      tasks->core_id = i;
+      tasks->from = from;
+      tasks->to = to;
+      compute_task_run(heap, error, 2, params2, hc);
+      if (error->value) {
+         sched.abort = 1;
+         break;
+      }
+   }
+
+   tasks->parallel_mode = 0;
+   tasks->sched = NULL;
+   compute_task_finish_all(heap, &error2, 0, NULL, NULL);
+   if (!error->value) {
+      *error = error2;
+   }
+   free((void *)sched.ranges);
+   return fixscript_int(0);
+#endif
+}
+
+
+static Value parallel_call(Heap *heap, ParallelChunk *chunk, Value func, int num_args, Value a, Value b)
+{
+   Value args[3];
+
+   args[0] = chunk->data;
+   args[1] = a;
+   args[2] = b;
+   if (chunk->job->has_data) {
+      return fixscript_call_args(heap, func, num_args+1, &chunk->error, args);
+   }
+   return fixscript_call_args(heap, func, num_args, &chunk->error, args+1);
+}
+
+
+static void parallel_process_chunk(Heap *heap, ParallelChunk *chunk)
+{
+   ParallelJob *job = chunk->job;
+   Value values[128], value;
+   int i, err, off, cnt;
+
+   for (off=chunk->from; off<chunk->to; off+=cnt) {
+      cnt = chunk->to - off;
+      if (cnt > sizeof(values)/sizeof(Value)) {
+         cnt = sizeof(values)/sizeof(Value);
+      }
+
+      err = fixscript_get_array_range(heap, chunk->input, off - chunk->input_off, cnt, values);
+      if (err) {
+         fixscript_error(heap, &chunk->error, err);
+         return;
+      }
+
+      for (i=0; i<cnt; i++) {
+         if (job->abort) {
+            return;
+         }
+
+         value = values[i];
+         if (job->reduce) {
+            if (off+i > chunk->from) {
+               value = parallel_call(heap, chunk, chunk->func, 2, chunk->result, value);
+               if (chunk->error.value) {
+                  return;
+               }
+            }
+            fixscript_ref(heap, value);
+            fixscript_unref(heap, chunk->result);
+            chunk->result = value;
+            continue;
+         }
+
+         value = parallel_call(heap, chunk, chunk->func, 1, value, fixscript_int(0));
+         if (chunk->error.value) {
+            return;
+         }
+         if (!fixscript_is_int(value) && !fixscript_is_float(value)) {
+            chunk->error = fixscript_create_error_string(heap, "map function must return integer or float");
+            return;
+         }
+         // each chunk writes only into its part of the shared output array:
+         err = fixscript_set_array_elem(heap, chunk->output, off+i, value);
+         if (err) {
+            fixscript_error(heap, &chunk->error, err);
+            return;
+         }
+      }
+   }
+}
+
+
+#ifndef __wasm__
+static void parallel_combine(Heap *heap, ParallelChunk *chunk, ParallelChunk *other)
+{
+   Value value;
+   int err;
+
+   err = fixscript_clone_between(heap, other->cheap->heap, other->result, &value, fixscript_resolve_existing, NULL, &chunk->error);
+   if (err) {
+      if (!chunk->error.value) {
+         fixscript_error(heap, &chunk->error, err);
+      }
+      return;
+   }
+
+   value = parallel_call(heap, chunk, chunk->combine, 2, chunk->result, value);
+   if (chunk->error.value) {
+      return;
+   }
+   fixscript_ref(heap, value);
+   fixscript_unref(heap, chunk->result);
+   chunk->result = value;
+}
+
+
+static void parallel_chunk_run(Heap *heap, int core_id, void *data)
+{
+   ParallelChunk *chunk = data, *other;
+   ParallelJob *job = chunk->job;
+   ParentHeap parent_heap;
+   int err, err2, step;
+
+   parent_heap.heap = job->parent_heap;
+   parent_heap.map = fixscript_int(0);
+
+   err = fixscript_set_heap_data(heap, parent_heap_key, &parent_heap, NULL);
+   if (err) {
+      fixscript_error(heap, &chunk->error, err);
+   }
+   else {
+      if (!chunk->input.value) {
+         // the part of the array is cloned at once from the parent heap (it's not running at this time):
+         err2 = fixscript_clone_between(heap, job->parent_heap, chunk->range, &chunk->input, fixscript_resolve_existing, NULL, &chunk->error);
+         if (err2) {
+            if (!chunk->error.value) {
+               fixscript_error(heap, &chunk->error, err2);
+            }
+         }
+         else {
+            fixscript_ref(heap, chunk->input);
+         }
+      }
+      if (!chunk->error.value) {
+         parallel_process_chunk(heap, chunk);
+      }
+   }
+   if (chunk->error.value) {
+      job->abort = 1;
+   }
+
+   // merge the partial results of the reduction pairwise so the number of chunks is halved at each level,
+   // the donor chunk waits until its result is taken so its heap stays untouched:
+   for (step=1; job->reduce && step<job->num_chunks; step<<=1) {
+      if (chunk->idx & step) {
+         pthread_mutex_lock(&job->mutex);
+         chunk->ready = 1;
+         pthread_cond_broadcast(&job->cond);
+         while (!chunk->consumed) {
+            pthread_cond_wait(&job->cond, &job->mutex);
+         }
+         pthread_mutex_unlock(&job->mutex);
+         break;
+      }
+      if (chunk->idx + step >= job->num_chunks) {
+         continue;
+      }
+
+      other = &job->chunks[chunk->idx + step];
+      pthread_mutex_lock(&job->mutex);
+      while (!other->ready) {
+         pthread_cond_wait(&job->cond, &job->mutex);
+      }
+      pthread_mutex_unlock(&job->mutex);
+
+      if (!job->abort) {
+         parallel_combine(heap, chunk, other);
+         if (chunk->error.value) {
+            job->abort = 1;
+         }
+      }
+
+      pthread_mutex_lock(&job->mutex);
+      other->consumed = 1;
+      pthread_cond_broadcast(&job->cond);
+      pthread_mutex_unlock(&job->mutex);
+   }
+
+   fixscript_ref(heap, chunk->error);
+   if (!err) {
+      fixscript_unref(heap, parent_heap.map);
+      fixscript_set_heap_data(heap, parent_heap_key, NULL, NULL);
+   }
+}
+
+
+static int parallel_clone_to(Heap *heap, Value *error, HeapCreateData *hc, Heap *dest, Value value, Value *clone)
+{
+   int err;
+
+   err = fixscript_clone_between(dest, heap, value, clone, hc->load_func, hc->load_data, error);
+   if (err) {
+      if (error->value) {
+         if (fixscript_clone_between(heap, dest, *error, error, NULL, NULL, NULL) != FIXSCRIPT_SUCCESS) {
+            *error = fixscript_int(0);
+         }
+      }
+      if (error->value) {
+         *error = fixscript_create_error(heap, *error);
+      }
+      else {
+         fixscript_error(heap, error, err);
+      }
+      return 0;
+   }
+
+   fixscript_ref(dest, *clone);
+   return 1;
+}
+
+
+static Value run_parallel_job(Heap *heap, Value *error, HeapCreateData *hc, ParallelJob *job, Value func, Value combine, Value data, Value output, int len)
+{
+   ComputeTasks *tasks;
+   ComputeHeap *cheap;
+   ParallelChunk *chunk;
+   Value result = fixscript_int(0);
+   int i, err, num_chunks, num_inactive;
+
+   tasks = get_compute_tasks(heap, hc);
+   if (!tasks) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   compute_task_finish_all(heap, error, 0, NULL, NULL);
+   if (error->value) {
+      return fixscript_int(0);
+   }
+
+   num_chunks = tasks->num_cores;
+   if (num_chunks > len) {
+      num_chunks = len;
+   }
+
+   job->chunks = calloc(num_chunks, sizeof(ParallelChunk));
+   if (!job->chunks) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   job->num_chunks = num_chunks;
+
+   if (pthread_mutex_init(&job->mutex, NULL) != 0) {
+      free(job->chunks);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   if (pthread_cond_init(&job->cond, NULL) != 0) {
+      pthread_mutex_destroy(&job->mutex);
+      free(job->chunks);
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+
+   pthread_mutex_lock(&tasks->mutex);
+   for (i=0; i<num_chunks; i++) {
+      cheap = tasks->inactive_heaps;
+      tasks->inactive_heaps = cheap->inactive_next;
+      cheap->inactive_next = NULL;
+      job->chunks[i].cheap = cheap;
+   }
+   pthread_mutex_unlock(&tasks->mutex);
+
+   for (i=0; i<num_chunks; i++) {
+      chunk = &job->chunks[i];
+      chunk->job = job;
+      chunk->idx = i;
+      chunk->from = (int64_t)len * i / num_chunks;
+      chunk->to = (int64_t)len * (i+1) / num_chunks;
+
+      cheap = chunk->cheap;
+      if (!parallel_clone_to(heap, error, hc, cheap->heap, func, &chunk->func)) break;
+      if (!parallel_clone_to(heap, error, hc, cheap->heap, combine, &chunk->combine)) break;
+      if (!parallel_clone_to(heap, error, hc, cheap->heap, data, &chunk->data)) break;
+      if (!parallel_clone_to(heap, error, hc, cheap->heap, output, &chunk->output)) break;
+      if (fixscript_is_shared_array(heap, job->input)) {
+         if (!parallel_clone_to(heap, error, hc, cheap->heap, job->input, &chunk->input)) break;
+         continue;
+      }
+
+      // other arrays are copied into a separate array for each chunk so each can be cloned in a single batch:
+      chunk->range = fixscript_create_array(heap, chunk->to - chunk->from);
+      if (!chunk->range.value) {
+         fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+         break;
+      }
+      err = fixscript_copy_array(heap, chunk->range, 0, job->input, chunk->from, chunk->to - chunk->from);
+      if (err) {
+         fixscript_error(heap, error, err);
+         break;
+      }
+      chunk->input_off = chunk->from;
+   }
+
+   pthread_mutex_lock(&tasks->mutex);
+   for (i=0; i<num_chunks; i++) {
+      cheap = job->chunks[i].cheap;
+      if (error->value) {
+         cheap->inactive_next = tasks->inactive_heaps;
+         tasks->inactive_heaps = cheap;
+         continue;
+      }
+      cheap->run_func = parallel_chunk_run;
+      cheap->run_data = &job->chunks[i];
+      cheap->core_id = i;
+      cheap->active_next = tasks->active_heaps;
+      tasks->active_heaps = cheap;
+   }
+   for (i=0; i<tasks->num_cores; i++) {
+      pthread_cond_signal(&tasks->conds[i]);
+   }
+   for (;;) {
+      num_inactive = 0;
+      cheap = tasks->inactive_heaps;
+      while (cheap) {
+         num_inactive++;
+         cheap = cheap->inactive_next;
+      }
+      if (num_inactive == tasks->num_heaps) break;
+
+      pthread_cond_wait(&tasks->cond, &tasks->mutex);
+   }
+   pthread_mutex_unlock(&tasks->mutex);
+
+   if (!error->value) {
+      for (i=0; i<num_chunks; i++) {
+         chunk = &job->chunks[i];
+         if (!chunk->error.value) continue;
+
+         err = fixscript_clone_between(heap, chunk->cheap->heap, chunk->error, error, fixscript_resolve_existing, NULL, NULL);
+         if (err) {
+            fixscript_error(heap, error, err);
+         }
+         else {
+            *error = fixscript_create_error(heap, *error);
+         }
+         break;
+      }
+   }
+
+   if (!error->value) {
+      if (!job->reduce) {
+         result = output;
+      }
+      else {
+         chunk = &job->chunks[0];
+         err = fixscript_clone_between(heap, chunk->cheap->heap, chunk->result, &result, fixscript_resolve_existing, NULL, NULL);
+         if (err) {
+            fixscript_error(heap, error, err);
+         }
+      }
+   }
+
+   for (i=0; i<num_chunks; i++) {
+      chunk = &job->chunks[i];
+      cheap = chunk->cheap;
+      fixscript_unref(cheap->heap, chunk->func);
+      fixscript_unref(cheap->heap, chunk->combine);
+      fixscript_unref(cheap->heap, chunk->data);
+      fixscript_unref(cheap->heap, chunk->input);
+      fixscript_unref(cheap->heap, chunk->output);
+      fixscript_unref(cheap->heap, chunk->result);
+      fixscript_unref(cheap->heap, chunk->error);
+   }
+
+   pthread_cond_destroy(&job->cond);
+   pthread_mutex_destroy(&job->mutex);
+   free(job->chunks);
+   return result;
+}
+#endif
+
+
+static Value compute_task_parallel(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   int reduce = (data != NULL);
+   ParallelJob job;
+   ParallelChunk chunk;
+   Value func, combine, func_data, output = fixscript_int(0), result;
+   int err, len, elem_size;
+
+   func = params[1];
+   combine = reduce? params[2] : fixscript_int(0);
+   func_data = num_params > (reduce? 3 : 2)? params[num_params-1] : fixscript_int(0);
+
+   err = fixscript_get_array_length(heap, params[0], &len);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+   if (len == 0 && reduce) {
+      return fixscript_int(0);
+   }
+
+   memset(&job, 0, sizeof(ParallelJob));
+   job.parent_heap = heap;
+   job.input = params[0];
+   job.reduce = reduce;
+   job.has_data = (num_params > (reduce? 3 : 2));
+
+   if (!reduce) {
+      // the results are stored directly into a new shared array, each thread writes only into its own part:
+      elem_size = 4;
+      if (fixscript_is_shared_array(heap, params[0])) {
+         fixscript_get_shared_array_data(heap, params[0], NULL, &elem_size, NULL, -1, NULL);
+      }
+      output = fixscript_create_shared_array(heap, len, elem_size);
+      if (!output.value) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      if (len == 0) {
+         return output;
+      }
+   }
+
+#ifndef __wasm__
+   if (fixtask_get_core_count(heap) > 1 && len > 1) {
+      fixscript_ref(heap, output);
+      result = run_parallel_job(heap, error, fixscript_get_heap_data(heap, heap_create_data_key), &job, func, combine, func_data, output, len);
+      fixscript_unref(heap, output);
+      return result;
+   }
+#endif
+
+   memset(&chunk, 0, sizeof(ParallelChunk));
+   chunk.job = &job;
+   chunk.from = 0;
+   chunk.to = len;
+   chunk.func = func;
+   chunk.combine = combine;
+   chunk.data = func_data;
+   chunk.input = params[0];
+   chunk.output = output;
+   job.num_chunks = 1;
+   job.chunks = &chunk;
+
+   fixscript_ref(heap, output);
+   parallel_process_chunk(heap, &chunk);
+   fixscript_unref(heap, output);
+   fixscript_unref(heap, chunk.result);
+   if (chunk.error.value) {
+      *error = chunk.error;
+      return fixscript_int(0);
+   }
+   return reduce? chunk.result : output;
+}
+
+
 static int get_parent_ref(Heap *heap, Value *error, Heap **parent_heap_out, Value *value)
 {
    ParentHeap *parent_heap;
@@ -4998,15 +6095,91 @@ static pthread_mutex_t *get_global_mutex()
 }
 
 
-static int ensure_global_heap()
+static GlobalShard *get_global_shards()
+{
+   pthread_mutex_t *mutex;
+   GlobalShard *shards;
+   int i;
+
+   shards = (GlobalShard *)global_shards;
+   if (shards) {
+      return shards;
+   }
+
+   mutex = get_global_mutex();
+   if (!mutex) {
+      return NULL;
+   }
+
+   pthread_mutex_lock(mutex);
+   shards = (GlobalShard *)global_shards;
+   if (!shards) {
+      shards = calloc(NUM_GLOBAL_SHARDS, sizeof(GlobalShard));
+      if (shards) {
+         for (i=0; i<NUM_GLOBAL_SHARDS; i++) {
+            if (pthread_mutex_init(&shards[i].mutex, NULL) != 0) {
+               while (--i >= 0) {
+                  pthread_mutex_destroy(&shards[i].mutex);
+               }
+               free(shards);
+               shards = NULL;
+               break;
+            }
+         }
+      }
+      if (shards) {
+         __sync_synchronize();
+         global_shards = shards;
+      }
+   }
+   pthread_mutex_unlock(mutex);
+   return shards;
+}
+
+
+static int get_global_shard(Heap *heap, Value key, GlobalShard **shard_out, int *idx_out)
 {
-   if (!global_heap) {
-      global_heap = fixscript_create_heap();
-      if (!global_heap) {
+   GlobalShard *shards;
+   char *buf;
+   uint32_t hash = 2166136261U;
+   int i, len, err;
+
+   shards = get_global_shards();
+   if (!shards) {
+      return FIXSCRIPT_ERR_OUT_OF_MEMORY;
+   }
+
+   // the serialized form is the same in every heap so it can select the shard:
+   err = fixscript_serialize_to_array(heap, &buf, &len, key);
+   if (err == FIXSCRIPT_SUCCESS) {
+      for (i=0; i<len; i++) {
+         hash = (hash ^ (uint8_t)buf[i]) * 16777619U;
+      }
+      free(buf);
+   }
+   else if (err == FIXSCRIPT_ERR_OUT_OF_MEMORY) {
+      return err;
+   }
+   else {
+      hash = 0;
+   }
+
+   hash ^= hash >> 16;
+   *idx_out = hash & (NUM_GLOBAL_SHARDS-1);
+   *shard_out = &shards[*idx_out];
+   return FIXSCRIPT_SUCCESS;
+}
+
+
+static int ensure_global_heap(GlobalShard *shard)
+{
+   if (!shard->heap) {
+      shard->heap = fixscript_create_heap();
+      if (!shard->heap) {
          return 0;
       }
-      global_hash = fixscript_create_hash(global_heap);
-      fixscript_ref(global_heap, global_hash);
+      shard->hash = fixscript_create_hash(shard->heap);
+      fixscript_ref(shard->heap, shard->hash);
    }
    return 1;
 }
@@ -5014,108 +6187,197 @@ static int ensure_global_heap()
 
 static Value global_set(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   pthread_mutex_t *mutex;
+   GlobalShard *shard;
    Value key, value;
-   int err;
+   int err, idx;
    
-   mutex = get_global_mutex();
-   if (!mutex) {
-      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   err = get_global_shard(heap, params[0], &shard, &idx);
+   if (err) {
+      return fixscript_error(heap, error, err);
    }
 
-   pthread_mutex_lock(mutex);
-   if (!ensure_global_heap()) {
-      pthread_mutex_unlock(mutex);
+   pthread_mutex_lock(&shard->mutex);
+   if (!ensure_global_heap(shard)) {
+      pthread_mutex_unlock(&shard->mutex);
       return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
    }
 
-   err = fixscript_clone_between(global_heap, heap, params[0], &key, NULL, NULL, NULL);
+   err = fixscript_clone_between(shard->heap, heap, params[0], &key, NULL, NULL, NULL);
    if (!err) {
-      err = fixscript_clone_between(global_heap, heap, params[1], &value, NULL, NULL, NULL);
-   }
-   if (!err) {
-      err = fixscript_set_hash_elem(global_heap, global_hash, key, value);
+      if (!params[1].value && !params[1].is_array) {
+         // setting null removes the entry so the shard heap doesn't grow with stale keys:
+         err = fixscript_remove_hash_elem(shard->heap, shard->hash, key, NULL);
+         if (err == FIXSCRIPT_ERR_KEY_NOT_FOUND) {
+            err = FIXSCRIPT_SUCCESS;
+         }
+      }
+      else {
+         err = fixscript_clone_between(shard->heap, heap, params[1], &value, NULL, NULL, NULL);
+         if (!err) {
+            err = fixscript_set_hash_elem(shard->heap, shard->hash, key, value);
+         }
+      }
    }
    if (err) {
-      pthread_mutex_unlock(mutex);
+      pthread_mutex_unlock(&shard->mutex);
       return fixscript_error(heap, error, err);
    }
 
-   pthread_mutex_unlock(mutex);
+   shard->version++;
+   pthread_mutex_unlock(&shard->mutex);
 
    return fixscript_int(0);
 }
 
 
-static Value global_get(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static int global_get_value(Heap *heap, Value *error, HeapCreateData *hc, GlobalShard *shard, Value key_val, Value *value_out, int *version_out)
 {
-   HeapCreateData *hc = data;
-   pthread_mutex_t *mutex;
    Value key, value;
    int err;
+
+   pthread_mutex_lock(&shard->mutex);
+   if (version_out) {
+      *version_out = shard->version;
+   }
+
+   if (!shard->heap) {
+      pthread_mutex_unlock(&shard->mutex);
+      *value_out = fixscript_int(0);
+      return FIXSCRIPT_SUCCESS;
+   }
+
+   err = fixscript_clone_between(shard->heap, heap, key_val, &key, NULL, NULL, NULL);
+   if (!err) {
+      err = fixscript_get_hash_elem(shard->heap, shard->hash, key, &value);
+      if (err == FIXSCRIPT_ERR_KEY_NOT_FOUND) {
+         value = fixscript_int(0);
+         err = FIXSCRIPT_SUCCESS;
+      }
+   }
+   if (err) {
+      pthread_mutex_unlock(&shard->mutex);
+      fixscript_error(heap, error, err);
+      return err;
+   }
+
+   err = fixscript_clone_between(heap, shard->heap, value, value_out, hc->load_func, hc->load_data, error);
+   pthread_mutex_unlock(&shard->mutex);
+
+   if (err) {
+      if (error->value) {
+         *error = fixscript_create_error(heap, *error);
+      }
+      else {
+         fixscript_error(heap, error, err);
+      }
+   }
+   return err;
+}
+
+
+static Value global_get(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   HeapCreateData *hc = data;
+   GlobalShard *shard;
+   Value value;
+   int err, idx;
    
-   mutex = get_global_mutex();
-   if (!mutex) {
+   err = get_global_shard(heap, params[0], &shard, &idx);
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
+
+   if (global_get_value(heap, error, hc, shard, params[0], &value, NULL)) {
       return fixscript_int(0);
    }
+   return value;
+}
 
-   pthread_mutex_lock(mutex);
 
-   if (!global_heap) {
-      pthread_mutex_unlock(mutex);
-      return fixscript_int(0);
+static Value global_get_snapshot(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   HeapCreateData *hc = data;
+   GlobalShard *shards, *shard;
+   GlobalCache *cache;
+   Value entry, values[3], key, value;
+   int err, idx, version;
+
+   cache = fixscript_get_heap_data(heap, global_cache_key);
+   if (!cache) {
+      cache = calloc(1, sizeof(GlobalCache));
+      if (!cache) {
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      cache->hash = fixscript_create_hash(heap);
+      if (!cache->hash.value) {
+         free(cache);
+         return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+      }
+      fixscript_ref(heap, cache->hash);
+      fixscript_set_heap_data(heap, global_cache_key, cache, free);
    }
 
-   err = fixscript_clone_between(global_heap, heap, params[0], &key, NULL, NULL, NULL);
-   if (!err) {
-      err = fixscript_get_hash_elem(global_heap, global_hash, key, &value);
-      if (err == FIXSCRIPT_ERR_KEY_NOT_FOUND) {
-         value = fixscript_int(0);
-         err = FIXSCRIPT_SUCCESS;
+   // entries are stored as [shard index, shard version, value], the value is reused
+   // without locking or cloning as long as the shard wasn't modified since:
+   shards = (GlobalShard *)global_shards;
+   if (shards && fixscript_get_hash_elem(heap, cache->hash, params[0], &entry) == FIXSCRIPT_SUCCESS) {
+      if (fixscript_get_array_range(heap, entry, 0, 3, values) == FIXSCRIPT_SUCCESS) {
+         if (shards[values[0].value].version == (uint32_t)values[1].value) {
+            return values[2];
+         }
       }
    }
+
+   err = get_global_shard(heap, params[0], &shard, &idx);
    if (err) {
-      pthread_mutex_unlock(mutex);
       return fixscript_error(heap, error, err);
    }
 
-   err = fixscript_clone_between(heap, global_heap, value, &value, hc->load_func, hc->load_data, error);
-   pthread_mutex_unlock(mutex);
-
-   if (err) {
-      if (error->value) {
-         *error = fixscript_create_error(heap, *error);
-      }
-      else {
-         fixscript_error(heap, error, err);
-      }
+   if (global_get_value(heap, error, hc, shard, params[0], &value, &version)) {
       return fixscript_int(0);
    }
 
+   values[0] = fixscript_int(idx);
+   values[1] = fixscript_int(version);
+   values[2] = value;
+   entry = fixscript_create_array(heap, 3);
+   if (!entry.value) {
+      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   }
+   err = fixscript_set_array_range(heap, entry, 0, 3, values);
+   if (!err) {
+      err = fixscript_clone(heap, params[0], 1, &key);
+   }
+   if (!err) {
+      err = fixscript_set_hash_elem(heap, cache->hash, key, entry);
+   }
+   if (err) {
+      return fixscript_error(heap, error, err);
+   }
    return value;
 }
 
 
 static Value global_add(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
-   pthread_mutex_t *mutex;
+   GlobalShard *shard;
    Value key, value;
-   int err, prev_value=0;
+   int err, idx, prev_value=0;
    
-   mutex = get_global_mutex();
-   if (!mutex) {
-      return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
+   err = get_global_shard(heap, params[0], &shard, &idx);
+   if (err) {
+      return fixscript_error(heap, error, err);
    }
 
-   pthread_mutex_lock(mutex);
-   if (!ensure_global_heap()) {
-      pthread_mutex_unlock(mutex);
+   pthread_mutex_lock(&shard->mutex);
+   if (!ensure_global_heap(shard)) {
+      pthread_mutex_unlock(&shard->mutex);
       return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
    }
 
-   err = fixscript_clone_between(global_heap, heap, params[0], &key, NULL, NULL, NULL);
+   err = fixscript_clone_between(shard->heap, heap, params[0], &key, NULL, NULL, NULL);
    if (!err) {
-      err = fixscript_get_hash_elem(global_heap, global_hash, key, &value);
+      err = fixscript_get_hash_elem(shard->heap, shard->hash, key, &value);
       if (err == FIXSCRIPT_ERR_KEY_NOT_FOUND) {
          value = fixscript_int(0);
          err = FIXSCRIPT_SUCCESS;
@@ -5124,37 +6386,40 @@ static Value global_add(Heap *heap, Value *error, int num_params, Value *params,
    if (!err) {
       prev_value = value.value;
       value = fixscript_int((uint32_t)value.value + (uint32_t)params[1].value);
-      err = fixscript_set_hash_elem(global_heap, global_hash, key, value);
+      err = fixscript_set_hash_elem(shard->heap, shard->hash, key, value);
    }
    if (err) {
-      pthread_mutex_unlock(mutex);
+      pthread_mutex_unlock(&shard->mutex);
       return fixscript_error(heap, error, err);
    }
 
-   pthread_mutex_unlock(mutex);
+   shard->version++;
+   pthread_mutex_unlock(&shard->mutex);
 
    return fixscript_int(prev_value);
 }
 
 
-static uint32_t *get_atomic_ptr32(Heap *heap, Value *error, Value array, int idx)
+static uint32_t *get_atomic_ptr32(Heap *heap, int array, int idx)
 {
+   Value error = fixscript_int(0);
    uint32_t *ptr;
    int len, elem_size;
 
-   ptr = fixscript_get_shared_array_data(heap, array, &len, &elem_size, NULL, -1, NULL);
+   ptr = fixscript_get_shared_array_data(heap, (Value) { array, 1 }, &len, &elem_size, NULL, -1, NULL);
    if (!ptr) {
-      *error = fixscript_create_error_string(heap, "invalid shared array reference");
+      fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "invalid shared array reference"));
       return NULL;
    }
    
    if (elem_size != 4) {
-      *error = fixscript_create_error_string(heap, "element size must be 4 bytes");
+      fixscript_set_fast_native_error(heap, fixscript_create_error_string(heap, "element size must be 4 bytes"));
       return NULL;
    }
 
    if (idx < 0 || idx >= len) {
-      fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_BOUNDS);
+      fixscript_error(heap, &error, FIXSCRIPT_ERR_OUT_OF_BOUNDS);
+      fixscript_set_fast_native_error(heap, error);
       return NULL;
    }
 
@@ -5239,13 +6504,13 @@ static pthread_mutex_t *get_atomic_mutex(Heap *heap, Value *error, void *ptr)
 }
 
 
-static Value atomic_get32(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static int atomic_get32(Heap *heap, void *data, int array, int idx, int p3, int p4)
 {
    volatile uint32_t *ptr, value;
 
-   ptr = get_atomic_ptr32(heap, error, params[0], params[1].value);
+   ptr = get_atomic_ptr32(heap, array, idx);
    if (!ptr) {
-      return fixscript_int(0);
+      return 0;
    }
 
 #if defined(__i386__) || defined(__x86_64__)
@@ -5256,7 +6521,7 @@ static Value atomic_get32(Heap *heap, Value *error, int num_params, Value *param
    __sync_synchronize();
 #endif
 
-   return fixscript_int(value);
+   return value;
 }
 
 
@@ -5297,20 +6562,20 @@ static Value atomic_get64(Heap *heap, Value *error, int num_params, Value *param
 }
 
 
-static Value atomic_set32(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static int atomic_set32(Heap *heap, void *data, int array, int idx, int value, int p4)
 {
    volatile uint32_t *ptr;
 
-   ptr = get_atomic_ptr32(heap, error, params[0], params[1].value);
+   ptr = get_atomic_ptr32(heap, array, idx);
    if (!ptr) {
-      return fixscript_int(0);
+      return 0;
    }
 
    __sync_synchronize();
-   *ptr = params[2].value;
+   *ptr = value;
    __sync_synchronize();
 
-   return fixscript_int(0);
+   return 0;
 }
 
 
@@ -5348,17 +6613,16 @@ static Value atomic_set64(Heap *heap, Value *error, int num_params, Value *param
 }
 
 
-static Value atomic_add32(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static int atomic_add32(Heap *heap, void *data, int array, int idx, int value, int p4)
 {
-   volatile uint32_t *ptr, value;
+   volatile uint32_t *ptr;
 
-   ptr = get_atomic_ptr32(heap, error, params[0], params[1].value);
+   ptr = get_atomic_ptr32(heap, array, idx);
    if (!ptr) {
-      return fixscript_int(0);
+      return 0;
    }
 
-   value = __sync_fetch_and_add(ptr, params[2].value);
-   return fixscript_int(value);
+   return __sync_fetch_and_add(ptr, value);
 }
 
 
@@ -5398,17 +6662,16 @@ static Value atomic_add64(Heap *heap, Value *error, int num_params, Value *param
 }
 
 
-static Value atomic_cas32(Heap *heap, Value *error, int num_params, Value *params, void *data)
+static int atomic_cas32(Heap *heap, void *data, int array, int idx, int expected, int value)
 {
-   volatile uint32_t *ptr, value;
+   volatile uint32_t *ptr;
 
-   ptr = get_atomic_ptr32(heap, error, params[0], params[1].value);
+   ptr = get_atomic_ptr32(heap, array, idx);
    if (!ptr) {
-      return fixscript_int(0);
+      return 0;
    }
 
-   value = __sync_val_compare_and_swap(ptr, params[2].value, params[3].value);
-   return fixscript_int(value);
+   return __sync_val_compare_and_swap(ptr, expected, value);
 }
 
 
@@ -5451,6 +6714,91 @@ static Value atomic_cas64(Heap *heap, Value *error, int num_params, Value *param
 }
 
 
+enum {
+   ATOMIC_SWAP,
+   ATOMIC_AND,
+   ATOMIC_OR,
+   ATOMIC_XOR
+};
+
+static int atomic_op32(Heap *heap, void *data, int array, int idx, int value, int p4)
+{
+   volatile uint32_t *ptr;
+   uint32_t prev_value;
+
+   ptr = get_atomic_ptr32(heap, array, idx);
+   if (!ptr) {
+      return 0;
+   }
+
+   switch ((intptr_t)data) {
+      case ATOMIC_SWAP:
+         do {
+            prev_value = *ptr;
+         }
+         while (!__sync_bool_compare_and_swap(ptr, prev_value, value));
+         break;
+
+      case ATOMIC_AND: prev_value = __sync_fetch_and_and(ptr, value); break;
+      case ATOMIC_OR:  prev_value = __sync_fetch_and_or(ptr, value); break;
+      default:         prev_value = __sync_fetch_and_xor(ptr, value); break;
+   }
+
+   return prev_value;
+}
+
+
+static Value atomic_op64(Heap *heap, Value *error, int num_params, Value *params, void *data)
+{
+   volatile uint64_t *ptr;
+   uint64_t value, prev_value;
+
+   ptr = get_atomic_ptr64(heap, error, params[0], params[1].value);
+   if (!ptr) {
+      return fixscript_int(0);
+   }
+
+   value = ((uint32_t)params[2].value) | (((uint64_t)(uint32_t)params[3].value) << 32);
+
+#ifdef __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8
+   switch ((intptr_t)data) {
+      case ATOMIC_SWAP:
+         do {
+            prev_value = *ptr;
+         }
+         while (!__sync_bool_compare_and_swap(ptr, prev_value, value));
+         break;
+
+      case ATOMIC_AND: prev_value = __sync_fetch_and_and(ptr, value); break;
+      case ATOMIC_OR:  prev_value = __sync_fetch_and_or(ptr, value); break;
+      default:         prev_value = __sync_fetch_and_xor(ptr, value); break;
+   }
+#else
+   {
+      pthread_mutex_t *mutex;
+      
+      mutex = get_atomic_mutex(heap, error, (uint64_t *)ptr);
+      if (!mutex) {
+         return fixscript_int(0);
+      }
+
+      pthread_mutex_lock(mutex);
+      prev_value = *ptr;
+      switch ((intptr_t)data) {
+         case ATOMIC_SWAP: *ptr = value; break;
+         case ATOMIC_AND:  *ptr = prev_value & value; break;
+         case ATOMIC_OR:   *ptr = prev_value | value; break;
+         default:          *ptr = prev_value ^ value; break;
+      }
+      pthread_mutex_unlock(mutex);
+   }
+#endif
+
+   *error = fixscript_int((uint32_t)(prev_value >> 32));
+   return fixscript_int((uint32_t)prev_value);
+}
+
+
 static Value atomic_run(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
    pthread_mutex_t *mutex;
@@ -5861,38 +7209,141 @@ static void channel_set_receive_notify(void *data);
 #endif
 
 
+static int channel_queue_push(Channel *channel, Heap *heap, Value msg)
+{
+   Value value;
+   int i, err, cap, new_cap, wrapped;
+
+   err = fixscript_get_array_length(channel->queue_heap, channel->queue, &cap);
+   if (err) {
+      return err;
+   }
+
+   err = fixscript_clone_between(channel->queue_heap, heap, msg, &value, NULL, NULL, NULL);
+   if (err) {
+      return err;
+   }
+
+   if (channel->queue_count == cap) {
+      if (cap >= (1<<29)) {
+         return FIXSCRIPT_ERR_OUT_OF_MEMORY;
+      }
+      new_cap = cap? cap*2 : 4;
+      err = fixscript_set_array_length(channel->queue_heap, channel->queue, new_cap);
+      if (err) {
+         return err;
+      }
+      wrapped = channel->queue_head + channel->queue_count - cap;
+      if (wrapped > 0) {
+         err = fixscript_copy_array(channel->queue_heap, channel->queue, cap, channel->queue, 0, wrapped);
+         for (i=0; i<wrapped && !err; i++) {
+            err = fixscript_set_array_elem(channel->queue_heap, channel->queue, i, fixscript_int(0));
+         }
+         if (err) {
+            return err;
+         }
+      }
+      cap = new_cap;
+   }
+
+   err = fixscript_set_array_elem(channel->queue_heap, channel->queue, (channel->queue_head + channel->queue_count) % cap, value);
+   if (err) {
+      return err;
+   }
+   channel->queue_count++;
+   return FIXSCRIPT_SUCCESS;
+}
+
+
+static int channel_queue_pop(Channel *channel, Heap *heap, Value *value, Value *error)
+{
+   Value msg;
+   int err, cap;
+
+   err = fixscript_get_array_length(channel->queue_heap, channel->queue, &cap);
+   if (!err) {
+      err = fixscript_get_array_elem(channel->queue_heap, channel->queue, channel->queue_head, &msg);
+   }
+   if (err) {
+      return err;
+   }
+
+   err = fixscript_clone_between(heap, channel->queue_heap, msg, value, fixscript_resolve_existing, NULL, error);
+
+   fixscript_set_array_elem(channel->queue_heap, channel->queue, channel->queue_head, fixscript_int(0));
+   channel->queue_head = (channel->queue_head + 1) % cap;
+   if (--channel->queue_count == 0) {
+      // the queue heap contains only garbage at this point, making the collection cheap:
+      channel->queue_head = 0;
+      fixscript_collect_heap(channel->queue_heap);
+   }
+   return err;
+}
+
+
+static void ready_push(ChannelSet *set, ChannelEntry *entry)
+{
+   entry->ready_prev = set->ready_last;
+   entry->ready_next = NULL;
+   if (set->ready_last) {
+      set->ready_last->ready_next = entry;
+   }
+   else {
+      set->ready_first = entry;
+   }
+   set->ready_last = entry;
+   set->ready_cnt++;
+   entry->ready = 1;
+}
+
+
+static void ready_unlink(ChannelSet *set, ChannelEntry *entry)
+{
+   if (!entry->ready) return;
+
+   if (entry->ready_prev) {
+      entry->ready_prev->ready_next = entry->ready_next;
+   }
+   else {
+      set->ready_first = entry->ready_next;
+   }
+   if (entry->ready_next) {
+      entry->ready_next->ready_prev = entry->ready_prev;
+   }
+   else {
+      set->ready_last = entry->ready_prev;
+   }
+   entry->ready_prev = NULL;
+   entry->ready_next = NULL;
+   set->ready_cnt--;
+   entry->ready = 0;
+}
+
+
+static ChannelEntry *ready_rotate(ChannelSet *set)
+{
+   ChannelEntry *entry;
+
+   // move the first ready channel to the end so other ready channels are served before it again:
+   entry = set->ready_first;
+   if (entry && entry != set->ready_last) {
+      ready_unlink(set, entry);
+      ready_push(set, entry);
+   }
+   return entry;
+}
+
+
 static int notify_sets(Channel *channel)
 {
-   ChannelEntry *entry, **new_list;
+   ChannelEntry *entry;
    ChannelSet *set;
-   int i, found, new_cap;
 
    for (entry = channel->notify_entries; entry; entry = entry->notify_next) {
       set = entry->set;
       pthread_mutex_lock(&set->mutex);
-      found = 0;
-      for (i=0; i<set->notify_cnt; i++) {
-         if (set->notify_list[i] == entry) {
-            found = 1;
-            break;
-         }
-      }
-      if (!found) {
-         if (set->notify_cnt == set->notify_cap) {
-            if (set->notify_cap >= 1<<27) {
-               pthread_mutex_unlock(&set->mutex);
-               return 0;
-            }
-            new_cap = set->notify_cap? set->notify_cap*2 : 4;
-            new_list = realloc(set->notify_list, new_cap * sizeof(ChannelEntry *));
-            if (!new_list) {
-               pthread_mutex_unlock(&set->mutex);
-               return 0;
-            }
-            set->notify_cap = new_cap;
-            set->notify_list = new_list;
-         }
-         set->notify_list[set->notify_cnt++] = entry;
+      if (!entry->ready) {
+         ready_push(set, entry);
          pthread_cond_signal(&set->cond);
 
          #ifdef __wasm__
@@ -5912,17 +7363,11 @@ static void unnotify_sets(Channel *channel)
 {
    ChannelEntry *entry;
    ChannelSet *set;
-   int i;
 
    for (entry = channel->notify_entries; entry; entry = entry->notify_next) {
       set = entry->set;
       pthread_mutex_lock(&set->mutex);
-      for (i=0; i<set->notify_cnt; i++) {
-         if (set->notify_list[i] == entry) {
-            set->notify_list[i] = set->notify_list[--set->notify_cnt];
-            break;
-         }
-      }
+      ready_unlink(set, entry);
       pthread_mutex_unlock(&set->mutex);
    }
 }
@@ -5993,10 +7438,9 @@ static void channel_send_cont(void *data)
    ContinuationResultFunc cont_func;
    void *cont_data;
    Value error;
-   int err, len, had_timer=0;
+   int err, had_timer=0;
    
-   err = fixscript_get_array_length(channel->queue_heap, channel->queue, &len);
-   if (!err && len >= channel->size) {
+   if (channel->queue_count >= channel->size) {
       channel_wake_receivers(channel);
       channel_sender->next = channel->wasm_senders;
       channel->wasm_senders = channel_sender;
@@ -6008,12 +7452,7 @@ static void channel_send_cont(void *data)
       had_timer = 1;
    }
 
-   if (!err) {
-      err = fixscript_clone_between(channel->queue_heap, heap, value, &value, NULL, NULL, NULL);
-   }
-   if (!err) {
-      err = fixscript_append_array_elem(channel->queue_heap, channel->queue, value);
-   }
+   err = channel_queue_push(channel, heap, value);
    if (err) {
       cont_func = channel_sender->cont_func;
       cont_data = channel_sender->cont_data;
@@ -6062,8 +7501,7 @@ static void channel_send_cancel(void *data)
 static Value channel_send(Heap *heap, Value *error, int num_params, Value *params, void *data)
 {
    Channel *channel;
-   Value value;
-   int err, len, timeout = -1;
+   int err, timeout = -1;
    void *ptr;
 #ifdef __wasm__
    ChannelSender *channel_sender;
@@ -6086,6 +7524,11 @@ static Value channel_send(Heap *heap, Value *error, int num_params, Value *param
       timeout = params[2].value;
    }
 
+   // avoid locking when polling a full queue:
+   if (timeout == 0 && channel->size > 0 && channel->queue_count >= channel->size) {
+      return fixscript_int(0);
+   }
+
    pthread_mutex_lock(&channel->mutex);
 
    #ifndef __wasm__
@@ -6154,17 +7597,8 @@ static Value channel_send(Heap *heap, Value *error, int num_params, Value *param
    }
    else {
       for (;;) {
-         err = fixscript_get_array_length(channel->queue_heap, channel->queue, &len);
-         if (err) {
-            pthread_mutex_unlock(&channel->mutex);
-            return fixscript_error(heap, error, err);
-         }
-
-         if (len < channel->size) {
-            err = fixscript_clone_between(channel->queue_heap, heap, params[1], &value, NULL, NULL, NULL);
-            if (!err) {
-               err = fixscript_append_array_elem(channel->queue_heap, channel->queue, value);
-            }
+         if (channel->queue_count < channel->size) {
+            err = channel_queue_push(channel, heap, params[1]);
             pthread_cond_signal(&channel->receive_cond);
             #ifdef __wasm__
                channel_wake_receivers(channel);
@@ -6237,10 +7671,9 @@ static void channel_receive_cont(void *data)
    ContinuationResultFunc cont_func;
    void *cont_data;
    Value error = fixscript_int(0), value;
-   int len, err;
+   int err;
 
-   err = fixscript_get_array_length(channel->queue_heap, channel->queue, &len);
-   if (!err && len == 0) {
+   if (channel->queue_count == 0) {
       channel_wake_senders(channel);
       channel_receiver->next = channel->wasm_receivers;
       channel->wasm_receivers = channel_receiver;
@@ -6251,31 +7684,11 @@ static void channel_receive_cont(void *data)
       wasm_timer_stop(channel_receiver->cancel_timer);
    }
 
-   if (err) {
-      cont_func = channel_receiver->cont_func;
-      cont_data = channel_receiver->cont_data;
-      free(channel_receiver);
-      fixscript_error(heap, &error, err);
-      cont_func(heap, fixscript_int(0), error, cont_data);
-      return;
-   }
-
-   err = fixscript_get_array_elem(channel->queue_heap, channel->queue, 0, &value);
-   if (!err) {
-      err = fixscript_copy_array(channel->queue_heap, channel->queue, 0, channel->queue, 1, len-1);
-   }
-   if (!err) {
-      err = fixscript_set_array_length(channel->queue_heap, channel->queue, len-1);
-   }
-   if (!err) {
-      if (len-1 == 0) {
-         unnotify_sets(channel);
-      }
-      err = fixscript_clone_between(heap, channel->queue_heap, value, &value, fixscript_resolve_existing, NULL, &error);
+   err = channel_queue_pop(channel, heap, &value, &error);
+   if (channel->queue_count == 0) {
+      unnotify_sets(channel);
    }
 
-   fixscript_collect_heap(channel->queue_heap);
-
    cont_func = channel_receiver->cont_func;
    cont_data = channel_receiver->cont_data;
    free(channel_receiver);
@@ -6323,7 +7736,7 @@ static Value channel_receive(Heap *heap, Value *error, int num_params, Value *pa
 {
    Channel *channel;
    Value value;
-   int err, len, timeout = -1;
+   int err, timeout = -1;
    void *ptr;
 #ifdef __wasm__
    ChannelReceiver *channel_receiver;
@@ -6346,6 +7759,11 @@ static Value channel_receive(Heap *heap, Value *error, int num_params, Value *pa
       timeout = params[1].value;
    }
 
+   // avoid locking when polling an empty queue:
+   if (timeout == 0 && channel->size > 0 && channel->queue_count == 0) {
+      return params[2];
+   }
+
    pthread_mutex_lock(&channel->mutex);
 
    #ifndef __wasm__
@@ -6395,42 +7813,21 @@ static Value channel_receive(Heap *heap, Value *error, int num_params, Value *pa
    }
    else {
       for (;;) {
-         err = fixscript_get_array_length(channel->queue_heap, channel->queue, &len);
-         if (err) {
-            pthread_mutex_unlock(&channel->mutex);
-            return fixscript_error(heap, error, err);
-         }
-
-         if (len > 0) {
-            err = fixscript_get_array_elem(channel->queue_heap, channel->queue, 0, &value);
-            if (!err) {
-               err = fixscript_copy_array(channel->queue_heap, channel->queue, 0, channel->queue, 1, len-1);
-            }
-            if (!err) {
-               err = fixscript_set_array_length(channel->queue_heap, channel->queue, len-1);
-            }
+         if (channel->queue_count > 0) {
+            err = channel_queue_pop(channel, heap, &value, error);
             #ifdef __wasm__
                channel_wake_senders(channel);
             #endif
-            if (!err) {
-               if (len-1 == 0) {
-                  unnotify_sets(channel);
-               }
-               err = fixscript_clone_between(heap, channel->queue_heap, value, &value, fixscript_resolve_existing, NULL, error);
-               if (err) {
-                  pthread_cond_signal(&channel->send_cond);
-                  pthread_mutex_unlock(&channel->mutex);
-                  if (!error->value) {
-                     return fixscript_error(heap, error, err);
-                  }
-                  return fixscript_int(0);
-               }
-               fixscript_collect_heap(channel->queue_heap);
+            if (channel->queue_count == 0) {
+               unnotify_sets(channel);
             }
             pthread_cond_signal(&channel->send_cond);
             pthread_mutex_unlock(&channel->mutex);
             if (err) {
-               return fixscript_error(heap, error, err);
+               if (!error->value) {
+                  return fixscript_error(heap, error, err);
+               }
+               return fixscript_int(0);
             }
             return value;
          }
@@ -6670,7 +8067,6 @@ static void *channel_set_handler(Heap *heap, int op, void *p1, void *p2)
             }
          }
          free(set->entries);
-         free(set->notify_list);
          #ifdef __wasm__
             free(set->cont_data);
          #endif
@@ -6739,7 +8135,7 @@ static Value channel_set_add(Heap *heap, Value *error, int num_params, Value *pa
    Channel *channel;
    ChannelEntry *new_entry, *entry, *next, **prev, **new_entries;
    void *ptr;
-   int i, err, len, idx;
+   int i, idx;
 
    set = fixscript_get_handle(heap, params[0], HANDLE_TYPE_CHANNEL_SET, NULL);
    if (!set) {
@@ -6768,7 +8164,7 @@ static Value channel_set_add(Heap *heap, Value *error, int num_params, Value *pa
    new_entry->channel_val = params[1];
    new_entry->key = params[2];
 
-   if (set->entries_cnt > set->entries_cap/2 && set->entries_cap < 4096) {
+   if (set->entries_cnt > set->entries_cap/2 && set->entries_cap < (1<<24)) {
       new_entries = calloc(set->entries_cap*2, sizeof(ChannelEntry *));
       if (new_entries) {
          for (i=0; i<set->entries_cap; i++) {
@@ -6812,12 +8208,7 @@ static Value channel_set_add(Heap *heap, Value *error, int num_params, Value *pa
       }
    }
    else {
-      err = fixscript_get_array_length(channel->queue_heap, channel->queue, &len);
-      if (err) {
-         pthread_mutex_unlock(&channel->mutex);
-         return fixscript_error(heap, error, err);
-      }
-      if (len > 0) {
+      if (channel->queue_count > 0) {
          if (!notify_sets(channel)) {
             pthread_mutex_unlock(&channel->mutex);
             return fixscript_error(heap, error, FIXSCRIPT_ERR_OUT_OF_MEMORY);
@@ -6863,6 +8254,9 @@ static Value channel_set_remove(Heap *heap, Value *error, int num_params, Value
          *prev = entry->next;
          set->entries_cnt--;
          remove_notify(entry);
+         pthread_mutex_lock(&set->mutex);
+         ready_unlink(set, entry);
+         pthread_mutex_unlock(&set->mutex);
          free(entry);
          return fixscript_int(0);
       }
@@ -6933,8 +8327,9 @@ static void channel_set_receive_cont(void *data)
          case CHANNEL_SET_RECEIVE_ITERATE: {
             Value ret, error, receive_params[3];
 
-            if (csc->idx < csc->set->notify_cnt) {
-               csc->entry = csc->set->notify_list[csc->idx++];
+            if (csc->idx < csc->set->ready_cnt) {
+               csc->entry = ready_rotate(csc->set);
+               csc->idx++;
                receive_params[0] = csc->entry->channel_val;
                receive_params[1] = fixscript_int(0);
                receive_params[2] = csc->timeout_key;
@@ -7156,8 +8551,8 @@ static Value channel_set_receive(Heap *heap, Value *error, int num_params, Value
          }
       }
 
-      for (i=0; i<set->notify_cnt; i++) {
-         entry = set->notify_list[i];
+      for (i=0; i<set->ready_cnt; i++) {
+         entry = ready_rotate(set);
          pthread_mutex_unlock(&set->mutex);
          receive_params[0] = entry->channel_val;
          receive_params[1] = fixscript_int(0);
@@ -7277,6 +8672,7 @@ void fixtask_register_functions(Heap *heap, HeapCreateFunc create_func, void *cr
    fixscript_register_heap_key(&is_queue_heap_key);
    fixscript_register_heap_key(&parent_heap_key);
    fixscript_register_heap_key(&async_integration_key);
+   fixscript_register_heap_key(&global_cache_key);
 
    hc = malloc(sizeof(HeapCreateData));
    hc->create_func = create_func;
@@ -7302,19 +8698,31 @@ void fixtask_register_functions(Heap *heap, HeapCreateFunc create_func, void *cr
    fixscript_register_native_func(heap, "task_get#0", task_get, NULL);
    fixscript_register_native_func(heap, "task_send#1", task_send, NULL);
    fixscript_register_native_func(heap, "task_send#2", task_send, NULL);
+   fixscript_register_native_func(heap, "task_send_move#1", send_move, (void *)0);
+   fixscript_register_native_func(heap, "task_send_move#2", send_move, (void *)0);
    fixscript_register_native_func(heap, "task_receive#0", task_receive, (void *)0);
    fixscript_register_native_func(heap, "task_receive#1", task_receive, (void *)0);
    fixscript_register_native_func(heap, "task_receive_wait#1", task_receive, (void *)1);
    fixscript_register_native_func(heap, "task_receive_wait#2", task_receive, (void *)1);
    fixscript_register_native_func(heap, "task_sleep#1", sleep_func, NULL);
+   fixscript_register_native_func(heap, "task_set_heap_pool#2", task_set_heap_pool, hc);
+   fixscript_register_native_func(heap, "task_get_heap_pool_stats#0", task_get_heap_pool_stats, NULL);
 
    fixscript_register_native_func(heap, "compute_task_run#2", compute_task_run, hc);
    fixscript_register_native_func(heap, "compute_task_run#4", compute_task_run, hc);
    fixscript_register_native_func(heap, "compute_task_check_finished#0", compute_task_check_finished, NULL);
    fixscript_register_native_func(heap, "compute_task_finish_all#0", compute_task_finish_all, NULL);
+   fixscript_register_native_func(heap, "compute_task_preload#1", compute_task_preload, hc);
+   fixscript_register_native_func(heap, "compute_task_set_thread_affinity#1", compute_task_set_thread_affinity, hc);
    fixscript_register_native_func(heap, "compute_task_get_core_count#0", compute_task_get_core_count, NULL);
    fixscript_register_native_func(heap, "compute_task_run_parallel#4", compute_task_run_parallel, hc);
    fixscript_register_native_func(heap, "compute_task_run_parallel#5", compute_task_run_parallel, hc);
+   fixscript_register_native_func(heap, "compute_task_run_parallel_dynamic#4", compute_task_run_parallel_dynamic, hc);
+   fixscript_register_native_func(heap, "compute_task_run_parallel_dynamic#5", compute_task_run_parallel_dynamic, hc);
+   fixscript_register_native_func(heap, "compute_task_parallel_map#2", compute_task_parallel, NULL);
+   fixscript_register_native_func(heap, "compute_task_parallel_map#3", compute_task_parallel, NULL);
+   fixscript_register_native_func(heap, "compute_task_parallel_reduce#3", compute_task_parallel, (void *)1);
+   fixscript_register_native_func(heap, "compute_task_parallel_reduce#4", compute_task_parallel, (void *)1);
 
    fixscript_register_native_func(heap, "parent_ref_length#1", parent_ref_length, NULL);
    fixscript_register_native_func(heap, "parent_ref_array_get#2", parent_ref_array_get, NULL);
@@ -7422,16 +8830,25 @@ void fixtask_register_functions(Heap *heap, HeapCreateFunc create_func, void *cr
 
    fixscript_register_native_func(heap, "global_set#2", global_set, NULL);
    fixscript_register_native_func(heap, "global_get#1", global_get, hc);
+   fixscript_register_native_func(heap, "global_get_snapshot#1", global_get_snapshot, hc);
    fixscript_register_native_func(heap, "global_add#2", global_add, hc);
 
-   fixscript_register_native_func(heap, "atomic_get32#2", atomic_get32, NULL);
+   fixscript_register_fast_native_func(heap, "atomic_get32#2", atomic_get32, "iai", NULL);
    fixscript_register_native_func(heap, "atomic_get64#2", atomic_get64, NULL);
-   fixscript_register_native_func(heap, "atomic_set32#3", atomic_set32, NULL);
+   fixscript_register_fast_native_func(heap, "atomic_set32#3", atomic_set32, "vaii", NULL);
    fixscript_register_native_func(heap, "atomic_set64#4", atomic_set64, NULL);
-   fixscript_register_native_func(heap, "atomic_add32#3", atomic_add32, NULL);
+   fixscript_register_fast_native_func(heap, "atomic_add32#3", atomic_add32, "iaii", NULL);
    fixscript_register_native_func(heap, "atomic_add64#4", atomic_add64, NULL);
-   fixscript_register_native_func(heap, "atomic_cas32#4", atomic_cas32, NULL);
+   fixscript_register_fast_native_func(heap, "atomic_cas32#4", atomic_cas32, "iaiii", NULL);
    fixscript_register_native_func(heap, "atomic_cas64#6", atomic_cas64, NULL);
+   fixscript_register_fast_native_func(heap, "atomic_swap32#3", atomic_op32, "iaii", (void *)ATOMIC_SWAP);
+   fixscript_register_native_func(heap, "atomic_swap64#4", atomic_op64, (void *)ATOMIC_SWAP);
+   fixscript_register_fast_native_func(heap, "atomic_and32#3", atomic_op32, "iaii", (void *)ATOMIC_AND);
+   fixscript_register_native_func(heap, "atomic_and64#4", atomic_op64, (void *)ATOMIC_AND);
+   fixscript_register_fast_native_func(heap, "atomic_or32#3", atomic_op32, "iaii", (void *)ATOMIC_OR);
+   fixscript_register_native_func(heap, "atomic_or64#4", atomic_op64, (void *)ATOMIC_OR);
+   fixscript_register_fast_native_func(heap, "atomic_xor32#3", atomic_op32, "iaii", (void *)ATOMIC_XOR);
+   fixscript_register_native_func(heap, "atomic_xor64#4", atomic_op64, (void *)ATOMIC_XOR);
    fixscript_register_native_func(heap, "atomic_run#4", atomic_run, NULL);
 
    fixscript_register_native_func(heap, "barrier_create#1", barrier_create, NULL);
@@ -7442,6 +8859,7 @@ void fixtask_register_functions(Heap *heap, HeapCreateFunc create_func, void *cr
    fixscript_register_native_func(heap, "channel_create#1", channel_create, NULL);
    fixscript_register_native_func(heap, "channel_send#2", channel_send, NULL);
    fixscript_register_native_func(heap, "channel_send#3", channel_send, NULL);
+   fixscript_register_native_func(heap, "channel_send_move#2", send_move, (void *)1);
    fixscript_register_native_func(heap, "channel_receive#1", channel_receive, NULL);
    fixscript_register_native_func(heap, "channel_receive#3", channel_receive, NULL);
    fixscript_register_native_func(heap, "channel_get_sender#1", channel_get_sender, NULL);